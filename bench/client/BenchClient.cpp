@@ -0,0 +1,524 @@
+/**
+ * bench-client: HTTP/1.1 load generator for webserv (make bench-client).
+ *
+ *   ./bench-client [-c connections] [-d seconds] [-R rate] [-K] [-t timeout] [-f mix] host:port[/path]
+ *   ./bench-client -I connections [-S sources] [-P probes] [-p server_pid] host:port[/path]
+ *
+ * Closed loop by default: each connection sends its next request as soon as the
+ * previous response is complete. With -R the load is open loop: requests are
+ * scheduled at a fixed rate whether or not the server keeps up, and latency is
+ * measured from the time a request was scheduled, not from when a connection
+ * was free to send it, so queueing behind a slow server shows up in the tail
+ * instead of being omitted (coordinated omission).
+ *
+ * -K opens a new connection per request. A mix file lists requests, one per line:
+ *   [weight] METHOD /path [body]
+ * sent in weighted round robin so runs are reproducible. Latencies go into the
+ * server's own HDR LatencyHistogram.
+ *
+ * -I runs the idle connection benchmark of IdleBench.cpp instead.
+ */
+#include "BenchClient.hpp"
+#include <string>
+#include <vector>
+#include <map>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <cerrno>
+#include <ctime>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <netdb.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+struct BenchStats
+{
+	unsigned long long				requests;
+	unsigned long long				bytes;
+	unsigned long long				connect_errors;
+	unsigned long long				read_errors;
+	unsigned long long				timeouts;
+	std::map<short, unsigned long long>	statuses;
+	LatencyHistogram				latency;
+};
+
+long	nowUsec()
+{
+	struct timespec	ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (ts.tv_sec * 1000000L + ts.tv_nsec / 1000);
+}
+
+static void	usage(const char *name)
+{
+	std::cerr << "usage: " << name << " [-c connections] [-d seconds] [-R rate] [-K] [-t timeout] [-f mix] host:port[/path]" << std::endl
+		<< "  -c  concurrent connections (default 10)" << std::endl
+		<< "  -d  test duration in seconds (default 10)" << std::endl
+		<< "  -R  open loop at this many requests per second (default: closed loop)" << std::endl
+		<< "  -K  new connection per request instead of keep-alive" << std::endl
+		<< "  -t  seconds before a request counts as timed out (default 10)" << std::endl
+		<< "  -f  request mix file: [weight] METHOD /path [body] per line" << std::endl
+		<< "  -I  hold this many idle keep-alive connections and probe latency meanwhile" << std::endl
+		<< "  -S  spread idle connections over 127.0.0.1 to 127.0.0.<sources> (default: 1 per 20000)" << std::endl
+		<< "  -P  probe requests before and while connections are idle (default 1000)" << std::endl
+		<< "  -p  server pid, to report its RSS per connection" << std::endl;
+	exit(2);
+}
+
+static bool	parseOptions(int argc, char **argv, BenchOptions &options)
+{
+	int	opt;
+
+	options.connections = 10;
+	options.duration = 10;
+	options.rate = 0;
+	options.keep_alive = true;
+	options.timeout = 10;
+	options.idle = 0;
+	options.sources = 0;
+	options.probes = 1000;
+	options.server_pid = 0;
+	while ((opt = getopt(argc, argv, "c:d:R:Kt:f:I:S:P:p:")) != -1)
+	{
+		if (opt == 'c')
+			options.connections = std::strtoul(optarg, NULL, 10);
+		else if (opt == 'd')
+			options.duration = std::strtol(optarg, NULL, 10);
+		else if (opt == 'R')
+			options.rate = std::strtod(optarg, NULL);
+		else if (opt == 'K')
+			options.keep_alive = false;
+		else if (opt == 't')
+			options.timeout = std::strtol(optarg, NULL, 10);
+		else if (opt == 'f')
+			options.mix = optarg;
+		else if (opt == 'I')
+			options.idle = std::strtoul(optarg, NULL, 10);
+		else if (opt == 'S')
+			options.sources = std::strtoul(optarg, NULL, 10);
+		else if (opt == 'P')
+			options.probes = std::strtoul(optarg, NULL, 10);
+		else if (opt == 'p')
+			options.server_pid = std::strtol(optarg, NULL, 10);
+		else
+			return (false);
+	}
+	if (optind != argc - 1 || options.connections == 0 || options.duration <= 0 || options.timeout <= 0
+		|| options.rate < 0 || options.sources > 254)
+		return (false);
+	if (options.sources == 0)
+		options.sources = options.idle / 20000 + 1;
+	std::string target = argv[optind];
+	if (target.compare(0, 7, "http://") == 0)
+		target.erase(0, 7);
+	size_t slash = target.find('/');
+	options.path = slash == std::string::npos ? "/" : target.substr(slash);
+	target = target.substr(0, slash);
+	size_t colon = target.rfind(':');
+	options.host = target.substr(0, colon);
+	options.port = colon == std::string::npos ? "80" : target.substr(colon + 1);
+	return (!options.host.empty());
+}
+
+BenchRequest	buildRequest(const BenchOptions &options, const std::string &method,
+	const std::string &path, const std::string &body)
+{
+	BenchRequest		request;
+	std::ostringstream	raw;
+
+	raw << method << " " << path << " HTTP/1.1\r\n"
+		<< "Host: " << options.host << ":" << options.port << "\r\n"
+		<< "User-Agent: webserv-bench\r\n";
+	if (!options.keep_alive)
+		raw << "Connection: close\r\n";
+	if (!body.empty() || method == "POST")
+		raw << "Content-Type: application/x-www-form-urlencoded\r\nContent-Length: " << body.size() << "\r\n";
+	raw << "\r\n" << body;
+	request.raw = raw.str();
+	request.label = method + " " + path;
+	request.head = (method == "HEAD");
+	return (request);
+}
+
+/* the mix expanded by weight: requests are taken from it in turn */
+static bool	loadMix(const BenchOptions &options, std::vector<BenchRequest> &mix)
+{
+	if (options.mix.empty())
+	{
+		mix.push_back(buildRequest(options, "GET", options.path, ""));
+		return (true);
+	}
+	std::ifstream file(options.mix.c_str());
+	std::string line;
+	if (!file)
+		return (false);
+	while (std::getline(file, line))
+	{
+		std::istringstream	tokens(line);
+		std::string			first;
+		std::string			method;
+		std::string			path;
+		std::string			body;
+		unsigned long		weight = 1;
+
+		if (!(tokens >> first) || first[0] == '#')
+			continue ;
+		if (first.find_first_not_of("0123456789") == std::string::npos)
+		{
+			weight = std::strtoul(first.c_str(), NULL, 10);
+			tokens >> method;
+		}
+		else
+			method = first;
+		if (!(tokens >> path) || path[0] != '/')
+			return (false);
+		std::getline(tokens >> std::ws, body);
+		BenchRequest request = buildRequest(options, method, path, body);
+		for (unsigned long i = 0; i < weight; ++i)
+			mix.push_back(request);
+	}
+	return (!mix.empty());
+}
+
+static void	closeConnection(int epoll_fd, Connection &conn)
+{
+	if (conn.fd >= 0)
+	{
+		epoll_ctl(epoll_fd, EPOLL_CTL_DEL, conn.fd, NULL);
+		close(conn.fd);
+	}
+	conn.fd = -1;
+	conn.state = CONN_CLOSED;
+}
+
+static bool	openConnection(int epoll_fd, const struct addrinfo *address, Connection &conn, size_t index)
+{
+	struct epoll_event	event;
+	int					one = 1;
+
+	conn.fd = socket(address->ai_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (conn.fd < 0)
+		return (false);
+	setsockopt(conn.fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+	if (connect(conn.fd, address->ai_addr, address->ai_addrlen) < 0 && errno != EINPROGRESS)
+	{
+		close(conn.fd);
+		conn.fd = -1;
+		return (false);
+	}
+	event.events = EPOLLOUT;
+	event.data.u64 = index;
+	epoll_ctl(epoll_fd, EPOLL_CTL_ADD, conn.fd, &event);
+	conn.state = CONN_CONNECTING;
+	return (true);
+}
+
+static void	watch(int epoll_fd, Connection &conn, size_t index, unsigned int events)
+{
+	struct epoll_event	event;
+
+	event.events = events;
+	event.data.u64 = index;
+	epoll_ctl(epoll_fd, EPOLL_CTL_MOD, conn.fd, &event);
+}
+
+/* give conn its next request: it is written as soon as the socket is connected */
+static bool	assign(int epoll_fd, const struct addrinfo *address, Connection &conn, size_t index,
+	const BenchRequest &request, long intended)
+{
+	prepare(conn, request, intended);
+	if (conn.state == CONN_CLOSED)
+		return (openConnection(epoll_fd, address, conn, index));
+	conn.state = CONN_WRITING;
+	watch(epoll_fd, conn, index, EPOLLOUT);
+	return (true);
+}
+
+//sets conn up to send request and parse its response
+void	prepare(Connection &conn, const BenchRequest &request, long intended)
+{
+	conn.request = &request;
+	conn.intended = intended;
+	conn.out = request.raw;
+	conn.written = 0;
+	conn.in.clear();
+	conn.body_start = 0;
+	conn.content_length = -1;
+	conn.chunked = false;
+	conn.server_closes = false;
+	conn.status = 0;
+}
+
+static std::string	lower(std::string value)
+{
+	for (size_t i = 0; i < value.size(); ++i)
+		value[i] = std::tolower(value[i]);
+	return (value);
+}
+
+//true once the chunked body starting at start is complete
+static bool	chunkedComplete(const std::string &in, size_t pos)
+{
+	while (true)
+	{
+		size_t line_end = in.find("\r\n", pos);
+		if (line_end == std::string::npos)
+			return (false);
+		unsigned long size = std::strtoul(in.c_str() + pos, NULL, 16);
+		if (size == 0)
+			return (in.find("\r\n\r\n", line_end) != std::string::npos || in.compare(line_end, 4, "\r\n\r\n") == 0);
+		pos = line_end + 2 + size + 2;
+		if (pos > in.size())
+			return (false);
+	}
+}
+
+//true once conn holds a whole response
+bool	responseComplete(Connection &conn)
+{
+	if (conn.body_start == 0)
+	{
+		size_t end = conn.in.find("\r\n\r\n");
+		if (end == std::string::npos)
+			return (false);
+		conn.body_start = end + 4;
+		conn.status = std::atoi(conn.in.c_str() + 9);
+		std::istringstream headers(conn.in.substr(0, end));
+		std::string line;
+		std::getline(headers, line);
+		while (std::getline(headers, line))
+		{
+			size_t colon = line.find(':');
+			if (colon == std::string::npos)
+				continue ;
+			std::string name = lower(line.substr(0, colon));
+			std::string value = lower(line.substr(colon + 1));
+			if (name == "content-length")
+				conn.content_length = std::atol(value.c_str());
+			else if (name == "transfer-encoding" && value.find("chunked") != std::string::npos)
+				conn.chunked = true;
+			else if (name == "connection" && value.find("close") != std::string::npos)
+				conn.server_closes = true;
+		}
+		if (conn.request->head || conn.status == 204 || conn.status == 304 || conn.status < 200)
+			conn.content_length = 0;
+	}
+	if (conn.chunked)
+		return (chunkedComplete(conn.in, conn.body_start));
+	if (conn.content_length >= 0)
+		return (conn.in.size() >= conn.body_start + conn.content_length);
+	return (false);
+}
+
+static void	record(BenchStats &stats, Connection &conn, long now)
+{
+	++stats.requests;
+	++stats.statuses[conn.status];
+	stats.latency.record(now - conn.intended);
+}
+
+static void	report(const BenchOptions &options, const BenchStats &stats, long elapsed, unsigned long long backlog)
+{
+	static const double	spectrum[] = {0.5, 0.75, 0.9, 0.95, 0.99, 0.995, 0.999, 0.9999, 1.0};
+	double				seconds = elapsed / 1e6;
+
+	printf("Target %s:%s, %lu connections, %.1fs, %s, %s\n", options.host.c_str(), options.port.c_str(),
+		static_cast<unsigned long>(options.connections), seconds,
+		options.rate > 0 ? "open loop" : "closed loop", options.keep_alive ? "keep-alive" : "connection per request");
+	if (options.rate > 0)
+		printf("Target rate: %.1f req/s, requests not sent when the test ended: %llu\n", options.rate, backlog);
+	printf("Requests: %llu (%.1f req/s)  Bytes received: %llu (%.2f MB/s)\n", stats.requests,
+		stats.requests / seconds, stats.bytes, stats.bytes / seconds / 1e6);
+	printf("Errors: connect %llu, read %llu, timeout %llu\n", stats.connect_errors, stats.read_errors, stats.timeouts);
+	printf("Status:");
+	for (std::map<short, unsigned long long>::const_iterator it = stats.statuses.begin(); it != stats.statuses.end(); ++it)
+		printf(" %d:%llu", it->first, it->second);
+	printf("\nLatency (ms): p50 %.3f p90 %.3f p99 %.3f p999 %.3f max %.3f mean %.3f\n",
+		stats.latency.percentile(0.5) / 1000.0, stats.latency.percentile(0.9) / 1000.0,
+		stats.latency.percentile(0.99) / 1000.0, stats.latency.percentile(0.999) / 1000.0,
+		stats.latency.getMax() / 1000.0,
+		stats.latency.getCount() ? stats.latency.getSum() / 1000.0 / stats.latency.getCount() : 0.0);
+	printf("Percentile spectrum:\n  %12s %12s\n", "value (ms)", "percentile");
+	for (size_t i = 0; i < sizeof(spectrum) / sizeof(spectrum[0]); ++i)
+		printf("  %12.3f %12.4f\n", stats.latency.percentile(spectrum[i]) / 1000.0, spectrum[i] * 100);
+}
+
+int	main(int argc, char **argv)
+{
+	BenchOptions				options;
+	std::vector<BenchRequest>	mix;
+	struct addrinfo				hints;
+	struct addrinfo				*address;
+	BenchStats					stats;
+	struct epoll_event			events[BENCH_MAX_EVENTS];
+	char						buffer[BENCH_READ_SIZE];
+
+	if (!parseOptions(argc, argv, options))
+		usage(argv[0]);
+	if (!loadMix(options, mix))
+	{
+		std::cerr << "bench-client: cannot read request mix " << options.mix << std::endl;
+		return (1);
+	}
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_STREAM;
+	if (getaddrinfo(options.host.c_str(), options.port.c_str(), &hints, &address) != 0)
+	{
+		std::cerr << "bench-client: cannot resolve " << options.host << std::endl;
+		return (1);
+	}
+	signal(SIGPIPE, SIG_IGN);
+	if (options.idle > 0)
+	{
+		int status = runIdle(options, mix[0], address);
+		freeaddrinfo(address);
+		return (status);
+	}
+	stats.requests = 0;
+	stats.bytes = 0;
+	stats.connect_errors = 0;
+	stats.read_errors = 0;
+	stats.timeouts = 0;
+	int epoll_fd = epoll_create(1);
+	std::vector<Connection> conns(options.connections);
+	std::vector<size_t> idle;
+	for (size_t i = 0; i < conns.size(); ++i)
+	{
+		conns[i].fd = -1;
+		conns[i].state = CONN_CLOSED;
+		idle.push_back(i);
+	}
+	size_t				next_request = 0;
+	unsigned long long	scheduled = 0;
+	long				start = nowUsec();
+	long				end = start + options.duration * 1000000L;
+	long				now = start;
+	while (now < end)
+	{
+		//hand out requests to free connections: all of them when closed loop, those due when open loop
+		while (!idle.empty())
+		{
+			long intended = now;
+			if (options.rate > 0)
+			{
+				intended = start + static_cast<long>(scheduled * 1e6 / options.rate);
+				if (intended > now)
+					break ;
+			}
+			size_t index = idle.back();
+			idle.pop_back();
+			++scheduled;
+			if (!assign(epoll_fd, address, conns[index], index, mix[next_request++ % mix.size()], intended))
+			{
+				++stats.connect_errors;
+				idle.push_back(index);
+				break ;
+			}
+		}
+		int wait_ms = 100;
+		if (options.rate > 0 && !idle.empty())
+		{
+			long next = start + static_cast<long>(scheduled * 1e6 / options.rate);
+			wait_ms = next > now ? static_cast<int>((next - now) / 1000) : 0;
+		}
+		int ready = epoll_wait(epoll_fd, events, BENCH_MAX_EVENTS, wait_ms);
+		now = nowUsec();
+		for (int e = 0; e < ready; ++e)
+		{
+			size_t index = events[e].data.u64;
+			Connection &conn = conns[index];
+			if (conn.state == CONN_CONNECTING)
+			{
+				int error = 0;
+				socklen_t len = sizeof(error);
+				getsockopt(conn.fd, SOL_SOCKET, SO_ERROR, &error, &len);
+				if (error != 0)
+				{
+					++stats.connect_errors;
+					closeConnection(epoll_fd, conn);
+					idle.push_back(index);
+					continue ;
+				}
+				conn.state = CONN_WRITING;
+			}
+			if (conn.state == CONN_WRITING)
+			{
+				ssize_t n = write(conn.fd, conn.out.data() + conn.written, conn.out.size() - conn.written);
+				if (n < 0 && errno != EAGAIN)
+				{
+					++stats.read_errors;
+					closeConnection(epoll_fd, conn);
+					idle.push_back(index);
+					continue ;
+				}
+				if (n > 0)
+					conn.written += n;
+				if (conn.written == conn.out.size())
+				{
+					conn.state = CONN_READING;
+					watch(epoll_fd, conn, index, EPOLLIN);
+				}
+				continue ;
+			}
+			if (conn.state != CONN_READING)
+				continue ;
+			ssize_t n = read(conn.fd, buffer, sizeof(buffer));
+			if (n < 0 && errno == EAGAIN)
+				continue ;
+			if (n > 0)
+			{
+				stats.bytes += n;
+				conn.in.append(buffer, n);
+			}
+			bool complete = (n > 0 && responseComplete(conn));
+			//a response without length or chunking ends with the connection
+			if (n == 0 && conn.body_start != 0 && conn.content_length < 0 && !conn.chunked)
+				complete = true;
+			if (complete)
+			{
+				record(stats, conn, now);
+				if (!options.keep_alive || conn.server_closes || n == 0)
+					closeConnection(epoll_fd, conn);
+				else
+					conn.state = CONN_IDLE;
+			}
+			else if (n <= 0)
+			{
+				++stats.read_errors;
+				closeConnection(epoll_fd, conn);
+			}
+			else
+				continue ;
+			idle.push_back(index);
+		}
+		//requests taking longer than the timeout are counted and their connection dropped
+		for (size_t i = 0; i < conns.size(); ++i)
+		{
+			if ((conns[i].state == CONN_WRITING || conns[i].state == CONN_READING || conns[i].state == CONN_CONNECTING)
+				&& now - conns[i].intended > options.timeout * 1000000L)
+			{
+				++stats.timeouts;
+				closeConnection(epoll_fd, conns[i]);
+				idle.push_back(i);
+			}
+		}
+	}
+	unsigned long long due = options.rate > 0 ? static_cast<unsigned long long>((end - start) / 1e6 * options.rate) : 0;
+	report(options, stats, nowUsec() - start, due > scheduled ? due - scheduled : 0);
+	for (size_t i = 0; i < conns.size(); ++i)
+		closeConnection(epoll_fd, conns[i]);
+	close(epoll_fd);
+	freeaddrinfo(address);
+	return (0);
+}
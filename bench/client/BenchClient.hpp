@@ -0,0 +1,67 @@
+#ifndef BENCHCLIENT_HPP
+# define BENCHCLIENT_HPP
+
+# include "../../includes/Metrics/LatencyHistogram.hpp"
+# include <string>
+# include <netdb.h>
+
+#define BENCH_READ_SIZE		65536
+#define BENCH_MAX_EVENTS	256
+
+struct BenchRequest
+{
+	std::string	raw;
+	std::string	label;
+	bool		head;
+};
+
+struct BenchOptions
+{
+	std::string		host;
+	std::string		port;
+	std::string		path;
+	size_t			connections;
+	long			duration; //seconds
+	double			rate; //requests per second, 0 for closed loop
+	bool			keep_alive;
+	long			timeout; //seconds a request may take
+	std::string		mix;
+	size_t			idle; //connections held open by the idle benchmark, 0 for a load test
+	size_t			sources; //127.0.0.x source addresses the idle connections come from
+	size_t			probes; //requests timed before and while the connections sit idle
+	long			server_pid; //server whose RSS is read from /proc, 0 if not given
+};
+
+enum ConnState
+{
+	CONN_CLOSED,
+	CONN_IDLE,
+	CONN_CONNECTING,
+	CONN_WRITING,
+	CONN_READING
+};
+
+struct Connection
+{
+	int				fd;
+	ConnState		state;
+	std::string		out;
+	size_t			written;
+	std::string		in;
+	const BenchRequest	*request;
+	long			intended; //usec the request was scheduled for
+	size_t			body_start; //0 until the header block is complete
+	long			content_length; //-1 when not given
+	bool			chunked;
+	bool			server_closes;
+	short			status;
+};
+
+long			nowUsec();
+BenchRequest	buildRequest(const BenchOptions &options, const std::string &method,
+					const std::string &path, const std::string &body);
+void			prepare(Connection &conn, const BenchRequest &request, long intended);
+bool			responseComplete(Connection &conn);
+int				runIdle(const BenchOptions &options, const BenchRequest &request, const struct addrinfo *address);
+
+#endif
@@ -0,0 +1,291 @@
+/**
+ * Idle connection benchmark (bench-client -I connections): does holding many
+ * idle keep-alive connections cost the server memory or slow down active ones?
+ *
+ * 1. times -P probe requests, one after the other on a single connection;
+ * 2. opens the connections, each sending one request and keeping its socket open
+ *    once answered. Source addresses cycle over 127.0.0.1 to 127.0.0.<-S>, since a
+ *    single address runs out of ephemeral ports (about 28k) before C100K;
+ * 3. reads the server's VmRSS (-p pid) before and after, for the memory it keeps
+ *    per connection (socket buffers live in the kernel and are not counted);
+ * 4. times the probes again with the connections held, then counts how many of
+ *    them the server closed meanwhile.
+ *
+ * Both processes need an open file limit above the connection count: for C100K
+ * raise the hard limit (ulimit -Hn) of the shell starting them.
+ */
+#include "BenchClient.hpp"
+#include <vector>
+#include <fstream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#define IDLE_IN_FLIGHT	512 /**< Connections being opened at once. */
+
+struct IdleCounts
+{
+	size_t	open;
+	size_t	failed;
+	long	connected; //usec from the first connect to the last connection established
+	long	served; //usec from the first connect to the last first response
+};
+
+//VmRSS of pid in kB, -1 if unknown
+static long	readRss(long pid)
+{
+	char		path[64];
+	std::string	line;
+
+	if (pid <= 0)
+		return (-1);
+	snprintf(path, sizeof(path), "/proc/%ld/status", pid);
+	std::ifstream status(path);
+	while (std::getline(status, line))
+		if (line.compare(0, 6, "VmRSS:") == 0)
+			return (std::strtol(line.c_str() + 6, NULL, 10));
+	return (-1);
+}
+
+//raises the soft open file limit to the hard one, false if it stays below needed
+static bool	raiseFileLimit(size_t needed)
+{
+	struct rlimit	limit;
+
+	if (getrlimit(RLIMIT_NOFILE, &limit) != 0)
+		return (false);
+	if (limit.rlim_cur < limit.rlim_max)
+	{
+		limit.rlim_cur = limit.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &limit);
+		getrlimit(RLIMIT_NOFILE, &limit);
+	}
+	return (limit.rlim_cur >= needed);
+}
+
+//a socket bound to 127.0.0.<1 + source>, port left to connect(), or -1
+static int	sourceSocket(size_t source, int flags)
+{
+	struct sockaddr_in	address;
+	int					one = 1;
+	int					fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC | flags, 0);
+
+	if (fd < 0)
+		return (-1);
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+#ifdef IP_BIND_ADDRESS_NO_PORT
+	//the port is picked at connect(), per destination, instead of reserved here
+	setsockopt(fd, IPPROTO_IP, IP_BIND_ADDRESS_NO_PORT, &one, sizeof(one));
+#endif
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK + source);
+	if (bind(fd, reinterpret_cast<struct sockaddr *>(&address), sizeof(address)) < 0)
+	{
+		close(fd);
+		return (-1);
+	}
+	return (fd);
+}
+
+/* probes one request at a time over a blocking connection, false if it broke */
+static bool	probe(const struct addrinfo *address, const BenchRequest &request, size_t count, LatencyHistogram &latency)
+{
+	Connection	conn;
+	char		buffer[BENCH_READ_SIZE];
+	int			fd = sourceSocket(0, 0);
+
+	if (fd < 0 || connect(fd, address->ai_addr, address->ai_addrlen) < 0)
+	{
+		if (fd >= 0)
+			close(fd);
+		return (false);
+	}
+	for (size_t i = 0; i < count; ++i)
+	{
+		long start = nowUsec();
+		prepare(conn, request, start);
+		bool ok = (write(fd, conn.out.data(), conn.out.size()) == static_cast<ssize_t>(conn.out.size()));
+		while (ok && !responseComplete(conn))
+		{
+			ssize_t n = read(fd, buffer, sizeof(buffer));
+			ok = (n > 0);
+			if (ok)
+				conn.in.append(buffer, n);
+		}
+		if (!ok || conn.server_closes)
+		{
+			close(fd);
+			return (false);
+		}
+		latency.record(nowUsec() - start);
+	}
+	close(fd);
+	return (true);
+}
+
+static void	dropConnection(int epoll_fd, Connection &conn, IdleCounts &counts)
+{
+	epoll_ctl(epoll_fd, EPOLL_CTL_DEL, conn.fd, NULL);
+	close(conn.fd);
+	conn.fd = -1;
+	conn.state = CONN_CLOSED;
+	++counts.failed;
+}
+
+/**
+ * Opens every connection, IDLE_IN_FLIGHT at a time, sends its request and leaves
+ * it open once the response arrived. Gives up on the connections still being
+ * opened when none made progress for the timeout.
+ */
+static void	openIdle(const BenchOptions &options, const BenchRequest &request, const struct addrinfo *address,
+	std::vector<Connection> &conns, IdleCounts &counts)
+{
+	struct epoll_event	events[BENCH_MAX_EVENTS];
+	char				buffer[BENCH_READ_SIZE];
+	int					epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	size_t				next = 0;
+	size_t				in_flight = 0;
+	long				start = nowUsec();
+	long				progress = start;
+
+	while (next < conns.size() || in_flight > 0)
+	{
+		for (; next < conns.size() && in_flight < IDLE_IN_FLIGHT; ++next)
+		{
+			Connection &conn = conns[next];
+			struct epoll_event event;
+			prepare(conn, request, 0);
+			conn.fd = sourceSocket(next % options.sources, SOCK_NONBLOCK);
+			if (conn.fd < 0 || (connect(conn.fd, address->ai_addr, address->ai_addrlen) < 0 && errno != EINPROGRESS))
+			{
+				if (conn.fd >= 0)
+					close(conn.fd);
+				conn.fd = -1;
+				conn.state = CONN_CLOSED;
+				++counts.failed;
+				continue ;
+			}
+			event.events = EPOLLOUT;
+			event.data.u64 = next;
+			epoll_ctl(epoll_fd, EPOLL_CTL_ADD, conn.fd, &event);
+			conn.state = CONN_CONNECTING;
+			++in_flight;
+		}
+		int ready = epoll_wait(epoll_fd, events, BENCH_MAX_EVENTS, 1000);
+		long now = nowUsec();
+		if (ready <= 0 && now - progress > options.timeout * 1000000L)
+			break ;
+		for (int e = 0; e < ready; ++e)
+		{
+			Connection &conn = conns[events[e].data.u64];
+			if (conn.state == CONN_CONNECTING)
+			{
+				int error = 0;
+				socklen_t len = sizeof(error);
+				getsockopt(conn.fd, SOL_SOCKET, SO_ERROR, &error, &len);
+				if (error != 0 || write(conn.fd, conn.out.data(), conn.out.size()) != static_cast<ssize_t>(conn.out.size()))
+				{
+					dropConnection(epoll_fd, conn, counts);
+					--in_flight;
+					continue ;
+				}
+				conn.state = CONN_READING;
+				events[e].events = EPOLLIN;
+				epoll_ctl(epoll_fd, EPOLL_CTL_MOD, conn.fd, &events[e]);
+				counts.connected = now - start;
+				progress = now;
+				continue ;
+			}
+			ssize_t n = read(conn.fd, buffer, sizeof(buffer));
+			if (n < 0 && errno == EAGAIN)
+				continue ;
+			if (n > 0)
+				conn.in.append(buffer, n);
+			if (n > 0 && responseComplete(conn) && !conn.server_closes)
+			{
+				epoll_ctl(epoll_fd, EPOLL_CTL_DEL, conn.fd, NULL);
+				conn.state = CONN_IDLE;
+				conn.in.clear();
+				++counts.open;
+				counts.served = now - start;
+				progress = now;
+				--in_flight;
+			}
+			else if (n <= 0 || conn.server_closes)
+			{
+				dropConnection(epoll_fd, conn, counts);
+				--in_flight;
+			}
+		}
+	}
+	for (size_t i = 0; i < conns.size(); ++i)
+		if (conns[i].state == CONN_CONNECTING || conns[i].state == CONN_READING)
+			dropConnection(epoll_fd, conns[i], counts);
+	close(epoll_fd);
+}
+
+static void	printLatency(const char *label, const LatencyHistogram &latency)
+{
+	printf("  %-12s %10.3f %10.3f %10.3f %10.3f %10.3f\n", label, latency.percentile(0.5) / 1000.0,
+		latency.percentile(0.9) / 1000.0, latency.percentile(0.99) / 1000.0,
+		latency.percentile(0.999) / 1000.0, latency.getMax() / 1000.0);
+}
+
+int	runIdle(const BenchOptions &options, const BenchRequest &request, const struct addrinfo *address)
+{
+	std::vector<Connection>	conns(options.idle);
+	IdleCounts				counts = {0, 0, 0, 0};
+	LatencyHistogram		before;
+	LatencyHistogram		during;
+	char					byte;
+
+	if (!raiseFileLimit(options.idle + 16))
+		fprintf(stderr, "bench-client: open file limit below %lu, raise ulimit -Hn\n",
+			static_cast<unsigned long>(options.idle + 16));
+	if (!probe(address, request, options.probes, before))
+	{
+		fprintf(stderr, "bench-client: probe requests to %s:%s failed\n", options.host.c_str(), options.port.c_str());
+		return (1);
+	}
+	long rss_before = readRss(options.server_pid);
+	openIdle(options, request, address, conns, counts);
+	long rss_after = readRss(options.server_pid);
+	bool probed = probe(address, request, options.probes, during);
+	size_t closed = 0;
+	for (size_t i = 0; i < conns.size(); ++i)
+	{
+		if (conns[i].state != CONN_IDLE)
+			continue ;
+		if (recv(conns[i].fd, &byte, 1, MSG_PEEK | MSG_DONTWAIT) == 0)
+			++closed;
+		close(conns[i].fd);
+	}
+
+	printf("Target %s:%s, %lu idle connections from %lu source address%s\n", options.host.c_str(), options.port.c_str(),
+		static_cast<unsigned long>(options.idle), static_cast<unsigned long>(options.sources),
+		options.sources == 1 ? "" : "es");
+	printf("Opened: %lu, failed: %lu\n", static_cast<unsigned long>(counts.open), static_cast<unsigned long>(counts.failed));
+	if (counts.connected > 0)
+		printf("Connect rate: %.0f conn/s (%.3fs to connect all), all answered after %.3fs\n",
+			(counts.open + counts.failed) / (counts.connected / 1e6), counts.connected / 1e6, counts.served / 1e6);
+	if (rss_before >= 0 && rss_after >= 0)
+		printf("Server RSS: %ld kB before, %ld kB after, %.2f kB per connection\n", rss_before, rss_after,
+			counts.open ? static_cast<double>(rss_after - rss_before) / counts.open : 0.0);
+	printf("Probe latency (ms, %lu requests):\n  %-12s %10s %10s %10s %10s %10s\n", static_cast<unsigned long>(options.probes),
+		"", "p50", "p90", "p99", "p999", "max");
+	printLatency("before", before);
+	if (probed)
+		printLatency("while idle", during);
+	else
+		printf("  while idle: probe connection failed\n");
+	printf("Closed by the server while idle: %lu\n", static_cast<unsigned long>(closed));
+	return (probed ? 0 : 1);
+}
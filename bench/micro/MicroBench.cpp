@@ -0,0 +1,445 @@
+/**
+ * bench-micro: microbenchmarks of the server's hot paths (make bench).
+ *
+ *   ./bench-micro [-f filter] [-t min_ms] [-o out.json] [-c baseline.json] [-T percent]
+ *
+ * Each benchmark is run for at least min_ms (default 200) with a doubling number
+ * of iterations, five times, keeping the fastest run. It reports ns/op and the
+ * allocations and bytes allocated per op, counted by WebServer::AllocStats,
+ * which the benchmark is always built with.
+ *
+ * -o writes the results as JSON; -c reads such a file back and flags every
+ * benchmark whose ns/op, allocs/op or bytes/op grew by more than the threshold
+ * (-T, default 10%), exiting 1 if any did. Timings only compare on the same
+ * machine: refresh the baseline with make bench-baseline after moving.
+ */
+#include "../../includes/HTTPMessage/HTTPRequest/HTTPRequest.hpp"
+#include "../../includes/ConfigParser/ConfigParser.hpp"
+#include "../../includes/Router/Router.hpp"
+#include "../../includes/Utils/Clock.hpp"
+#include "../../includes/Utils/AllocStats.hpp"
+#include "../../includes/Utils/BufferPool.hpp"
+#include <string>
+#include <algorithm>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+
+#define BENCH_RUNS			5
+#define BENCH_SERVERS		50 /**< Servers in the synthetic config. */
+#define BENCH_LOCATIONS		20 /**< Locations per synthetic server. */
+#define BENCH_PIPELINED		16 /**< Requests in one pipelined buffer. */
+#define BENCH_FRAGMENT		16 /**< Bytes per read in the fragmented parse. */
+
+static volatile size_t		g_sink = 0; //results are folded in so the compiler keeps the work
+
+struct BenchResult
+{
+	std::string	name;
+	double		ns_per_op;
+	double		allocs_per_op;
+	double		bytes_per_op;
+};
+
+typedef void	(*BenchFunction)(size_t iterations);
+
+struct Benchmark
+{
+	const char		*name;
+	BenchFunction	run;
+};
+
+/* inputs, built once before timing */
+static std::string			g_small_request;
+static std::string			g_large_request;
+static std::string			g_pipelined;
+static std::string			g_config_path;
+static std::vector<Server>	g_servers;
+static std::string			g_location_target;
+static HTTPRequest			g_vhost_request;
+
+static void	buildInputs()
+{
+	std::ostringstream	large;
+	std::ostringstream	config;
+	char				path[] = "/tmp/webserv-bench-XXXXXX";
+
+	g_small_request = "GET /index.html HTTP/1.1\r\nHost: localhost:8000\r\nUser-Agent: bench\r\nAccept: */*\r\n\r\n";
+	large << "GET /tours/tour1.html?id=42&sort=asc HTTP/1.1\r\nHost: localhost:8000\r\n";
+	for (int i = 0; i < 40; ++i)
+		large << "X-Bench-Header-" << i << ": value-" << std::string(40, 'a' + i % 26) << "\r\n";
+	large << "Cookie: " << std::string(2048, 'c') << "\r\n\r\n";
+	g_large_request = large.str();
+	for (int i = 0; i < BENCH_PIPELINED; ++i)
+		g_pipelined += g_small_request;
+
+	for (int s = 0; s < BENCH_SERVERS; ++s)
+	{
+		config << "server {\n    listen 127.0.0.1:" << 8000 + s << ";\n    server_name s" << s << ".bench;\n"
+			<< "    root docs/fusion_web/;\n    index index.html;\n    error_page 404 error_pages/404.html;\n";
+		//redirects: the locations need no directories on disk
+		for (int l = 0; l < BENCH_LOCATIONS; ++l)
+			config << "    location /section" << l << "/page {\n        allow_methods GET POST;\n"
+				<< "        return 301 /tours;\n    }\n";
+		config << "}\n";
+	}
+	int fd = mkstemp(path);
+	if (fd < 0)
+	{
+		perror("bench-micro: mkstemp");
+		exit(1);
+	}
+	std::string content = config.str();
+	if (write(fd, content.data(), content.size()) != static_cast<ssize_t>(content.size()))
+		perror("bench-micro: write");
+	close(fd);
+	g_config_path = path;
+	ConfigParser parser;
+	parser.extractServerBlocks(g_config_path);
+	g_servers = parser.getServers();
+	std::ostringstream target;
+	target << "/section" << BENCH_LOCATIONS - 1 << "/page/images/photo.jpg";
+	g_location_target = target.str();
+	std::ostringstream vhost;
+	vhost << "GET / HTTP/1.1\r\nHost: s" << BENCH_SERVERS - 1 << ".bench:" << 8000 + BENCH_SERVERS - 1 << "\r\n\r\n";
+	g_vhost_request = HTTPRequest(vhost.str());
+}
+
+static void	benchParseSmall(size_t iterations)
+{
+	for (size_t i = 0; i < iterations; ++i)
+	{
+		HTTPRequest request(g_small_request);
+		g_sink += request.getHeaders().size();
+	}
+}
+
+static void	benchParseLargeHeaders(size_t iterations)
+{
+	for (size_t i = 0; i < iterations; ++i)
+	{
+		HTTPRequest request(g_large_request);
+		g_sink += request.getHeaders().size();
+	}
+}
+
+//first CRLFCRLF in the buffered bytes, NULL if none
+static const char	*headerEnd(const InputBuffer &input)
+{
+	const char *found = static_cast<const char *>(memmem(input.data(), input.size(),
+		FIELD_LINE_SEPARATOR, strlen(FIELD_LINE_SEPARATOR)));
+
+	return (found == NULL ? NULL : found + strlen(FIELD_LINE_SEPARATOR));
+}
+
+//copies len bytes of data into input the way Router::readRequest's recv() does
+static void	receive(InputBuffer &input, const char *data, size_t len)
+{
+	size_t	room;
+	char	*dst = input.reserve(BUFFER_SMALL, room);
+
+	len = std::min(len, room);
+	memcpy(dst, data, len);
+	input.commit(len);
+}
+
+//one op is a buffer of BENCH_PIPELINED requests, split the way Router::parseRequest does
+static void	benchParsePipelined(size_t iterations)
+{
+	for (size_t i = 0; i < iterations; ++i)
+	{
+		InputBuffer input;
+		const char *body_start;
+		receive(input, g_pipelined.data(), g_pipelined.size());
+		while ((body_start = headerEnd(input)) != NULL)
+		{
+			HTTPRequest request;
+			request.parse(input.data(), body_start - input.data());
+			g_sink += request.getHeaders().size();
+			input.consume(body_start - input.data());
+		}
+	}
+}
+
+//the request arrives BENCH_FRAGMENT bytes per read, the buffer is searched after each
+static void	benchParseFragmented(size_t iterations)
+{
+	for (size_t i = 0; i < iterations; ++i)
+	{
+		InputBuffer input;
+		const char *body_start = NULL;
+		for (size_t pos = 0; body_start == NULL && pos < g_small_request.size(); pos += BENCH_FRAGMENT)
+		{
+			receive(input, g_small_request.data() + pos, std::min<size_t>(BENCH_FRAGMENT, g_small_request.size() - pos));
+			body_start = headerEnd(input);
+		}
+		HTTPRequest request;
+		request.parse(input.data(), body_start - input.data());
+		g_sink += request.getHeaders().size();
+	}
+}
+
+static void	benchSplitString(size_t iterations)
+{
+	const std::string line = "allow_methods GET POST DELETE PUT HEAD OPTIONS;";
+
+	for (size_t i = 0; i < iterations; ++i)
+		g_sink += WebServer::Utils::splitString(line).size();
+}
+
+static void	benchStoi(size_t iterations)
+{
+	const std::string value = "50000000";
+
+	for (size_t i = 0; i < iterations; ++i)
+		g_sink += WebServer::Utils::ft_stoi(value);
+}
+
+static void	benchStatusCodeString(size_t iterations)
+{
+	static const short codes[] = {200, 201, 204, 301, 304, 400, 403, 404, 413, 500, 502, 504};
+
+	for (size_t i = 0; i < iterations; ++i)
+		g_sink += WebServer::Utils::statusCodeString(codes[i % 12]).size();
+}
+
+static void	benchConfigExtract(size_t iterations)
+{
+	for (size_t i = 0; i < iterations; ++i)
+	{
+		ConfigParser parser;
+		parser.extractServerBlocks(g_config_path);
+		g_sink += parser.getServers().size();
+	}
+}
+
+//longest prefix match over BENCH_LOCATIONS locations, hitting the last one
+static void	benchLocationLookup(size_t iterations)
+{
+	const Server &server = g_servers[0];
+
+	for (size_t i = 0; i < iterations; ++i)
+		g_sink += (size_t)server.matchLocation(g_location_target);
+}
+
+//server_name match over BENCH_SERVERS servers, hitting the last one
+static void	benchVhostLookup(size_t iterations)
+{
+	for (size_t i = 0; i < iterations; ++i)
+		g_sink += (size_t)&Router::matchServer(g_servers, g_vhost_request);
+}
+
+static const Benchmark	g_benchmarks[] = {
+	{"parse_small", benchParseSmall},
+	{"parse_large_headers", benchParseLargeHeaders},
+	{"parse_pipelined_16", benchParsePipelined},
+	{"parse_fragmented", benchParseFragmented},
+	{"split_string", benchSplitString},
+	{"ft_stoi", benchStoi},
+	{"status_code_string", benchStatusCodeString},
+	{"config_extract_50x20", benchConfigExtract},
+	{"location_lookup_20", benchLocationLookup},
+	{"vhost_lookup_50", benchVhostLookup}
+};
+
+static BenchResult	measure(const Benchmark &bench, long min_usec)
+{
+	BenchResult	result;
+	size_t		iterations = 1;
+	long		elapsed = 0;
+
+	result.name = bench.name;
+	//grow the iteration count until one run lasts min_usec
+	while (true)
+	{
+		long start = WebServer::Clock::monotonicUsec();
+		bench.run(iterations);
+		elapsed = WebServer::Clock::monotonicUsec() - start;
+		if (elapsed >= min_usec)
+			break ;
+		iterations *= (elapsed < min_usec / 10) ? 10 : 2;
+	}
+	result.ns_per_op = elapsed * 1000.0 / iterations;
+	for (int run = 0; run < BENCH_RUNS; ++run)
+	{
+		AllocCounts before = WebServer::AllocStats::threadTotal();
+		long start = WebServer::Clock::monotonicUsec();
+		bench.run(iterations);
+		elapsed = WebServer::Clock::monotonicUsec() - start;
+		if (elapsed * 1000.0 / iterations < result.ns_per_op)
+			result.ns_per_op = elapsed * 1000.0 / iterations;
+		AllocCounts after = WebServer::AllocStats::threadTotal();
+		result.allocs_per_op = static_cast<double>(after.allocs - before.allocs) / iterations;
+		result.bytes_per_op = static_cast<double>(after.bytes - before.bytes) / iterations;
+	}
+	return (result);
+}
+
+static bool	writeJson(const std::string &path, const std::vector<BenchResult> &results)
+{
+	std::ofstream	out(path.c_str());
+
+	if (!out)
+		return (false);
+	out << "{\n  \"benchmarks\": [\n";
+	for (size_t i = 0; i < results.size(); ++i)
+	{
+		char line[256];
+		snprintf(line, sizeof(line), "    {\"name\": \"%s\", \"ns_per_op\": %.2f, \"allocs_per_op\": %.2f, \"bytes_per_op\": %.2f}%s\n",
+			results[i].name.c_str(), results[i].ns_per_op, results[i].allocs_per_op, results[i].bytes_per_op,
+			i + 1 < results.size() ? "," : "");
+		out << line;
+	}
+	out << "  ]\n}\n";
+	return (true);
+}
+
+//value of "key": in object, -1 when missing
+static double	jsonNumber(const std::string &object, const std::string &key)
+{
+	size_t pos = object.find("\"" + key + "\":");
+
+	if (pos == std::string::npos)
+		return (-1);
+	return (strtod(object.c_str() + pos + key.size() + 3, NULL));
+}
+
+/* reads back what writeJson wrote: one object per benchmark */
+static bool	readJson(const std::string &path, std::vector<BenchResult> &results)
+{
+	std::ifstream	in(path.c_str());
+	std::string		content;
+	std::string		line;
+
+	if (!in)
+		return (false);
+	while (std::getline(in, line))
+		content += line;
+	size_t pos = 0;
+	while ((pos = content.find("{\"name\": \"", pos)) != std::string::npos)
+	{
+		size_t end = content.find('}', pos);
+		std::string object = content.substr(pos, end - pos);
+		BenchResult result;
+		size_t name_start = pos + 10;
+		result.name = content.substr(name_start, content.find('"', name_start) - name_start);
+		result.ns_per_op = jsonNumber(object, "ns_per_op");
+		result.allocs_per_op = jsonNumber(object, "allocs_per_op");
+		result.bytes_per_op = jsonNumber(object, "bytes_per_op");
+		results.push_back(result);
+		pos = end;
+	}
+	return (true);
+}
+
+static bool	regressed(double current, double baseline, double threshold)
+{
+	if (baseline < 0)
+		return (false);
+	//the baseline keeps two decimals
+	if (baseline == 0)
+		return (current >= 0.005);
+	return ((current - baseline) / baseline * 100 > threshold);
+}
+
+//prints each result against its baseline, returns the number of regressions
+static int	compare(const std::vector<BenchResult> &results, const std::vector<BenchResult> &baseline, double threshold)
+{
+	int	regressions = 0;
+
+	printf("\n%-24s %12s %12s %8s %10s %10s\n", "benchmark", "ns/op", "baseline", "delta", "allocs/op", "baseline");
+	for (size_t i = 0; i < results.size(); ++i)
+	{
+		const BenchResult *base = NULL;
+		for (size_t j = 0; j < baseline.size() && base == NULL; ++j)
+			if (baseline[j].name == results[i].name)
+				base = &baseline[j];
+		if (base == NULL)
+		{
+			printf("%-24s %12.1f %12s\n", results[i].name.c_str(), results[i].ns_per_op, "new");
+			continue ;
+		}
+		bool slower = regressed(results[i].ns_per_op, base->ns_per_op, threshold)
+			|| regressed(results[i].allocs_per_op, base->allocs_per_op, threshold)
+			|| regressed(results[i].bytes_per_op, base->bytes_per_op, threshold);
+		printf("%-24s %12.1f %12.1f %+7.1f%% %10.2f %10.2f%s\n", results[i].name.c_str(), results[i].ns_per_op,
+			base->ns_per_op, (results[i].ns_per_op - base->ns_per_op) / base->ns_per_op * 100,
+			results[i].allocs_per_op, base->allocs_per_op, slower ? "  REGRESSION" : "");
+		regressions += slower;
+	}
+	return (regressions);
+}
+
+static void	usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-f filter] [-t min_ms] [-o out.json] [-c baseline.json] [-T percent]\n", name);
+	exit(2);
+}
+
+int	main(int argc, char **argv)
+{
+	std::string					filter;
+	std::string					output;
+	std::string					baseline_path;
+	long						min_usec = 200000;
+	double						threshold = 10;
+	std::vector<BenchResult>	results;
+	int							opt;
+
+	while ((opt = getopt(argc, argv, "f:t:o:c:T:")) != -1)
+	{
+		if (opt == 'f')
+			filter = optarg;
+		else if (opt == 't')
+			min_usec = strtol(optarg, NULL, 10) * 1000;
+		else if (opt == 'o')
+			output = optarg;
+		else if (opt == 'c')
+			baseline_path = optarg;
+		else if (opt == 'T')
+			threshold = strtod(optarg, NULL);
+		else
+			usage(argv[0]);
+	}
+	if (min_usec <= 0)
+		usage(argv[0]);
+	try
+	{
+		buildInputs();
+	}
+	catch (std::exception &e)
+	{
+		fprintf(stderr, "bench-micro: cannot build inputs: %s\n", e.what());
+		return (1);
+	}
+	printf("%-24s %12s %12s %12s\n", "benchmark", "ns/op", "allocs/op", "bytes/op");
+	for (size_t i = 0; i < sizeof(g_benchmarks) / sizeof(g_benchmarks[0]); ++i)
+	{
+		if (!filter.empty() && std::string(g_benchmarks[i].name).find(filter) == std::string::npos)
+			continue ;
+		results.push_back(measure(g_benchmarks[i], min_usec));
+		printf("%-24s %12.1f %12.2f %12.2f\n", results.back().name.c_str(), results.back().ns_per_op,
+			results.back().allocs_per_op, results.back().bytes_per_op);
+	}
+	unlink(g_config_path.c_str());
+	if (!output.empty() && !writeJson(output, results))
+	{
+		fprintf(stderr, "bench-micro: cannot write %s\n", output.c_str());
+		return (1);
+	}
+	if (baseline_path.empty())
+		return (0);
+	std::vector<BenchResult> baseline;
+	if (!readJson(baseline_path, baseline))
+	{
+		fprintf(stderr, "bench-micro: cannot read baseline %s\n", baseline_path.c_str());
+		return (1);
+	}
+	int regressions = compare(results, baseline, threshold);
+	printf("\n%d regression%s above %.1f%%\n", regressions, regressions == 1 ? "" : "s", threshold);
+	return (regressions > 0);
+}
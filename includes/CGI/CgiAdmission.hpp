@@ -0,0 +1,44 @@
+#ifndef CGIADMISSION_HPP
+# define CGIADMISSION_HPP
+
+# include <deque>
+# include <vector>
+# include <utility>
+# include <time.h>
+
+/**
+ * Admission control for one CGI location (cgi_max_concurrent / cgi_queue).
+ *
+ * At most max_running requests hold a slot at once. Requests beyond that wait in
+ * a bounded FIFO, handled by the event loop like any other state: a slot freed by
+ * a finishing script goes to the oldest waiter, and waiters older than timeout are
+ * handed back to be answered with 503. A full queue refuses new waiters right away.
+ */
+class CgiAdmission
+{
+	private:
+		size_t								_max_running;
+		size_t								_running;
+		size_t								_max_queued;
+		time_t								_timeout;
+		std::deque<std::pair<int, time_t> >	_queue; //client fd, time it started waiting
+
+	public:
+		CgiAdmission();
+		CgiAdmission(size_t max_running, size_t max_queued, time_t timeout);
+		CgiAdmission(const CgiAdmission &other);
+		CgiAdmission &operator=(const CgiAdmission &other);
+		~CgiAdmission();
+
+		bool	tryEnter();
+		void	leave();
+		bool	enqueue(int client_fd, time_t now);
+		bool	popWaiting(int &client_fd);
+		void	drop(int client_fd);
+		void	expire(time_t now, std::vector<int> &expired);
+
+		size_t	getRunning() const;
+		size_t	getQueued() const;
+};
+
+#endif
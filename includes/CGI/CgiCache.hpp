@@ -0,0 +1,72 @@
+#ifndef CGICACHE_HPP
+# define CGICACHE_HPP
+
+# include <string>
+# include <vector>
+# include <map>
+# include <utility>
+# include <time.h>
+
+# define CGI_CACHE_ENTRY_MAX	1048576 /**< Largest body kept in the microcache. */
+# define CGI_CACHE_SIZE_MAX		67108864 /**< Bytes of bodies the microcache holds at most. */
+
+class HTTPRequest;
+
+//one stored script response, replayed with a fresh Date, Age and Connection
+struct CgiCacheEntry
+{
+	short		status;
+	std::string	headers; //the script's header lines, without framing or hop-by-hop fields
+	std::string	body;
+	time_t		stored;
+	time_t		expires;
+};
+
+/**
+ * Microcache for responses of CGI and FastCGI locations with cache_valid.
+ *
+ * Entries are keyed by the server, method and request target, plus the values of
+ * the request headers named in the response's Vary (remembered per target the first
+ * time a response is stored). How long an entry lives comes from cache_valid for
+ * its status, or from the script's Cache-Control max-age / s-maxage; no-store,
+ * no-cache, private, Set-Cookie and Vary: * keep a response out of the cache.
+ *
+ * A miss makes the request the filler of its key: identical requests arriving
+ * while its script runs wait on the key instead of starting their own, and are
+ * answered from the entry (or run their own script if it could not be stored)
+ * once the filler's script is done.
+ */
+class CgiCache
+{
+	private:
+		std::map<std::string, std::vector<std::string> >	_vary; //base key -> request header names the response varies on
+		std::map<std::string, CgiCacheEntry>			_entries; //full key -> response
+		std::map<std::string, std::vector<int> >		_fills; //full key being filled -> client fds waiting for it
+		size_t											_size;
+
+		static std::string	_requestHeader(const HTTPRequest &request, const std::string &name);
+
+	public:
+		CgiCache();
+		CgiCache(const CgiCache &other);
+		CgiCache &operator=(const CgiCache &other);
+		~CgiCache();
+
+		std::string				key(const std::string &base, const HTTPRequest &request) const;
+		const CgiCacheEntry		*lookup(const std::string &key, time_t now) const;
+		bool					beginFill(const std::string &key);
+		void					wait(const std::string &key, int client_fd);
+		void					dropWaiter(const std::string &key, int client_fd);
+		void					endFill(const std::string &key, std::vector<int> &waiters);
+		bool					store(const std::string &base, const HTTPRequest &request, const CgiCacheEntry &entry,
+									const std::vector<std::string> &vary);
+		void					expire(time_t now);
+
+		size_t					getCount() const;
+		size_t					getSize() const;
+
+		static time_t			lifetime(short status, const std::vector<std::pair<std::string, std::string> > &headers,
+									const std::map<short, time_t> &valid, std::vector<std::string> &vary);
+};
+
+#endif
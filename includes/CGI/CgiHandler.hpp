@@ -0,0 +1,126 @@
+#ifndef CGIHANDLER_HPP
+# define CGIHANDLER_HPP
+
+# include <string>
+# include <vector>
+# include <map>
+# include <sys/types.h>
+# include <time.h>
+# include "../Client/OutputChain.hpp"
+# include "CgiPool.hpp"
+# include "CgiCache.hpp"
+
+# define CGI_TIMEOUT			30 /**< Seconds a script may run before it is killed. */
+# define CGI_READ_SIZE			65536 /**< Bytes read from the script's stdout per read(). */
+# define CGI_MAX_HEADER_SIZE	8192 /**< Largest accepted CGI header block. */
+# define CGI_SPLICE_SIZE		1048576 /**< Bytes moved from the pipe to the socket per splice(). */
+
+/* spliceOutput() results besides a byte count or 0 at EOF */
+# define CGI_SPLICE_SOCKET_FULL	-1
+# define CGI_SPLICE_PIPE_EMPTY	-2
+# define CGI_SPLICE_ERROR		-3
+
+class Client;
+class Location;
+
+/**
+ * One running CGI script, driven by the Router's event loop.
+ *
+ * The script gets two non-blocking pipes. The request body is streamed into its
+ * stdin as the pipe becomes writable, its stdout is read as it becomes readable,
+ * the CGI header block is parsed incrementally, and everything after it is relayed
+ * into the client's OutputChain as it arrives. Nothing here ever blocks: children
+ * are reaped from the SIGCHLD self-pipe instead of a blocking waitpid().
+ *
+ * With a CgiPool the script runs in a persistent worker instead: the request goes
+ * out as frames on the worker's socket (stdin is a dup() of it, so it can still be
+ * closed on its own once the request is sent) and the reply frames are unwrapped
+ * before the same header parsing. The worker socket itself belongs to the pool.
+ * A FastCGI upstream works the same way with FastCGI records instead of frames:
+ * STDOUT content is parsed like a script's output, STDERR is logged and
+ * END_REQUEST ends the response.
+ *
+ * When the body goes out unframed (the script sent Content-Length, or the body is
+ * delimited by closing the connection) and nothing is queued ahead of it, the
+ * Router moves it from the stdout pipe to the client socket with splice(), so
+ * large bodies never pass through userspace. Chunked or HEAD responses are copied,
+ * and so are responses captured for the microcache (see CgiCache).
+ */
+class CgiHandler
+{
+	private:
+		pid_t					_pid;
+		int						_stdin_fd; /**< Write end of the script's stdin, -1 once the body is sent. */
+		int						_stdout_fd; /**< Read end of the script's stdout, -1 at EOF. */
+		int						_client_fd;
+		std::string				_body;
+		size_t					_body_pos;
+		std::string				_header_buffer;
+		bool					_headers_done;
+		short					_status;
+		std::vector<std::pair<std::string, std::string> >	_headers;
+		bool					_has_content_length;
+		bool					_chunked;
+		bool					_head_only;
+		bool					_splice_ok; /**< Cleared if the kernel refuses splice() for this pair. */
+		time_t					_start_time;
+		CgiPool					*_pool; /**< Pool lending the worker, NULL for a forked script. */
+		int						_worker_fd;
+		bool					_worker_done; /**< The worker sent its end-of-response frame. */
+		std::string				_frame_header;
+		size_t					_frame_left;
+		size_t					_frame_padding;
+		unsigned char			_frame_type;
+		bool					_capture; /**< The body is copied into _captured for the microcache. */
+		std::string				_captured;
+
+		static int				_signal_pipe[2];
+		static void				_sigchldHandler(int sig);
+
+		void					_begin(Client &client);
+		bool					_consume(Client &client, const char *data, size_t len);
+		bool					_readFrameHeader(const char *buffer, size_t len, size_t &pos);
+		bool					_parseHeaderBlock(size_t &body_start);
+		void					_queueHeaders(Client &client);
+		void					_queueBody(OutputChain &output, const char *data, size_t len);
+
+	public:
+		CgiHandler();
+		CgiHandler(const CgiHandler &other);
+		CgiHandler &operator=(const CgiHandler &other);
+		~CgiHandler();
+
+		bool		start(Client &client, const std::string &script, const std::string &interpreter);
+		bool		startPooled(Client &client, const std::string &script, CgiPool &pool, int worker_fd);
+		ssize_t		sendBody();
+		ssize_t		readOutput(Client &client);
+		bool		canSplice() const;
+		ssize_t		spliceOutput(int sock);
+		void		finishOutput(Client &client);
+		void		closeStdin();
+		void		closeStdout();
+		void		kill();
+
+		pid_t		getPid() const;
+		int			getStdinFd() const;
+		int			getStdoutFd() const;
+		int			getClientFd() const;
+		bool		getHeadersDone() const;
+		time_t		getStartTime() const;
+		CgiPool		*getPool() const;
+		int			getWorkerFd() const;
+		bool		getWorkerDone() const;
+		void		setCapture(bool capture);
+		bool		getCapture() const;
+		const std::string	&getCaptured() const;
+		short		getStatus() const;
+		const std::vector<std::pair<std::string, std::string> >	&getHeaders() const;
+
+		static char			**buildEnv(Client &client, const std::string &script);
+		static std::string	getInterpreter(const Location &location, const std::string &script);
+		static void			initSignalPipe();
+		static int			getSignalFd();
+		static void			reapChildren();
+};
+
+#endif
@@ -0,0 +1,107 @@
+#ifndef CGIPOOL_HPP
+# define CGIPOOL_HPP
+
+# include <string>
+# include <vector>
+# include <deque>
+# include <sys/types.h>
+# include <time.h>
+# include <sys/socket.h>
+# include <sys/un.h>
+# include <netinet/in.h>
+# include "../ConfigParser/Location.hpp"
+
+# define CGI_FRAME_MAX	65536 /**< Largest payload a worker sends in one frame. */
+
+/* FastCGI 1.0 record types and roles used by the client */
+# define FCGI_VERSION_1			1
+# define FCGI_BEGIN_REQUEST		1
+# define FCGI_END_REQUEST		3
+# define FCGI_PARAMS			4
+# define FCGI_STDIN				5
+# define FCGI_STDOUT			6
+# define FCGI_STDERR			7
+# define FCGI_RESPONDER			1
+# define FCGI_KEEP_CONN			1
+# define FCGI_HEADER_LEN		8
+# define FCGI_RECORD_MAX		65528 /**< Largest content sent per record, keeps records 8-byte aligned. */
+
+enum CgiPoolType
+{
+	CGI_POOL_WORKERS, //pre-spawned interpreters running the worker bootstrap
+	CGI_POOL_FASTCGI //persistent connections to a FastCGI application server
+};
+
+//one pre-spawned interpreter talking over a socketpair, or one FastCGI connection
+struct CgiWorker
+{
+	pid_t	pid; //-1 for a FastCGI connection
+	int		fd; //server end of the socketpair or the connected socket, non-blocking
+	bool	busy;
+	size_t	served;
+	time_t	last_used;
+};
+
+/**
+ * Persistent interpreter processes for one (location, interpreter) pair.
+ *
+ * Workers run a small bootstrap that loops over requests instead of exiting, so a
+ * request costs a socket round trip instead of fork, execve and interpreter startup.
+ * Every message is a frame: a 4-byte big-endian length followed by the payload.
+ * The server sends two frames per request (the NUL-separated CGI environment, then
+ * the request body) and the worker answers with the script's output split in
+ * frames of at most CGI_FRAME_MAX bytes, ended by an empty frame.
+ *
+ * The pool starts with config.workers processes, spawns more up to
+ * config.max_workers when every worker is busy, and queues requests beyond that.
+ * A worker is recycled after config.max_requests requests, and workers above the
+ * minimum are retired once idle for config.idle_timeout seconds.
+ *
+ * As a FastCGI upstream the "workers" are persistent connections to the application
+ * server instead: they are opened on demand (non-blocking connect) up to
+ * config.max_workers, reused across requests thanks to FCGI_KEEP_CONN and closed
+ * once idle. The request and the reply are FastCGI records rather than frames.
+ */
+class CgiPool
+{
+	private:
+		CgiPoolType								_type;
+		std::string								_target; //interpreter path, or FastCGI address
+		CgiPoolConfig							_config;
+		struct sockaddr_un						_unix_address;
+		struct sockaddr_in						_inet_address;
+		bool									_unix;
+		std::vector<CgiWorker>					_workers;
+		std::deque<std::pair<int, std::string> >	_pending; //client fd, script waiting for a worker
+
+		bool	_spawn();
+		bool	_connect();
+		void	_retire(size_t index);
+
+	public:
+		CgiPool();
+		CgiPool(const std::string &target, const CgiPoolConfig &config, CgiPoolType type = CGI_POOL_WORKERS);
+		CgiPool(const CgiPool &other);
+		CgiPool &operator=(const CgiPool &other);
+		~CgiPool();
+
+		void	start();
+		int		acquire(bool &failed);
+		void	release(int worker_fd, bool reusable);
+		void	queue(int client_fd, const std::string &script);
+		bool	popPending(int &client_fd, std::string &script);
+		void	dropPending(int client_fd);
+		void	maintain(time_t now);
+		void	shutdown();
+
+		const std::string	&getTarget() const;
+		CgiPoolType			getType() const;
+		size_t				getSize() const;
+		size_t				getPendingCount() const;
+
+		static bool			supports(const std::string &interpreter);
+		static std::string	frame(const std::string &payload);
+		static std::string	fastcgiRequest(char *const *env, const std::string &body);
+};
+
+#endif
@@ -0,0 +1,131 @@
+#ifndef CLIENT_HPP
+# define CLIENT_HPP
+
+# include <string>
+# include <time.h>
+# include <netinet/in.h>
+# include "OutputChain.hpp"
+# include "RequestArena.hpp"
+# include "InputBuffer.hpp"
+# include "../HTTPMessage/HTTPRequest/HTTPRequest.hpp"
+# include "../Utils/AllocStats.hpp"
+
+# define CONNECTION_TIMEOUT	60 /**< Seconds a connection may stay silent before it is closed. */
+# define MAX_HEADER_SIZE	30000 /**< Largest accepted request line + header block. */
+
+class Server;
+class Location;
+
+/**
+ * Where a connection is in its request/response cycle.
+ */
+enum ClientState
+{
+	CLIENT_READING, /**< Waiting for (the rest of) a request line and header block. */
+	CLIENT_READING_BODY, /**< Headers parsed, waiting for Content-Length body bytes. */
+	CLIENT_WRITING /**< Flushing the response queued in the OutputChain. */
+};
+
+/**
+ * Points in a request's life stamped with the monotonic clock, in order. A phase
+ * the request did not go through stays 0; accept is only set on a connection's
+ * first request.
+ */
+enum RequestPhase
+{
+	PHASE_ACCEPT, /**< Connection accepted. */
+	PHASE_FIRST_BYTE, /**< First byte of the request read. */
+	PHASE_HEADERS, /**< Request line and headers parsed. */
+	PHASE_LOCATION, /**< Virtual server and location resolved. */
+	PHASE_HANDLER, /**< Body complete, handler started. */
+	PHASE_CGI_SPAWN, /**< Script started or sent to a pool worker. */
+	PHASE_RESPONSE_START, /**< First byte of the response sent. */
+	PHASE_RESPONSE_END, /**< Last byte of the response sent. */
+	PHASE_COUNT
+};
+
+/**
+ * One accepted connection: the bytes read so far, the parsed request, the
+ * virtual server and location it was routed to, and the response waiting in
+ * its OutputChain.
+ *
+ * Clients are pooled by the ConnectionTable, which starts them on a cache line:
+ * the members up to _input fill that first line and are what every read and the
+ * timeout sweep touch. open() and release() let one object serve connection
+ * after connection.
+ *
+ * A copy does not take the RequestArena, so whatever was queued from it would
+ * not survive the original.
+ */
+class Client
+{
+	private:
+		int					_fd;
+		int					_listen_fd;
+		ClientState			_state;
+		short				_status; /**< Status of the response queued for the current request, 0 before. */
+		bool				_keep_alive;
+		time_t				_last_activity;
+		size_t				_content_length; /**< Body bytes announced by the parsed headers. */
+		InputBuffer			_input; /**< Raw bytes received and not yet consumed by a request. */
+		//end of the first cache line
+		const Server		*_server;
+		const Location		*_location;
+		struct sockaddr_in	_address;
+		HTTPRequest			_request;
+		OutputChain			_output;
+		long				_phases[PHASE_COUNT]; /**< Monotonic usec of each RequestPhase, 0 before it. */
+		long				_upstream_start;
+		long				_upstream_time; /**< Usec the CGI took, -1 if none ran. */
+		AllocCounts			_allocs; /**< Allocations charged to the current request (ALLOC_STATS build). */
+		RequestArena		_arena; /**< Memory of the current request, released by resetRequest(). */
+
+	public:
+		Client();
+		Client(int fd, int listen_fd, const struct sockaddr_in &address);
+		Client(const Client &other);
+		Client &operator=(const Client &other);
+		~Client();
+
+		//setters
+		void setState(ClientState state);
+		void setKeepAlive(bool keep_alive);
+		void setContentLength(size_t content_length);
+		void setRequest(const HTTPRequest &request);
+		void setServer(const Server *server);
+		void setLocation(const Location *location);
+		void updateTime();
+		void setStatus(short status);
+		void markPhase(RequestPhase phase);
+		void startUpstreamTimer();
+		void stopUpstreamTimer();
+
+		//getters
+		int							getFd() const;
+		int							getListenFd() const;
+		const struct sockaddr_in	&getAddress() const;
+		ClientState					getState() const;
+		time_t						getLastActivity() const;
+		bool						getKeepAlive() const;
+		size_t						getContentLength() const;
+		HTTPRequest					&getRequest();
+		InputBuffer					&getInput();
+		const HTTPRequest			&getRequest() const;
+		const Server				*getServer() const;
+		const Location				*getLocation() const;
+		OutputChain					&getOutput();
+		const OutputChain			&getOutput() const;
+		short						getStatus() const;
+		long						getPhase(RequestPhase phase) const;
+		long						getRequestStart() const;
+		long						getUpstreamTime() const;
+		AllocCounts					&getAllocs();
+		const AllocCounts			&getAllocs() const;
+		RequestArena				&getArena();
+
+		void						open(int fd, int listen_fd, const struct sockaddr_in &address);
+		void						release();
+		void						resetRequest();
+};
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef INPUTBUFFER_HPP
+# define INPUTBUFFER_HPP
+
+# include <cstddef>
+
+/**
+ * Bytes received from a connection and not consumed yet, in a buffer borrowed
+ * from the BufferPool.
+ *
+ * reserve() makes room before a recv(): a connection without buffered bytes
+ * borrows a class big enough for what it expects (BUFFER_SMALL for a request
+ * line and headers), and a full buffer first moves its bytes to the front,
+ * then grows to the next class, as nginx's large_client_header_buffers do for
+ * oversized headers. consume() drops bytes from the front and gives the buffer
+ * back once it is empty, so an idle keep-alive connection holds none.
+ *
+ * A buffer never grows past BUFFER_LARGE: reserve() then returns no room.
+ */
+class InputBuffer
+{
+	private:
+		char	*_data;
+		size_t	_capacity; /**< Size class of _data, 0 without a buffer. */
+		size_t	_start; /**< First unconsumed byte. */
+		size_t	_end; /**< End of the received bytes. */
+
+		void	_resize(size_t capacity);
+
+	public:
+		InputBuffer();
+		InputBuffer(const InputBuffer &other);
+		InputBuffer &operator=(const InputBuffer &other);
+		~InputBuffer();
+
+		char		*reserve(size_t wanted, size_t &room);
+		void		commit(size_t len);
+		void		consume(size_t len);
+		void		clear();
+
+		const char	*data() const;
+		size_t		size() const;
+		bool		empty() const;
+		size_t		capacity() const;
+};
+
+#endif
@@ -0,0 +1,93 @@
+#ifndef OUTPUTCHAIN_HPP
+# define OUTPUTCHAIN_HPP
+
+# include <string>
+# include <deque>
+# include <sys/types.h>
+
+# define OUTPUT_HIGH_WATER	65536 /**< Upstream reads pause while more than this is buffered in memory. */
+# define OUTPUT_LOW_WATER	16384 /**< Upstream reads resume once the buffered bytes fall below this. */
+# define OUTPUT_MAX_IOV		64 /**< Maximum number of memory buffers gathered into one writev(). */
+# define FILE_CHUNK_SIZE	65536 /**< Maximum bytes sent from a file region per sendfile() call. */
+
+/**
+ * Outcome of OutputChain::flush().
+ */
+enum FlushStatus
+{
+	FLUSH_DONE = 0, /**< Every queued buffer was written. */
+	FLUSH_AGAIN = 1, /**< The socket send buffer is full, wait for write readiness. */
+	FLUSH_ERROR = -1 /**< The peer is gone or the socket failed. */
+};
+
+/**
+ * Queue of response pieces waiting to be written to one connection.
+ *
+ * A response is a sequence of buffers of three kinds:
+ * - memory: bytes owned by the chain (rendered headers, CGI pipe data).
+ * - slice: bytes owned by someone that outlives the response (pre-rendered
+ *   redirect and error responses), queued without a copy.
+ * - file region: [offset, offset + length) of an open file, sent with sendfile()
+ *   when the socket is writable so the file never sits in memory.
+ *
+ * flush() writes as much as the socket accepts and stops at EAGAIN, so a slow
+ * reader only costs the bytes already queued. Producers that read from an
+ * upstream (CGI pipes) check aboveHighWater() and stop reading until the chain
+ * drains below the low-water mark.
+ */
+class OutputChain
+{
+	private:
+		enum BufferType
+		{
+			MEMORY,
+			SLICE,
+			FILE_REGION
+		};
+
+		struct Buffer
+		{
+			BufferType	type;
+			std::string	data; /**< Owned bytes for MEMORY buffers. */
+			const char	*ptr; /**< Borrowed bytes for SLICE buffers. */
+			size_t		len; /**< Bytes in the buffer, or in the file region. */
+			size_t		pos; /**< Bytes already written. */
+			int			fd; /**< File for FILE_REGION buffers. */
+			off_t		offset; /**< Start of the file region. */
+			bool		owns_fd; /**< Close fd when the buffer is released. */
+		};
+
+		std::deque<Buffer>	_buffers;
+		size_t				_memory_bytes; /**< Unsent bytes held in MEMORY buffers. */
+		size_t				_pending_bytes; /**< Unsent bytes of every kind. */
+		size_t				_sent_bytes; /**< Bytes written since the last clear(). */
+
+		FlushStatus			_flushMemory(int sock);
+		FlushStatus			_flushFile(int sock);
+		void				_release(Buffer &buffer);
+		void				_popFront();
+
+	public:
+		OutputChain();
+		OutputChain(const OutputChain &other);
+		OutputChain &operator=(const OutputChain &other);
+		~OutputChain();
+
+		void		appendMemory(const std::string &data);
+		void		appendMemory(const char *data, size_t len);
+		void		appendSlice(const char *data, size_t len);
+		void		appendFile(int fd, off_t offset, size_t len, bool owns_fd);
+
+		FlushStatus	flush(int sock);
+		void		clear();
+
+		bool		empty() const;
+		bool		aboveHighWater() const;
+		bool		belowLowWater() const;
+		size_t		getMemoryBytes() const;
+		size_t		getPendingBytes() const;
+		size_t		getSentBytes() const;
+		void		addSentBytes(size_t len);
+};
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef REQUESTARENA_HPP
+# define REQUESTARENA_HPP
+
+# include <cstddef>
+
+# define ARENA_CHUNK_SIZE	4096 /**< Usable bytes per arena chunk. */
+# define ARENA_FREE_MAX		64 /**< Chunks each thread keeps for reuse, beyond that they are freed. */
+
+/**
+ * Bump-pointer memory for the current request of one connection.
+ *
+ * allocate() hands out bytes from the newest chunk and takes another one when it
+ * is full; nothing is freed one by one. reset() releases everything at once when
+ * the request finishes: the chunks go back to a per-thread free list in one
+ * splice, so the next request (on any connection of the thread) reuses them
+ * without a malloc, and a keep-alive connection waiting for its next request
+ * holds no chunk. An allocation larger than a chunk gets one of its own, freed
+ * by reset().
+ *
+ * Pointers into the arena are valid until reset(): anything queued from it (such
+ * as an OutputChain slice) must be sent or dropped first. A copy starts empty.
+ */
+class RequestArena
+{
+	private:
+		struct Chunk
+		{
+			Chunk	*next;
+		};
+
+		Chunk	*_chunks; /**< Chunks in use, newest first. */
+		Chunk	*_last; /**< Oldest chunk in use, where the list is spliced onto the free list. */
+		size_t	_count; /**< Chunks in _chunks. */
+		Chunk	*_large; /**< Dedicated chunks of oversized allocations. */
+		char	*_pos; /**< Next free byte of the newest chunk. */
+		char	*_end; /**< End of the newest chunk. */
+		size_t	_used; /**< Bytes handed out since the last reset(). */
+
+		void	_newChunk();
+
+	public:
+		RequestArena();
+		RequestArena(const RequestArena &other);
+		RequestArena &operator=(const RequestArena &other);
+		~RequestArena();
+
+		void	*allocate(size_t size);
+		char	*copy(const char *data, size_t len);
+		char	*join(const char *a, size_t a_len, const char *b, size_t b_len);
+		void	reset();
+
+		size_t	getUsed() const;
+};
+
+#endif
@@ -9,8 +9,12 @@
 #include <iostream>
 #include "Server.hpp"
 #include "../Utils/Utils.hpp"
+#include "../Logger/RequestSampler.hpp"
+#include "../Logger/TraceLog.hpp"
+#include "../Router/StallWatchdog.hpp"
 
 class Server;
+class Location;
 
 class ConfigParser
 {
@@ -18,10 +22,18 @@ class ConfigParser
 		std::vector<Server>			_servers;
 		std::vector<std::string>	_server_blocks;
 		size_t						_server_num;
+		std::string					_error_log; //"stdout" or a file the Logger's writer thread appends to
+		LogOverflow					_log_overflow;
+		int							_log_level;
+		SampleConfig				_log_sample;
+		TraceConfig					_request_trace;
+		long						_stall_threshold; //usec, 0 when the watchdog is off
 		
 		typedef void (ConfigParser::*Handler)(size_t&, Server&, std::vector<std::string>&);
+		typedef void (ConfigParser::*GlobalHandler)(std::vector<std::string>&);
 
 		std::map<std::string, Handler>	handlers;
+		std::map<std::string, GlobalHandler>	global_handlers;
 		
 		void handleRoot(size_t &i, Server &server, std::vector<std::string> &parameters);
 		void handleListen(size_t &i, Server &server, std::vector<std::string> &parameters);
@@ -31,6 +43,17 @@ class ConfigParser
 		void handleErrorPage(size_t &i, Server &server, std::vector<std::string> &parameters);
 		void handleServerName(size_t &i, Server &server, std::vector<std::string> &parameters);
 		void handleClientMaxBodySize(size_t &i, Server &server, std::vector<std::string> &parameters);
+		void handleAccessLog(size_t &i, Server &server, std::vector<std::string> &parameters);
+		void handleErrorLog(std::vector<std::string> &parameters);
+		void handleLogLevel(std::vector<std::string> &parameters);
+		void handleLogSample(std::vector<std::string> &parameters);
+		void handleRequestTrace(std::vector<std::string> &parameters);
+		void handleStallThreshold(std::vector<std::string> &parameters);
+
+		std::string renderRedirect(const Location &location);
+		std::string renderErrorPage(const Server &server, short code, const std::string &path);
+		std::vector<std::string> renderCgiEnv(const Server &server);
+		std::string renderBusy(const Location &location);
 
 	public:
 		ConfigParser();
@@ -40,11 +63,18 @@ class ConfigParser
 		void splitServerBlocks(std::string &content);
 		void removeComments(std::string &content);
 		void normaliseSpaces(std::string &content);
+		size_t	parseGlobalDirectives(size_t start, std::string &content);
 		size_t	getServerBlockStart(size_t start, std::string &content);
 		size_t	getServerBlockEnd(size_t start, std::string &content);
 		void parseServerBlock(std::string &config, Server &server);
 		void checkServersDup();
 		std::vector<Server> getServers();
+		const std::string &getErrorLog() const;
+		LogOverflow getLogOverflow() const;
+		int getLogLevel() const;
+		const SampleConfig &getLogSample() const;
+		const TraceConfig &getRequestTrace() const;
+		long getStallThreshold() const;
 		void print();
 		void finaliseServer(Server &server);
 		
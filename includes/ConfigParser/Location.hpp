@@ -4,8 +4,18 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <ctime>
 #include "../Utils/Utils.hpp"
 
+//cgi_pool settings, workers == 0 means every request forks its own interpreter
+struct CgiPoolConfig
+{
+	size_t	workers; //processes kept warm per interpreter
+	size_t	max_workers; //upper bound when the pool grows under load
+	size_t	max_requests; //requests a worker serves before it is recycled
+	time_t	idle_timeout; //seconds an extra worker may stay idle before it is retired
+};
+
 class Location
 {
 	private:
@@ -15,10 +25,21 @@ class Location
 		std::string					_index;
 		std::vector<short>			_methods;
 		std::string					_return;
+		std::string					_return_response;
 		std::string					_alias;
 		std::vector<std::string>	_cgi_path;
 		std::vector<std::string>	_cgi_ext;
 		unsigned long				_client_max_body_size;
+		CgiPoolConfig				_cgi_pool;
+		std::string					_fastcgi_pass; //"unix:/path" or "ip:port", empty when unused
+		size_t						_fastcgi_max_conns;
+		std::vector<std::string>	_cgi_env; //request-independent CGI variables, built at config load
+		size_t						_cgi_max_concurrent; //0: no limit on running scripts
+		size_t						_cgi_queue_size; //requests allowed to wait for a slot
+		time_t						_cgi_queue_timeout;
+		std::string					_busy_response; //pre-serialised 503 for a full queue
+		std::map<short, time_t>		_cache_valid; //status -> seconds a CGI response stays in the microcache
+		bool						_metrics; //the location answers with the server's metrics
 		bool						methods_flag;
 		bool						autoindex_flag;
 		bool						maxsize_flag;
@@ -37,9 +58,18 @@ class Location
 		void setIndex(std::string index);
 		void setMethods(std::vector<std::string> methods);
 		void setReturn(std::string ret);
+		void setReturnResponse(const std::string &response);
 		void setAlias(std::string alias);
 		void setCgiPath(std::vector<std::string> path);
 		void setCgiExtension(std::vector<std::string> ext);
+		void setCgiPool(const CgiPoolConfig &pool);
+		void setFastCgiPass(const std::string &address, size_t max_conns);
+		void setCgiEnvTemplate(const std::vector<std::string> &env);
+		void setCgiMaxConcurrent(size_t max);
+		void setCgiQueue(size_t size, time_t timeout);
+		void setBusyResponse(const std::string &response);
+		void setCacheValid(short code, time_t ttl);
+		void setMetrics(bool metrics);
 		void setMethodsFlag(bool flag);
 		void setAutoindexFlag(bool flag);
 		void setMaxSizeFlag(bool flag);
@@ -53,9 +83,22 @@ class Location
 		const std::string &getIndex() const;
 		const std::vector<short> &getMethods() const;
 		const std::string &getReturn() const;
+		const std::string &getReturnResponse() const;
+		short getReturnCode() const;
+		std::string getReturnUrl() const;
 		const std::string &getAlias() const;
 		const std::vector<std::string> &getCgiPath() const;
 		const std::vector<std::string> &getCgiExtension() const;
+		const CgiPoolConfig &getCgiPool() const;
+		const std::string &getFastCgiPass() const;
+		size_t getFastCgiMaxConns() const;
+		const std::vector<std::string> &getCgiEnvTemplate() const;
+		size_t getCgiMaxConcurrent() const;
+		size_t getCgiQueueSize() const;
+		time_t getCgiQueueTimeout() const;
+		const std::string &getBusyResponse() const;
+		const std::map<short, time_t> &getCacheValid() const;
+		bool getMetrics() const;
 		const unsigned long &getMaxBodySize() const;
 		const bool &getMethodsFlag() const;
 		const bool &getAutoIndexFlag() const;
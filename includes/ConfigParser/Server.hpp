@@ -6,6 +6,7 @@
 #include <map>
 #include <vector>
 #include "../Utils/Utils.hpp"
+#include "../Logger/AccessLog.hpp"
 
 class Location;
 
@@ -19,12 +20,14 @@ class Server
 		bool							_autoindex;
 		unsigned long					_client_max_body_size;
 		std::map<short, std::string>	_error_pages_map; //map status codes to custom error pages
+		std::map<short, std::string>	_error_responses; //pre-serialised responses for _error_pages_map
 		std::vector<Location> 			_locations;
 		struct sockaddr_in 				_server_address;
 		bool							location_flag;
 		bool							autoindex_flag;
 		bool							maxsize_flag;
 		std::vector<int>				_listen_fds;
+		AccessLogConfig					_access_log;
 
 		typedef void (Server::*Handler)(size_t&, Location&, std::vector<std::string>&);
 
@@ -38,6 +41,12 @@ class Server
 		void handleReturn(size_t &i, Location& new_location, std::vector<std::string> &parameters);
 		void handleCgiExt(size_t &i, Location& new_location, std::vector<std::string> &parameters);
 		void handleCgiPath(size_t &i, Location& new_location, std::vector<std::string> &parameters);
+		void handleCgiPool(size_t &i, Location& new_location, std::vector<std::string> &parameters);
+		void handleFastCgiPass(size_t &i, Location& new_location, std::vector<std::string> &parameters);
+		void handleCgiMaxConcurrent(size_t &i, Location& new_location, std::vector<std::string> &parameters);
+		void handleCgiQueue(size_t &i, Location& new_location, std::vector<std::string> &parameters);
+		void handleCacheValid(size_t &i, Location& new_location, std::vector<std::string> &parameters);
+		void handleMetrics(size_t &i, Location& new_location, std::vector<std::string> &parameters);
 		void handleClientMaxBodySize(size_t &i, Location& new_location, std::vector<std::string> &parameters);
 
 	public:
@@ -54,6 +63,7 @@ class Server
 		void setClientMaxBodySize(std::string size);
 		void initialiseErrorPagesMap();
 		void setErrorPages(const std::vector<std::string> &parameters);
+		void setErrorResponse(short code, const std::string &response);
 		void parseLocationBlocks(std::string path, std::vector<std::string> parameters);
 		void addListenFds(int fd);
 		void setAutoindexFlag(bool flag);
@@ -62,6 +72,7 @@ class Server
 		void setServerDefaultValues();
 		void setLocationsDefaultValues();
 		void setServerAddress(std::string host, uint16_t port);
+		void setAccessLog(const AccessLogConfig &config);
 
 		//getter
 		const std::string 					&getServerName() const;
@@ -77,9 +88,12 @@ class Server
 		const bool							&getMaxSizeFlag() const;
 		const struct sockaddr_in 			&getServerAddress() const;
 		const std::vector< std::pair<std::string, uint16_t> >	&getHostPortPairs() const;
+		const AccessLogConfig					&getAccessLog() const;
 		
 		//getter for Response
 		const std::string 						&getErrorPagePath(short key);
+		const std::string						*getErrorResponse(short key) const;
+		const Location							*matchLocation(const std::string &uri) const;
 		const std::vector<Location>::iterator	getLocation(std::string key);
 
 		//checker functions
@@ -44,11 +44,13 @@ class HTTPMessage
         //Setters
         void							setHeader(const string& name, const string& value);
         void							setBody(string body);
+        void							appendBody(const char *data, size_t len);
+        void							clear();
 
         //Getters
         string							getFieldName(const string& name) const;
-        const std::map<string, string>	getHeaders() const;
-        string							getBody() const;
+        const std::map<string, string>	&getHeaders() const;
+        const string					&getBody() const;
         string							getMessage() const;
 		string							getStarline() const;
 
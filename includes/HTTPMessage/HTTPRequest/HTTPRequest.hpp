@@ -37,15 +37,10 @@ class HTTPRequest: public HTTPMessage
 		string	_request_target; /**< The target resource of the HTTP request (e.g., "/index.html"). */
 		string	_http_version; /**< The HTTP version used in the request (e.g., "HTTP/1.1"). */
 
-		void	_parseMessage(const string& message);
-        void	_parseStartline(const string& start_line);
-        void	_parseHeaders(const string& headers);
-        void	_parseBody(const string& body);
-
-        //Private Setters 
-        void	_setMethod(const string& method);
-        void	_setRequestTarget(const string& request_target);
-        void	_setHttpVersion(const string& http_version);
+		void	_parseMessage(const char *message, size_t length);
+        void	_parseStartline(const char *begin, const char *end);
+        void	_parseHeaders(const char *begin, const char *end);
+        void	_parseBody(const char *begin, const char *end);
     public:
         HTTPRequest();
         ~HTTPRequest();
@@ -53,10 +48,13 @@ class HTTPRequest: public HTTPMessage
         HTTPRequest& operator=(const HTTPRequest& src);
         HTTPRequest(const string& message);
 
+        void	parse(const char *message, size_t length);
+        void	clear();
+
         //Getters
-		string	getRequestMethod()	const;
-		string	getRequestTarget()	const;
-		string	getHttpVersion()	const;
+		const string	&getRequestMethod()	const;
+		const string	&getRequestTarget()	const;
+		const string	&getHttpVersion()	const;
 
         //Exceptions
 		/**
@@ -22,13 +22,25 @@ class HTTPResponse : public HTTPMessage
 	public:
 	//Constructors
 		HTTPResponse();
+		HTTPResponse(short status_code);
 		HTTPResponse(HTTPResponse &copy);
 	//Destructor
 		~HTTPResponse();
 	//Operator Overloads
 		HTTPResponse	&operator=(HTTPResponse &copy);
-		
+
+	//Setters
+		void			setStatusCode(short status_code);
+	//Getters
+		short			getStatusCode() const;
+	//Serialisation
+		string			serialise() const;
+		static string	defaultErrorBody(short status_code);
+
+		void			checker();
+
 	private:
+		short			_status_code;
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,76 @@
+#ifndef ACCESSLOG_HPP
+# define ACCESSLOG_HPP
+
+# include <string>
+# include <vector>
+# include <csignal>
+# include <time.h>
+
+# define ACCESS_LOG_BUFFER	65536 /**< Default bytes buffered before a write. */
+# define ACCESS_LOG_FLUSH	1 /**< Default seconds a record may wait in the buffer. */
+
+class Client;
+
+enum AccessLogFormat
+{
+	ACCESS_LOG_COMBINED, //NCSA combined, followed by vhost, request time and CGI time
+	ACCESS_LOG_JSON //one JSON object per line
+};
+
+//access_log settings of a server block, an empty path means no access log
+struct AccessLogConfig
+{
+	std::string		path;
+	AccessLogFormat	format;
+	size_t			buffer_size;
+	time_t			flush_interval;
+};
+
+/**
+ * One access log file, shared by every server block naming the same path.
+ *
+ * A record is written per completed request: client address, virtual server,
+ * request line, status, bytes sent, request time and the time spent in CGI. Records
+ * collect in a buffer that goes out with a single write() once it holds
+ * buffer_size bytes, or flush_interval seconds after the last write, so logging
+ * costs a formatted append on the request path.
+ *
+ * SIGUSR1 asks for every log to be reopened (after logrotate moved the files);
+ * the handler only sets a flag that the event loop picks up. flushAll() writes
+ * out every open log's buffer when the server exits.
+ */
+class AccessLog
+{
+	private:
+		AccessLogConfig					_config;
+		int								_fd;
+		std::string						_buffer;
+		time_t							_last_flush;
+
+		static volatile sig_atomic_t	_reopen;
+		static std::vector<AccessLog *>	_open_logs; /**< For flushAll() on the way out. */
+
+		static void	_appendEscaped(std::string &out, const std::string &value, bool json);
+
+	public:
+		AccessLog();
+		AccessLog(const AccessLogConfig &config);
+		AccessLog(const AccessLog &other);
+		AccessLog &operator=(const AccessLog &other);
+		~AccessLog();
+
+		bool	open();
+		void	close();
+		bool	reopen();
+		void	log(const Client &client, const std::string &vhost);
+		void	flush();
+		void	tick(time_t now);
+
+		const std::string	&getPath() const;
+
+		static void			handleSignal(int sig);
+		static bool			reopenRequested();
+		static void			flushAll();
+};
+
+#endif
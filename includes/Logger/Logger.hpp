@@ -25,6 +25,54 @@ using std::string;
 # define LIGHTMAGENTA	"\x1B[95m" /**< Light magenta text color. */
 // TIME OFFSET
 # define GST				8; /**< Malaysia time offset for GMT+8. */
+// ASYNC LOGGING
+# define LOG_RING_SLOTS		1024 /**< Records the ring holds, a power of two. */
+# define LOG_RECORD_SIZE	4096 /**< Bytes of one preformatted record, longer messages are truncated. */
+# define LOG_BATCH_SIZE		65536 /**< Bytes the writer thread gathers per write(). */
+# define LOG_IDLE_WAIT		100 /**< Milliseconds the writer sleeps on an empty ring before checking again. */
+
+// LOG LEVELS, from the most to the least severe
+# define LOG_LEVEL_ERROR	0
+# define LOG_LEVEL_WARN		1
+# define LOG_LEVEL_INFO		2
+# define LOG_LEVEL_DEBUG	3
+# define LOG_LEVEL_TRACE	4
+
+/**
+ * Most verbose level compiled in, set by the Makefile (make LOG_LEVEL=info).
+ * Statements above it are constant-false: they are removed by the compiler and
+ * their arguments are never evaluated.
+ */
+# ifndef LOG_COMPILED_LEVEL
+#  define LOG_COMPILED_LEVEL	LOG_LEVEL_TRACE
+# endif
+
+/**
+ * Logs at a level. Below the compiled level, the runtime log_level is checked
+ * before anything else, so a disabled statement costs one comparison and does
+ * not evaluate its arguments.
+ */
+# define WS_LOG(level, color, ...) \
+	do \
+	{ \
+		if ((level) <= LOG_COMPILED_LEVEL && WebServer::Logger::enabled(level)) \
+			WebServer::Logger::getInstance()->logMsg(color, __VA_ARGS__); \
+	} while (0)
+# define WS_ERROR(...)	WS_LOG(LOG_LEVEL_ERROR, RED, __VA_ARGS__)
+# define WS_WARN(...)	WS_LOG(LOG_LEVEL_WARN, YELLOW, __VA_ARGS__)
+# define WS_INFO(...)	WS_LOG(LOG_LEVEL_INFO, LIGHT_BLUE, __VA_ARGS__)
+# define WS_DEBUG(...)	WS_LOG(LOG_LEVEL_DEBUG, CYAN, __VA_ARGS__)
+# define WS_TRACE(...)	WS_LOG(LOG_LEVEL_TRACE, DARK_GREY, __VA_ARGS__)
+
+/**
+ * What logMsg() does when the ring is full: drop the record and count it (the
+ * writer reports how many were lost), or wait for the writer to make room.
+ */
+enum LogOverflow
+{
+	LOG_OVERFLOW_DROP,
+	LOG_OVERFLOW_BLOCK
+};
 
 /**
  * @namespace WebServer
@@ -32,18 +80,40 @@ using std::string;
  */
 namespace WebServer
 {
+	/**
+	 * @struct LogSlot
+	 * @brief One record of the Logger's ring.
+	 *
+	 * sequence tells whose turn the slot is: it equals the slot's next write position
+	 * when a producer may claim it, and that position + 1 once the record is published
+	 * for the writer thread.
+	 */
+	struct LogSlot
+	{
+		size_t	sequence;
+		size_t	length;
+		char	data[LOG_RECORD_SIZE];
+	};
+
 	    /**
      * @class Logger
      * @brief A thread-safe Singleton class for logging messages with colored output and timestamps.
      *
      * The Logger class provides functionality for logging messages to the console with support
-     * for colored text using ANSI escape codes. It also ensures thread safety through the use of
-     * a `pthread_mutex_t` and follows the Singleton design pattern to ensure only one instance exists.
+     * for colored text using ANSI escape codes. It follows the Singleton design pattern to
+     * ensure only one instance exists.
+     *
+     * Once start() is called, logMsg() no longer writes: it formats the record straight
+     * into a slot of a bounded lock-free ring (multi-producer, single-consumer, one
+     * sequence number per slot, claimed with a compare-and-swap) and returns. A writer
+     * thread drains the ring and hands the records to the output in batches of up to
+     * LOG_BATCH_SIZE bytes, so the event loop never waits on a console or a disk.
+     * Before start() and after stop() messages are written synchronously.
      *
      * Key features include:
-     * - Logging messages with customizable color formatting.
+     * - Logging messages with customizable color formatting (stripped when the output is not a tty).
      * - Retrieving the current timestamp in a formatted string.
-     * - Thread safety through a mutex.
+     * - A full ring either drops and counts records, or blocks the producer (LogOverflow).
      * - Singleton instance management.
      */
 	class Logger
@@ -51,14 +121,40 @@ namespace WebServer
 		private:
 			static Logger *instancePtr; /**< Pointer to the Singleton instance of Logger. */
 			static pthread_mutex_t mtx; /**< Mutex for thread-safe Singleton access. */
+			static int _level; /**< Most verbose level logged at runtime (log_level). */
+
+			LogSlot			*_slots;
+			size_t			_enqueue_pos; /**< Next position producers claim, advanced by CAS. */
+			char			_pad[64]; /**< Keeps the producers' and the writer's counters on separate cache lines. */
+			size_t			_dequeue_pos; /**< Next position the writer thread reads, its own. */
+			size_t			_dropped; /**< Records lost to a full ring since the last report. */
+			int				_sleeping; /**< Set while the writer waits on _wake_pipe. */
+			int				_running;
+			int				_wake_pipe[2];
+			int				_fd;
+			bool			_color;
+			LogOverflow		_overflow;
+			pthread_t		_thread;
 
 			Logger();
 			~Logger();
 			Logger(const Logger &other);
 			Logger &operator=(const Logger &other);
+
+			size_t			_format(char *buffer, size_t size, const char *color, const char *msg, va_list args);
+			LogSlot			*_claim(size_t &pos);
+			void			_wake();
+			bool			_drain(char *batch, size_t &batch_len);
+			static void		*_writerLoop(void *arg);
+			static void		_writeAll(int fd, const char *data, size_t len);
 		public:
 			static Logger* getInstance();
+			static bool enabled(int level) { return (level <= _level); }
+			static void setLevel(int level);
+			static int parseLevel(const string &name);
 
+			bool	start(const string &path, LogOverflow overflow);
+			void	stop();
 			void	logMsg(const char *color, const char *msg, ...);
 			string	getCurrTime();
 	};
@@ -0,0 +1,49 @@
+#ifndef REQUESTSAMPLER_HPP
+# define REQUESTSAMPLER_HPP
+
+# include <string>
+# include <vector>
+
+# define SAMPLE_BODY_MAX	512 /**< Bytes of a sampled request's body included in its dump. */
+
+class Client;
+
+//log_sample settings, every predicate left at its default is off
+struct SampleConfig
+{
+	unsigned long				every; //dump 1 in every requests, 0 for none
+	short						status; //dump responses with this status or above, 0 for none
+	long						slow_usec; //dump requests that took longer, -1 for none
+	std::vector<std::string>	vhosts; //dump every request to these server names
+	std::vector<std::string>	locations; //dump every request routed to these location paths
+};
+
+/**
+ * Samples completed requests for full dumps (request line, headers, the start of
+ * the body, status, size and timing) through the Logger at info level.
+ *
+ * The decision is made once the response is sent, so a request is always dumped
+ * when it matches a predicate: its status, its latency, its virtual server or its
+ * location. Others are dumped 1 in every. A request that is not sampled costs a
+ * few comparisons and a counter increment.
+ */
+class RequestSampler
+{
+	private:
+		SampleConfig	_config;
+		unsigned long	_count;
+
+		const char	*_reason(const Client &client, long usec, const std::string &vhost);
+
+	public:
+		RequestSampler();
+		RequestSampler(const SampleConfig &config);
+		RequestSampler(const RequestSampler &other);
+		RequestSampler &operator=(const RequestSampler &other);
+		~RequestSampler();
+
+		bool	enabled() const;
+		void	sample(const Client &client, const std::string &vhost);
+};
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef TRACELOG_HPP
+# define TRACELOG_HPP
+
+# include <string>
+# include <set>
+# include <time.h>
+
+# define TRACE_LOG_BUFFER	65536 /**< Bytes of events buffered before a write. */
+# define TRACE_LOG_FLUSH	1 /**< Seconds an event may wait in the buffer. */
+
+class Client;
+
+//request_trace settings, an empty path means no tracing
+struct TraceConfig
+{
+	std::string		path;
+	unsigned long	every; //trace 1 in every requests, 0 for none
+	long			slow_usec; //trace requests that took longer, -1 for none
+};
+
+/**
+ * Writes the phases of sampled requests as Chrome trace events, to be opened
+ * in chrome://tracing or Perfetto.
+ *
+ * Every connection is a track (tid is its socket); a traced request is a span
+ * from its first byte to the last byte of its response, with a nested span for
+ * each phase it went through (see RequestPhase): idle after accept, read
+ * headers, route, read body, handler, cgi and send. A connection with traced
+ * requests also gets an instant event when it closes.
+ *
+ * The file uses the JSON array format: it starts with "[" and every event is
+ * followed by ",", with no closing bracket, which both viewers accept. This lets
+ * a restarted server keep appending to the same file.
+ */
+class TraceLog
+{
+	private:
+		TraceConfig			_config;
+		int					_fd;
+		int					_pid;
+		std::string			_buffer;
+		unsigned long		_count;
+		time_t				_last_flush;
+		std::set<int>		_traced_fds; //connections that got a track name and traced requests
+
+		static TraceLog		*_active; //for flushActive() on the way out
+
+		void	_event(const char *name, const char *phase, int tid, long start, long duration);
+
+	public:
+		TraceLog();
+		TraceLog(const TraceLog &other);
+		TraceLog &operator=(const TraceLog &other);
+		~TraceLog();
+
+		bool	open(const TraceConfig &config);
+		void	close();
+		bool	enabled() const;
+		void	record(const Client &client, const std::string &vhost);
+		void	closed(int fd);
+		void	flush();
+		void	tick(time_t now);
+
+		static void	flushActive();
+};
+
+#endif
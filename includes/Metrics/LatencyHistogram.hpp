@@ -0,0 +1,43 @@
+#ifndef LATENCYHISTOGRAM_HPP
+# define LATENCYHISTOGRAM_HPP
+
+# include <cstddef>
+
+# define HISTOGRAM_SUB_BUCKETS	16 /**< Buckets per power of two: values are kept within 1/16 (about 6%). */
+# define HISTOGRAM_BUCKETS		608 /**< Enough to cover 0 .. 2^41 microseconds. */
+
+/**
+ * HDR-style latency histogram in microseconds.
+ *
+ * Values below 32 get a bucket each; above that every power of two is split in
+ * HISTOGRAM_SUB_BUCKETS equal buckets, so the relative error stays the same from
+ * microseconds to hours. Recording is an index computation and an increment;
+ * percentiles are read by walking the buckets.
+ */
+class LatencyHistogram
+{
+	private:
+		unsigned long long	_counts[HISTOGRAM_BUCKETS];
+		unsigned long long	_count;
+		unsigned long long	_sum;
+		unsigned long long	_max;
+
+		static size_t				_index(unsigned long long usec);
+		static unsigned long long	_upper(size_t index);
+
+	public:
+		LatencyHistogram();
+		LatencyHistogram(const LatencyHistogram &other);
+		LatencyHistogram &operator=(const LatencyHistogram &other);
+		~LatencyHistogram();
+
+		void				record(unsigned long long usec);
+		void				merge(const LatencyHistogram &other);
+		unsigned long long	percentile(double fraction) const;
+
+		unsigned long long	getCount() const;
+		unsigned long long	getSum() const;
+		unsigned long long	getMax() const;
+};
+
+#endif
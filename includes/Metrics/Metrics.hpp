@@ -0,0 +1,71 @@
+#ifndef METRICS_HPP
+# define METRICS_HPP
+
+# include <string>
+# include <ostream>
+# include <map>
+# include <utility>
+# include <time.h>
+# include "LatencyHistogram.hpp"
+# include "../Utils/AllocStats.hpp"
+
+//open client connections by state, counted when the metrics are read
+struct ConnectionCounts
+{
+	size_t	reading; //a request (or its body) is partly received
+	size_t	writing; //a response is being produced or sent
+	size_t	idle; //keep-alive connections with nothing buffered
+};
+
+//counters of the requests answered for one server name and location
+struct RequestStats
+{
+	unsigned long long						requests;
+	unsigned long long						bytes_out;
+	std::map<short, unsigned long long>		statuses;
+	LatencyHistogram						latency;
+	AllocCounts								allocs; //summed over the requests (ALLOC_STATS build)
+};
+
+/**
+ * Counters behind `metrics on` locations: accepted connections, bytes in and out,
+ * and per server name and location the requests, status codes and an HDR latency
+ * histogram (p50/p90/p99/p999), plus the event loop stalls caught by the
+ * StallWatchdog. An ALLOC_STATS build adds allocations per request and the
+ * AllocStats totals by thread and phase.
+ *
+ * The event loop is the only writer, so counters are plain integers updated in
+ * place without locks or atomics; totals across servers and locations are summed
+ * only when the metrics are rendered, as text or in Prometheus exposition format.
+ */
+class Metrics
+{
+	private:
+		typedef std::map<std::pair<std::string, std::string>, RequestStats>	StatsMap;
+
+		StatsMap			_stats; //(server name, location path) -> counters
+		unsigned long long	_accepts;
+		unsigned long long	_bytes_in;
+		std::map<std::string, std::pair<unsigned long long, long> >	_stalls; //event loop callback -> (stalls, longest usec)
+		time_t				_started;
+
+		static std::string	_label(const std::string &value);
+		static void			_renderAllocs(std::ostream &out);
+
+	public:
+		Metrics();
+		Metrics(const Metrics &other);
+		Metrics &operator=(const Metrics &other);
+		~Metrics();
+
+		void	accepted();
+		void	received(size_t bytes);
+		void	completed(const std::string &server, const std::string &location, short status,
+					size_t bytes_out, long usec, const AllocCounts &allocs);
+		void	stalled(const std::string &callback, long usec);
+
+		std::string	renderText(const ConnectionCounts &connections) const;
+		std::string	renderPrometheus(const ConnectionCounts &connections) const;
+};
+
+#endif
@@ -0,0 +1,78 @@
+#ifndef CONNECTIONTABLE_HPP
+# define CONNECTIONTABLE_HPP
+
+# include <vector>
+# include <netinet/in.h>
+# include "../Client/Client.hpp"
+
+# define CLIENT_POOL_KEEP	1024 /**< Closed Client objects kept for reuse, beyond that they are freed. */
+# define CLIENT_ALIGN		64 /**< Clients start on a cache line, see Client's member order. */
+# define CONNECTION_TABLE_MAX	1048576 /**< Most fds the table covers, Linux's default fs.nr_open: 24 MB of address space. */
+
+/**
+ * What an fd of the event loop is.
+ */
+enum FdKind
+{
+	FD_UNUSED = 0,
+	FD_LISTEN, /**< A listening socket. */
+	FD_CLIENT, /**< An accepted connection, entry.client. */
+	FD_CGI /**< A pipe or pool worker socket of the CGI run for entry.client_fd. */
+};
+
+struct FdEntry
+{
+	unsigned char	kind; /**< FdKind */
+	int				client_fd; /**< FD_CGI: the client the script answers. */
+	unsigned int	index; /**< FD_CLIENT: position in the active list. */
+	Client			*client; /**< FD_CLIENT: the connection. */
+};
+
+/**
+ * The Router's fds, in an array indexed by fd: dispatching an event is one
+ * lookup, with no tree to walk.
+ *
+ * The array is sized from RLIMIT_NOFILE, which bounds every fd the process can
+ * get, and calloc'd: the kernel maps zero pages lazily, so a large limit only
+ * costs memory for the fds actually used. The Router keeps that limit at most
+ * CONNECTION_TABLE_MAX so the mapping itself stays reasonable.
+ *
+ * Client objects are pooled. open() reuses one a closed connection left behind,
+ * allocated on a cache line boundary so its hot fields share one line, and
+ * close() releases what the connection held and keeps the object. The open
+ * clients are also kept in a dense list for the timeout sweep.
+ */
+class ConnectionTable
+{
+	private:
+		FdEntry					*_entries;
+		size_t					_size;
+		std::vector<Client *>	_active; /**< Open clients, in no particular order. */
+		std::vector<Client *>	_pool; /**< Closed clients ready for reuse. */
+
+		ConnectionTable(const ConnectionTable &other);
+		ConnectionTable &operator=(const ConnectionTable &other);
+
+		static void	_destroy(Client *client);
+
+	public:
+		ConnectionTable();
+		~ConnectionTable();
+
+		bool			allocate(size_t max_fds);
+		size_t			size() const;
+		const FdEntry	&entry(int fd) const;
+		Client			*client(int fd) const;
+
+		Client			*open(int fd, int listen_fd, const struct sockaddr_in &address);
+		void			close(int fd);
+		void			setListen(int fd);
+		void			setCgi(int fd, int client_fd);
+		void			clear(int fd);
+
+		size_t			activeCount() const;
+		Client			*active(size_t index) const;
+		size_t			pooledCount() const;
+};
+
+#endif
@@ -0,0 +1,53 @@
+#ifndef EVENTPOLLER_HPP
+# define EVENTPOLLER_HPP
+
+# include <vector>
+# include <sys/epoll.h>
+
+# define POLLER_MAX_EVENTS	1024 /**< Events taken from the kernel per wait(). */
+
+enum PollInterest
+{
+	POLL_READ = 1,
+	POLL_WRITE = 2
+};
+
+/**
+ * The Router's readiness sets, on epoll.
+ *
+ * add() and remove() keep, per fd, whether the Router wants to read and/or write
+ * it, watching() answers what FD_ISSET on the old select() sets did, and wait()
+ * returns the fds that became ready. Level triggered like select(), so a callback
+ * that leaves data unread is called again on the next wait().
+ *
+ * An fd must be removed before it is closed: CGI children may hold copies of it,
+ * which would keep its registration alive under a number the next accept() reuses.
+ * A hang-up or error counts as ready for whatever the fd is watched for.
+ */
+class EventPoller
+{
+	private:
+		int								_epoll_fd;
+		std::vector<unsigned char>		_interest; //fd -> PollInterest bits
+		struct epoll_event				_events[POLLER_MAX_EVENTS];
+
+		EventPoller(const EventPoller &other);
+		EventPoller &operator=(const EventPoller &other);
+
+		void	_update(int fd, unsigned char interest);
+
+	public:
+		EventPoller();
+		~EventPoller();
+
+		bool	open();
+		void	add(int fd, int interest);
+		void	remove(int fd, int interest);
+		bool	watching(int fd, int interest) const;
+		int		wait(int timeout_ms);
+		int		readyFd(int index) const;
+		bool	readable(int index) const;
+		bool	writable(int index) const;
+};
+
+#endif
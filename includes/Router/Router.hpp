@@ -2,7 +2,19 @@
 # define ROUTER_HPP
 
 #include "../Utils/Utils.hpp"
+#include "../Utils/AllocStats.hpp"
 #include "../ConfigParser/Server.hpp"
+#include "../HTTPMessage/HTTPRequest/HTTPRequest.hpp"
+#include "../Client/Client.hpp"
+#include "../CGI/CgiHandler.hpp"
+#include "../CGI/CgiAdmission.hpp"
+#include "../CGI/CgiCache.hpp"
+#include "../Logger/RequestSampler.hpp"
+#include "../Logger/TraceLog.hpp"
+#include "../Metrics/Metrics.hpp"
+#include "StallWatchdog.hpp"
+#include "EventPoller.hpp"
+#include "ConnectionTable.hpp"
 
  //Setup servers and route requests and responses
 class Router
@@ -12,31 +24,79 @@ class Router
 		~Router();
 		void	setupServers(std::vector<Server>);
 		void	runServers();
+		void	setSampling(const SampleConfig &config);
+		void	setTracing(const TraceConfig &config);
+		void	setStallThreshold(long threshold);
 		void printRouterDetails();
+
+		static const Server	&matchServer(const std::vector<Server> &servers, const HTTPRequest &request);
 		
 	private:
 		std::vector<Server> _servers;
-		//std::map<int, Client> _clients_map;
-		fd_set	_recv_fd_pool;
-		fd_set	_write_fd_pool;
-		int		_biggest_fd;
-		std::map<int, std::vector<Server> > fds_to_servers_map;
+		ConnectionTable _connections; //fd -> listening socket, client or CGI fd
+		std::map<int, CgiHandler> _cgi_map; //client fd -> running script
+		std::map<std::pair<std::string, std::string>, CgiPool> _cgi_pools; //(location root + path, interpreter) or ("fastcgi_pass", address) -> workers
+		std::map<int, CgiPool *> _cgi_waiting; //client fd -> pool it is queued on
+		std::map<string, CgiAdmission> _cgi_admissions; //location root + path -> cgi_max_concurrent state
+		std::map<int, CgiAdmission *> _cgi_slots; //client fd -> admission it holds a slot of
+		std::map<int, CgiAdmission *> _cgi_queued; //client fd -> admission queue it waits in
+		CgiCache _cgi_cache;
+		std::map<int, string> _cache_fills; //client fd -> microcache key its script fills
+		std::map<int, string> _cache_waiting; //client fd -> microcache key it waits for
+		std::map<string, AccessLog> _access_logs; //access_log path -> open log
+		RequestSampler _sampler;
+		TraceLog _trace;
+		Metrics _metrics;
+		StallWatchdog _watchdog;
+		EventPoller _poller;
+		std::vector<std::vector<Server> > fds_to_servers; //listen fd -> servers on it
+		std::vector<int> _listen_fds;
 		std::map<std::pair<std::string, uint16_t>, int> pairs_to_fds_map;
 
 		void acceptNewConnection(int listen_fd);
-		//void checkTimeout();
+		void checkTimeout();
 		void initialiseSets();
-		/*
-		void readRequest(const int &, Client &);
-		void handleReqBody(Client &);
-		void sendResponse(const int &, Client &);
-		void sendCgiBody(Client &, CgiHandler &);
-		void readCgiResponse(Client &, CgiHandler &);
-		void closeConnection(const int);
-		void assignServer(Client &);
-		*/
-		void addToFdSet(const int fd, fd_set &fdset);
-		void removeFromFdSet(const int fd, fd_set &fdset);
+		void readRequest(const int &fd, Client &client);
+		void watchHangup(const int &fd, Client &client);
+		void parseRequest(Client &client);
+		void rejectRequest(Client &client, short code);
+		void handleRequest(Client &client);
+		void serveStatic(Client &client);
+		void sendResponse(const int &fd, Client &client);
+		void serveDynamic(Client &client);
+		void runCgi(Client &client);
+		void startCgi(Client &client);
+		void startCgiPools();
+		void initCgiAdmissions();
+		void openAccessLogs();
+		void logRequest(Client &client);
+		void serveMetrics(Client &client);
+		void endCallback();
+		void reportStall(const char *callback, const char *stage, int fd, const char *location, long elapsed,
+			const string &trace);
+		void releaseCgiSlot(int client_fd);
+		void expireCgiQueues(time_t now);
+		void startFastCgi(Client &client);
+		void submitToPool(Client &client, CgiPool &pool, const string &script);
+		void runPooledCgi(Client &client, CgiPool &pool, const string &script, int worker_fd);
+		void dispatchPending(CgiPool &pool);
+		void watchCgi(Client &client, CgiHandler &cgi);
+		void waitForCgi(Client &client);
+		void sendCgiBody(Client &client, CgiHandler &cgi);
+		void readCgiResponse(Client &client, CgiHandler &cgi);
+		void spliceCgiOutput(Client &client, CgiHandler &cgi);
+		void closeCgi(int client_fd, bool kill_child);
+		bool cgiBusy(int client_fd) const;
+		bool storeCgiResponse(Client &client, const CgiHandler &cgi);
+		void finishCacheFill(int client_fd, bool lookup_again);
+		string cacheBase(const Client &client) const;
+		void queueCached(Client &client, const CgiCacheEntry &entry, time_t now);
+		void closeConnection(const int fd);
+		void assignServer(Client &client);
+		const Server &selectServer(int listen_fd, const HTTPRequest &request);
+		void queueErrorResponse(Client &client, short code);
+		void queuePrebuilt(Client &client, const string &response);
+		void queueHeaders(Client &client, short code, const std::map<string, string> &headers);
 };
 
 #endif
@@ -0,0 +1,76 @@
+#ifndef STALLWATCHDOG_HPP
+# define STALLWATCHDOG_HPP
+
+# include <string>
+# include <pthread.h>
+
+# define WATCHDOG_THRESHOLD	50000 /**< Default usec a callback may hold the event loop. */
+# define WATCHDOG_FRAMES	32 /**< Stack frames captured from a stalled loop. */
+
+/**
+ * Catches event loop callbacks that block for longer than the threshold.
+ *
+ * The Router brackets each callback (accept, read, write, cgi, timers) with
+ * begin() and end(), and may name the stage it reached inside one with stage()
+ * and the location its request went to with locate().
+ * A watcher thread checks every half threshold whether the current callback is
+ * overdue; if so it sends SIGUSR2 to the loop thread, whose handler records the
+ * loop's stack and stage while it is still stuck. end() then reports how long
+ * the callback took so the Router can log it with that backtrace.
+ *
+ * Whole loop iterations are timed too, for stalls spread over many callbacks.
+ * The handler is installed with SA_RESTART, but a sleep or poll the stalled
+ * callback was blocked in returns early with EINTR.
+ */
+class StallWatchdog
+{
+	private:
+		long				_threshold; //usec, 0 when the watchdog is off
+		pthread_t			_loop_thread;
+		pthread_t			_thread;
+		int					_running;
+		long				_started; //usec the current callback began, 0 between callbacks
+		unsigned long		_generation; //callbacks begun so far
+		unsigned long		_signalled; //last generation the watcher signalled
+		const char			*_callback;
+		const char			*volatile _stage; //read by the signal handler
+		const char			*_location; //path of the location the callback's request went to, or NULL
+		int					_fd;
+		long				_iteration_start;
+		bool				_stalled; //a callback of this iteration was reported
+
+		static void				*_stack[WATCHDOG_FRAMES];
+		static volatile int		_frames;
+		static const char		*volatile _stack_stage;
+		static volatile unsigned long	_stack_generation;
+		static StallWatchdog	*_instance;
+
+		static void		*_watch(void *arg);
+		static void		_capture(int sig);
+
+		StallWatchdog(const StallWatchdog &other);
+		StallWatchdog &operator=(const StallWatchdog &other);
+
+	public:
+		StallWatchdog();
+		~StallWatchdog();
+
+		bool	start(long threshold);
+		void	stop();
+		bool	enabled() const;
+
+		void	beginIteration();
+		long	endIteration();
+		void	begin(const char *callback, int fd);
+		void	stage(const char *stage);
+		void	locate(const char *location);
+		long	end();
+
+		const char	*getCallback() const;
+		const char	*getStage() const;
+		int			getFd() const;
+		const char	*getLocation() const;
+		std::string	getBacktrace() const;
+};
+
+#endif
@@ -0,0 +1,102 @@
+#pragma once
+
+# include <string>
+# include <vector>
+
+/**
+ * Phase of the request a thread is working on, set with ALLOC_PHASE() and used to
+ * attribute the allocations it makes.
+ */
+enum AllocPhase
+{
+	ALLOC_PHASE_OTHER,
+	ALLOC_PHASE_PARSE,
+	ALLOC_PHASE_ROUTE,
+	ALLOC_PHASE_HANDLE,
+	ALLOC_PHASE_RESPOND,
+	ALLOC_PHASE_COUNT
+};
+
+//operator new and delete calls, and bytes asked of operator new
+struct AllocCounts
+{
+	unsigned long long	allocs;
+	unsigned long long	frees;
+	unsigned long long	bytes;
+};
+
+//one thread's counts, by phase
+struct ThreadAllocStats
+{
+	const char			*name;
+	AllocCounts			phases[ALLOC_PHASE_COUNT];
+	ThreadAllocStats	*next;
+};
+
+/**
+ * @namespace WebServer
+ * @brief Contains all components related to the web server.
+ */
+namespace WebServer
+{
+	/**
+	 * @class AllocStats
+	 * @brief Allocation accounting of the ALLOC_STATS build (make re ALLOC_STATS=1).
+	 *
+	 * That build replaces the global operator new and delete with versions that count
+	 * calls and bytes in a block owned by the calling thread, under the phase the
+	 * thread set last with ALLOC_PHASE(). A request can also be attached to the
+	 * thread, and is then charged for every allocation until it is detached: the
+	 * Router attaches the client whose callback it runs.
+	 *
+	 * Only the owning thread writes its block, and blocks are never freed, so the
+	 * totals can be read from any thread at any time. In a normal build nothing is
+	 * replaced, ALLOC_PHASE() compiles to nothing and enabled() is false.
+	 *
+	 * Key features include:
+	 * - Counts per thread (named with nameThread()) and per phase.
+	 * - Per request counts through attach().
+	 * - All methods are static, and the class cannot be instantiated.
+	 */
+	class AllocStats
+	{
+		private:
+			AllocStats();
+			~AllocStats();
+			AllocStats(const AllocStats &other);
+			AllocStats &operator=(const AllocStats &other);
+
+		public:
+			static bool				enabled();
+			static void				nameThread(const char *name);
+			static AllocPhase		setPhase(AllocPhase phase);
+			static void				attach(AllocCounts *request);
+			static void				detach(const AllocCounts *request);
+			static AllocCounts		threadTotal();
+			static std::vector<ThreadAllocStats>	snapshot();
+			static const char		*phaseName(int phase);
+
+			static void				allocated(size_t bytes);
+			static void				freed();
+	};
+} // namespace WebServer
+
+//sets the calling thread's phase until the end of the scope
+class AllocPhaseScope
+{
+	private:
+		AllocPhase	_previous;
+
+		AllocPhaseScope(const AllocPhaseScope &other);
+		AllocPhaseScope &operator=(const AllocPhaseScope &other);
+
+	public:
+		explicit AllocPhaseScope(AllocPhase phase): _previous(WebServer::AllocStats::setPhase(phase)) {}
+		~AllocPhaseScope() { WebServer::AllocStats::setPhase(this->_previous); }
+};
+
+# ifdef ALLOC_STATS
+#  define ALLOC_PHASE(phase)	AllocPhaseScope alloc_phase_scope(phase)
+# else
+#  define ALLOC_PHASE(phase)	((void)0)
+# endif
@@ -0,0 +1,68 @@
+#pragma once
+
+# include <cstddef>
+
+# define BUFFER_SMALL		4096 /**< Smallest buffer class, what a new request starts with. */
+# define BUFFER_MEDIUM		16384
+# define BUFFER_LARGE		65536 /**< Largest buffer class. */
+# define BUFFER_CLASSES		3
+# define BUFFER_POOL_KEEP	(1024 * 1024) /**< Bytes of idle buffers kept per class, beyond that they are freed. */
+
+/**
+ * Buffers of one size class: borrowed ones, and idle ones waiting in the pool.
+ */
+struct BufferClassStats
+{
+	size_t	size;
+	size_t	borrowed;
+	size_t	pooled;
+};
+
+/**
+ * @namespace WebServer
+ * @brief Contains all components related to the web server.
+ */
+namespace WebServer
+{
+	/**
+	 * @class BufferPool
+	 * @brief Fixed-size buffers lent to connections while they have data in flight.
+	 *
+	 * Buffers come in three classes (4, 16 and 64 KB). borrow() takes one off the
+	 * class free list, or allocates it when the list is empty; giveBack() puts it
+	 * back, or frees it when the class already keeps BUFFER_POOL_KEEP bytes. A
+	 * connection holds a buffer only while it has bytes buffered, so the memory
+	 * follows the number of active connections, not of open ones.
+	 *
+	 * Like the Clock, it is used from the event loop thread only.
+	 *
+	 * Key features include:
+	 * - classSize() picks the class for a wanted size, capped at BUFFER_LARGE.
+	 * - Counts of borrowed and pooled buffers for the status page.
+	 * - All methods are static, and the class cannot be instantiated.
+	 */
+	class BufferPool
+	{
+		private:
+			struct FreeBuffer
+			{
+				FreeBuffer	*next;
+			};
+
+			static FreeBuffer	*_free[BUFFER_CLASSES]; /**< Idle buffers of each class. */
+			static size_t		_pooled[BUFFER_CLASSES];
+			static size_t		_borrowed[BUFFER_CLASSES];
+
+			BufferPool();
+			~BufferPool();
+			BufferPool(const BufferPool &other);
+			BufferPool &operator=(const BufferPool &other);
+
+			static int		_classIndex(size_t size);
+		public:
+			static size_t			classSize(size_t wanted);
+			static char				*borrow(size_t size);
+			static void				giveBack(char *buffer, size_t size);
+			static BufferClassStats	stats(int index);
+	};
+} // namespace WebServer
@@ -0,0 +1,53 @@
+#pragma once
+
+# include <time.h>
+# include <string>
+
+using std::string;
+
+/**
+ * @namespace WebServer
+ * @brief Contains all components related to the web server.
+ */
+namespace WebServer
+{
+	/**
+	 * @class Clock
+	 * @brief Cached wall clock shared by the response builder and the Logger.
+	 *
+	 * Formatting a timestamp costs a time(), a gmtime() and a strftime(). The Clock
+	 * does that at most once per second, when update() is called from the event loop,
+	 * and hands out the pre-formatted strings to every caller in between.
+	 *
+	 * Key features include:
+	 * - RFC 7231 IMF-fixdate, both bare and as a complete "Date: ...\r\n" header line.
+	 * - The Logger timestamp prefix in GST (GMT+8).
+	 * - The access log's Common Log Format time.
+	 * - A monotonic microsecond counter for request timing (not cached).
+	 * - All methods are static, and the class cannot be instantiated.
+	 */
+	class Clock
+	{
+		private:
+			static time_t	_now; /**< Second the cached strings were rendered for, 0 before the first update. */
+			static string	_http_date; /**< "Sun, 06 Nov 1994 08:49:37 GMT" */
+			static string	_date_header; /**< "Date: Sun, 06 Nov 1994 08:49:37 GMT\r\n" */
+			static string	_log_time; /**< "[1994-11-06  16:49:37]   " */
+			static string	_access_time; /**< "06/Nov/1994:08:49:37 +0000" */
+
+			Clock();
+			~Clock();
+			Clock(const Clock &other);
+			Clock &operator=(const Clock &other);
+
+			static void		_render(time_t now);
+		public:
+			static void				update();
+			static time_t			now();
+			static const string		&httpDate();
+			static const string		&dateHeader();
+			static const string		&logTime();
+			static const string		&accessTime();
+			static long				monotonicUsec();
+	};
+} // namespace WebServer
@@ -49,12 +49,15 @@ namespace WebServer
 	class Utils
     {
         private:
+            static volatile sig_atomic_t _stop_signal;
+
             Utils();
             ~Utils();
             Utils(const Utils& other);
             Utils& operator=(const Utils& other);
         public:
             static  void signalHandler(int signum);
+            static  int stopSignal();
             static  std::vector<string> splitString(const string& s, const string& del = " ");
 			static int ft_stoi(std::string str);
 
@@ -62,9 +65,10 @@ namespace WebServer
         	static bool checkFileIsReadable(std::string abs_path_part, std::string rel_path);
 			
 			static PathType getPathType(const std::string &path);
+			static const char *getMimeType(const std::string &path);
 
         	static std::string statusCodeString(short statusCode);
-			static std::vector<std::pair<short, std::string> > initialiseStatusCodes();
+			static const char *statusLine(short statusCode, size_t &len);
 
         	static std::string getConfigFilePath(int argc, char** argv);
 			static void	checkFinalToken(std::string &parameters);
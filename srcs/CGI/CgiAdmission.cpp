@@ -0,0 +1,93 @@
+#include "../includes/CGI/CgiAdmission.hpp"
+
+CgiAdmission::CgiAdmission(): _max_running(0), _running(0), _max_queued(0), _timeout(0) {}
+
+CgiAdmission::CgiAdmission(size_t max_running, size_t max_queued, time_t timeout):
+	_max_running(max_running), _running(0), _max_queued(max_queued), _timeout(timeout) {}
+
+CgiAdmission::CgiAdmission(const CgiAdmission &other)
+{
+	*this = other;
+}
+
+CgiAdmission &CgiAdmission::operator=(const CgiAdmission &other)
+{
+	if (this != &other)
+	{
+		this->_max_running = other._max_running;
+		this->_running = other._running;
+		this->_max_queued = other._max_queued;
+		this->_timeout = other._timeout;
+		this->_queue = other._queue;
+	}
+	return (*this);
+}
+
+CgiAdmission::~CgiAdmission(){}
+
+//take a slot if one is free and nobody is waiting ahead
+bool CgiAdmission::tryEnter()
+{
+	if (this->_running >= this->_max_running || !this->_queue.empty())
+		return (false);
+	this->_running++;
+	return (true);
+}
+
+void CgiAdmission::leave()
+{
+	if (this->_running > 0)
+		this->_running--;
+}
+
+//false when the queue is full and the request has to be turned away
+bool CgiAdmission::enqueue(int client_fd, time_t now)
+{
+	if (this->_queue.size() >= this->_max_queued)
+		return (false);
+	this->_queue.push_back(std::make_pair(client_fd, now));
+	return (true);
+}
+
+//hand a free slot to the oldest waiter; the slot is taken on its behalf
+bool CgiAdmission::popWaiting(int &client_fd)
+{
+	if (this->_queue.empty() || this->_running >= this->_max_running)
+		return (false);
+	client_fd = this->_queue.front().first;
+	this->_queue.pop_front();
+	this->_running++;
+	return (true);
+}
+
+void CgiAdmission::drop(int client_fd)
+{
+	for (std::deque<std::pair<int, time_t> >::iterator it = this->_queue.begin(); it != this->_queue.end(); ++it)
+	{
+		if (it->first == client_fd)
+		{
+			this->_queue.erase(it);
+			return ;
+		}
+	}
+}
+
+//remove waiters that waited longer than the timeout, oldest first
+void CgiAdmission::expire(time_t now, std::vector<int> &expired)
+{
+	while (!this->_queue.empty() && now - this->_queue.front().second >= this->_timeout)
+	{
+		expired.push_back(this->_queue.front().first);
+		this->_queue.pop_front();
+	}
+}
+
+size_t CgiAdmission::getRunning() const
+{
+	return (this->_running);
+}
+
+size_t CgiAdmission::getQueued() const
+{
+	return (this->_queue.size());
+}
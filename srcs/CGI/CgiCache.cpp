@@ -0,0 +1,216 @@
+#include "../includes/CGI/CgiCache.hpp"
+#include "../includes/HTTPMessage/HTTPRequest/HTTPRequest.hpp"
+#include <cstdlib>
+#include <cctype>
+
+CgiCache::CgiCache(): _size(0) {}
+
+CgiCache::CgiCache(const CgiCache &other)
+{
+	*this = other;
+}
+
+CgiCache &CgiCache::operator=(const CgiCache &other)
+{
+	if (this != &other)
+	{
+		this->_vary = other._vary;
+		this->_entries = other._entries;
+		this->_fills = other._fills;
+		this->_size = other._size;
+	}
+	return (*this);
+}
+
+CgiCache::~CgiCache(){}
+
+static std::string	toLower(std::string str)
+{
+	for (size_t i = 0; i < str.size(); ++i)
+		str[i] = std::tolower(str[i]);
+	return (str);
+}
+
+//request header names are kept as the client sent them, Vary compares them case-insensitively
+std::string CgiCache::_requestHeader(const HTTPRequest &request, const std::string &name)
+{
+	const std::map<std::string, std::string> &headers = request.getHeaders();
+
+	for (std::map<std::string, std::string>::const_iterator it = headers.begin(); it != headers.end(); ++it)
+	{
+		if (toLower(it->first) == name)
+			return (it->second);
+	}
+	return ("");
+}
+
+//the base key, extended with the request's values for the headers the stored response varies on
+std::string CgiCache::key(const std::string &base, const HTTPRequest &request) const
+{
+	std::map<std::string, std::vector<std::string> >::const_iterator vary = this->_vary.find(base);
+	std::string full = base;
+
+	if (vary == this->_vary.end())
+		return (full);
+	for (size_t i = 0; i < vary->second.size(); ++i)
+		full += "\n" + vary->second[i] + ":" + _requestHeader(request, vary->second[i]);
+	return (full);
+}
+
+//a fresh entry for key, or NULL
+const CgiCacheEntry *CgiCache::lookup(const std::string &key, time_t now) const
+{
+	std::map<std::string, CgiCacheEntry>::const_iterator it = this->_entries.find(key);
+
+	if (it == this->_entries.end() || it->second.expires <= now)
+		return (NULL);
+	return (&it->second);
+}
+
+//false when another request is already filling key
+bool CgiCache::beginFill(const std::string &key)
+{
+	if (this->_fills.count(key))
+		return (false);
+	this->_fills[key];
+	return (true);
+}
+
+void CgiCache::wait(const std::string &key, int client_fd)
+{
+	this->_fills[key].push_back(client_fd);
+}
+
+void CgiCache::dropWaiter(const std::string &key, int client_fd)
+{
+	std::map<std::string, std::vector<int> >::iterator it = this->_fills.find(key);
+
+	if (it == this->_fills.end())
+		return ;
+	for (size_t i = 0; i < it->second.size(); ++i)
+	{
+		if (it->second[i] == client_fd)
+		{
+			it->second.erase(it->second.begin() + i);
+			return ;
+		}
+	}
+}
+
+//the filler of key is done: hand back the requests that waited for it, oldest first
+void CgiCache::endFill(const std::string &key, std::vector<int> &waiters)
+{
+	std::map<std::string, std::vector<int> >::iterator it = this->_fills.find(key);
+
+	if (it == this->_fills.end())
+		return ;
+	waiters.swap(it->second);
+	this->_fills.erase(it);
+}
+
+/**
+ * Stores entry for request under base. The Vary list given with the response
+ * becomes the one used to key later lookups of base. Returns false when the
+ * cache is full even after dropping expired entries.
+ */
+bool CgiCache::store(const std::string &base, const HTTPRequest &request, const CgiCacheEntry &entry,
+	const std::vector<std::string> &vary)
+{
+	if (this->_size + entry.body.size() > CGI_CACHE_SIZE_MAX)
+		expire(entry.stored);
+	if (this->_size + entry.body.size() > CGI_CACHE_SIZE_MAX)
+		return (false);
+	if (vary.empty())
+		this->_vary.erase(base);
+	else
+		this->_vary[base] = vary;
+	std::string full = key(base, request);
+	std::map<std::string, CgiCacheEntry>::iterator old = this->_entries.find(full);
+	if (old != this->_entries.end())
+		this->_size -= old->second.body.size();
+	this->_entries[full] = entry;
+	this->_size += entry.body.size();
+	return (true);
+}
+
+void CgiCache::expire(time_t now)
+{
+	std::map<std::string, CgiCacheEntry>::iterator it = this->_entries.begin();
+
+	while (it != this->_entries.end())
+	{
+		if (it->second.expires <= now)
+		{
+			this->_size -= it->second.body.size();
+			this->_entries.erase(it++);
+		}
+		else
+			++it;
+	}
+}
+
+size_t CgiCache::getCount() const
+{
+	return (this->_entries.size());
+}
+
+size_t CgiCache::getSize() const
+{
+	return (this->_size);
+}
+
+/**
+ * Seconds a script response may be cached, 0 if it may not be. Only statuses
+ * listed in cache_valid are cached; the script's Cache-Control max-age (or
+ * s-maxage, which wins) replaces the configured time. The lowercased names from
+ * the response's Vary are returned in vary.
+ */
+time_t CgiCache::lifetime(short status, const std::vector<std::pair<std::string, std::string> > &headers,
+	const std::map<short, time_t> &valid, std::vector<std::string> &vary)
+{
+	std::map<short, time_t>::const_iterator configured = valid.find(status);
+	long	max_age = -1;
+	long	s_maxage = -1;
+
+	if (configured == valid.end())
+		return (0);
+	for (size_t i = 0; i < headers.size(); ++i)
+	{
+		std::string name = toLower(headers[i].first);
+		if (name == "set-cookie")
+			return (0);
+		if (name != "vary" && name != "cache-control")
+			continue ;
+		std::string value = toLower(headers[i].second);
+		size_t pos = 0;
+		while (pos < value.size())
+		{
+			size_t end = value.find(',', pos);
+			if (end == std::string::npos)
+				end = value.size();
+			size_t first = value.find_first_not_of(" \t", pos);
+			size_t last = value.find_last_not_of(" \t", end - 1);
+			std::string token = (first >= end || last == std::string::npos || last < first) ? "" : value.substr(first, last - first + 1);
+			pos = end + 1;
+			if (token.empty())
+				continue ;
+			if (name == "vary")
+			{
+				if (token == "*")
+					return (0);
+				vary.push_back(token);
+			}
+			else if (token == "no-store" || token == "no-cache" || token == "private")
+				return (0);
+			else if (token.compare(0, 8, "max-age=") == 0)
+				max_age = std::atol(token.c_str() + 8);
+			else if (token.compare(0, 9, "s-maxage=") == 0)
+				s_maxage = std::atol(token.c_str() + 9);
+		}
+	}
+	if (s_maxage >= 0)
+		return (s_maxage);
+	if (max_age >= 0)
+		return (max_age);
+	return (configured->second);
+}
@@ -0,0 +1,740 @@
+#include "../includes/CGI/CgiHandler.hpp"
+#include "../includes/Client/Client.hpp"
+#include "../includes/ConfigParser/Server.hpp"
+#include "../includes/ConfigParser/Location.hpp"
+#include "../includes/Utils/Clock.hpp"
+#include "../includes/Logger/Logger.hpp"
+#include <sys/wait.h>
+#include <spawn.h>
+#include <sys/ioctl.h>
+#include <arpa/inet.h>
+#include <signal.h>
+#include <errno.h>
+#include <algorithm>
+
+int CgiHandler::_signal_pipe[2] = {-1, -1};
+
+CgiHandler::CgiHandler(): _pid(-1), _stdin_fd(-1), _stdout_fd(-1), _client_fd(-1), _body_pos(0),
+	_headers_done(false), _status(200), _has_content_length(false), _chunked(false),
+	_head_only(false), _splice_ok(true), _start_time(0), _pool(NULL), _worker_fd(-1), _worker_done(false), _frame_left(0),
+	_frame_padding(0), _frame_type(0), _capture(false) {}
+
+CgiHandler::CgiHandler(const CgiHandler &other)
+{
+	*this = other;
+}
+
+CgiHandler &CgiHandler::operator=(const CgiHandler &other)
+{
+	if (this != &other)
+	{
+		this->_pid = other._pid;
+		this->_stdin_fd = other._stdin_fd;
+		this->_stdout_fd = other._stdout_fd;
+		this->_client_fd = other._client_fd;
+		this->_body = other._body;
+		this->_body_pos = other._body_pos;
+		this->_header_buffer = other._header_buffer;
+		this->_headers_done = other._headers_done;
+		this->_status = other._status;
+		this->_headers = other._headers;
+		this->_has_content_length = other._has_content_length;
+		this->_chunked = other._chunked;
+		this->_head_only = other._head_only;
+		this->_splice_ok = other._splice_ok;
+		this->_start_time = other._start_time;
+		this->_pool = other._pool;
+		this->_worker_fd = other._worker_fd;
+		this->_worker_done = other._worker_done;
+		this->_frame_header = other._frame_header;
+		this->_frame_left = other._frame_left;
+		this->_frame_padding = other._frame_padding;
+		this->_frame_type = other._frame_type;
+		this->_capture = other._capture;
+		this->_captured = other._captured;
+	}
+	return (*this);
+}
+
+//pipes are owned by the Router's _cgi_map entry and closed explicitly, never on copy
+CgiHandler::~CgiHandler(){}
+
+/**
+ * Starts the interpreter on script with non-blocking pipes for stdin and stdout.
+ * posix_spawn() (vfork semantics in glibc) is used instead of fork(): the child
+ * borrows the server's address space until execve(), so launching does not copy
+ * page tables and does not get slower as the server's heap grows.
+ * Returns false if the pipes or the process could not be created.
+ */
+bool CgiHandler::start(Client &client, const std::string &script, const std::string &interpreter)
+{
+	int		in_pipe[2];
+	int		out_pipe[2];
+
+	if (pipe(in_pipe) < 0)
+		return (false);
+	if (pipe(out_pipe) < 0)
+	{
+		close(in_pipe[0]);
+		close(in_pipe[1]);
+		return (false);
+	}
+	char **envp = buildEnv(client, script);
+	char *argv[3];
+	argv[0] = const_cast<char *>(interpreter.c_str());
+	argv[1] = const_cast<char *>(script.c_str());
+	argv[2] = NULL;
+
+	//every server descriptor is FD_CLOEXEC, only the pipes survive into the script
+	posix_spawn_file_actions_t	actions;
+	posix_spawnattr_t			attr;
+	sigset_t					default_signals;
+	posix_spawn_file_actions_init(&actions);
+	posix_spawn_file_actions_adddup2(&actions, in_pipe[0], STDIN_FILENO);
+	posix_spawn_file_actions_adddup2(&actions, out_pipe[1], STDOUT_FILENO);
+	posix_spawnattr_init(&attr);
+	sigemptyset(&default_signals);
+	sigaddset(&default_signals, SIGPIPE);
+	posix_spawnattr_setsigdefault(&attr, &default_signals);
+	//own process group, so cancelling the script also stops whatever it started
+	posix_spawnattr_setpgroup(&attr, 0);
+	posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_SETPGROUP);
+	for (int i = 0; i < 2; ++i)
+	{
+		fcntl(in_pipe[i], F_SETFD, FD_CLOEXEC);
+		fcntl(out_pipe[i], F_SETFD, FD_CLOEXEC);
+	}
+	int err = posix_spawn(&this->_pid, argv[0], &actions, &attr, argv, envp);
+	posix_spawn_file_actions_destroy(&actions);
+	posix_spawnattr_destroy(&attr);
+	if (err != 0)
+	{
+		close(in_pipe[0]);
+		close(in_pipe[1]);
+		close(out_pipe[0]);
+		close(out_pipe[1]);
+		this->_pid = -1;
+		errno = err;
+		return (false);
+	}
+	close(in_pipe[0]);
+	close(out_pipe[1]);
+	this->_stdin_fd = in_pipe[1];
+	this->_stdout_fd = out_pipe[0];
+	fcntl(this->_stdin_fd, F_SETFL, O_NONBLOCK);
+	fcntl(this->_stdout_fd, F_SETFL, O_NONBLOCK);
+	this->_body = client.getRequest().getBody();
+	_begin(client);
+	return (true);
+}
+
+/**
+ * Hands the request to a pool worker: the environment and the body go out as two
+ * frames on worker_fd, or as a FastCGI request for a FastCGI upstream.
+ * Returns false if the descriptor could not be duplicated.
+ */
+bool CgiHandler::startPooled(Client &client, const std::string &script, CgiPool &pool, int worker_fd)
+{
+	char	**env = buildEnv(client, script);
+
+	this->_stdin_fd = dup(worker_fd);
+	if (this->_stdin_fd < 0)
+		return (false);
+	fcntl(this->_stdin_fd, F_SETFD, FD_CLOEXEC);
+	this->_stdout_fd = worker_fd;
+	this->_pool = &pool;
+	this->_worker_fd = worker_fd;
+	if (pool.getType() == CGI_POOL_FASTCGI)
+		this->_body = CgiPool::fastcgiRequest(env, client.getRequest().getBody());
+	else
+	{
+		std::string env_block;
+		for (size_t i = 0; env[i] != NULL; ++i)
+			env_block.append(env[i], strlen(env[i]) + 1);
+		this->_body = CgiPool::frame(env_block) + CgiPool::frame(client.getRequest().getBody());
+	}
+	_begin(client);
+	return (true);
+}
+
+void CgiHandler::_begin(Client &client)
+{
+	this->_client_fd = client.getFd();
+	this->_body_pos = 0;
+	this->_head_only = (client.getRequest().getRequestMethod() == "HEAD");
+	this->_start_time = WebServer::Clock::now();
+	if (this->_body.empty())
+		closeStdin();
+}
+
+/**
+ * Writes as much of the request body as the stdin pipe takes.
+ * Returns the bytes written, 0 when nothing could be written, -1 if the script
+ * stopped reading. stdin is closed once the whole body is sent.
+ */
+ssize_t CgiHandler::sendBody()
+{
+	if (this->_stdin_fd < 0)
+		return (0);
+	ssize_t written = write(this->_stdin_fd, this->_body.data() + this->_body_pos, this->_body.size() - this->_body_pos);
+	if (written < 0)
+	{
+		if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+			return (0);
+		closeStdin();
+		return (-1);
+	}
+	this->_body_pos += written;
+	if (this->_body_pos >= this->_body.size())
+		closeStdin();
+	return (written);
+}
+
+/**
+ * Reads what the script printed. Until the blank line ending the CGI header block
+ * shows up the bytes are kept aside; after that they are framed and queued on the
+ * client's OutputChain. Returns bytes read, 0 at EOF (or at a pool worker's end
+ * frame), -1 if nothing was available, -2 if the header block is malformed or too large.
+ */
+ssize_t CgiHandler::readOutput(Client &client)
+{
+	char	buffer[CGI_READ_SIZE];
+	ssize_t	bytes_read = read(this->_stdout_fd, buffer, CGI_READ_SIZE);
+
+	if (bytes_read < 0)
+		return ((errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? -1 : 0);
+	if (bytes_read == 0)
+		return (0);
+	if (this->_pool == NULL)
+		return (_consume(client, buffer, bytes_read) ? bytes_read : -2);
+	size_t pos = 0;
+	while (pos < static_cast<size_t>(bytes_read))
+	{
+		if (this->_frame_left == 0 && this->_frame_padding == 0)
+		{
+			if (!_readFrameHeader(buffer, bytes_read, pos))
+				break ;
+		}
+		else if (this->_frame_left > 0)
+		{
+			size_t take = std::min(this->_frame_left, bytes_read - pos);
+			if (this->_frame_type == FCGI_STDOUT && !_consume(client, buffer + pos, take))
+				return (-2);
+			if (this->_frame_type == FCGI_STDERR)
+				WS_WARN("FastCGI stderr: %.*s", static_cast<int>(take), buffer + pos);
+			pos += take;
+			this->_frame_left -= take;
+		}
+		else
+		{
+			size_t take = std::min(this->_frame_padding, bytes_read - pos);
+			pos += take;
+			this->_frame_padding -= take;
+		}
+		if (this->_frame_type == FCGI_END_REQUEST && this->_frame_left == 0 && this->_frame_padding == 0)
+			this->_worker_done = true;
+		if (this->_worker_done)
+			return (0);
+	}
+	return (bytes_read);
+}
+
+/**
+ * Collects the header of the next frame (4-byte length) or FastCGI record (8 bytes:
+ * version, type, request id, content length, padding length). Worker frames are
+ * always script output, and an empty one ends the response. Returns false while the
+ * header is still incomplete.
+ */
+bool CgiHandler::_readFrameHeader(const char *buffer, size_t len, size_t &pos)
+{
+	bool	fastcgi = (this->_pool->getType() == CGI_POOL_FASTCGI);
+	size_t	header_len = fastcgi ? FCGI_HEADER_LEN : 4;
+	size_t	take = std::min(header_len - this->_frame_header.size(), len - pos);
+
+	this->_frame_header.append(buffer + pos, take);
+	pos += take;
+	if (this->_frame_header.size() < header_len)
+		return (false);
+	const unsigned char *h = reinterpret_cast<const unsigned char *>(this->_frame_header.data());
+	if (fastcgi)
+	{
+		this->_frame_type = h[1];
+		this->_frame_left = (h[4] << 8) | h[5];
+		this->_frame_padding = h[6];
+	}
+	else
+	{
+		this->_frame_type = FCGI_STDOUT;
+		this->_frame_left = (static_cast<size_t>(h[0]) << 24) | (h[1] << 16) | (h[2] << 8) | h[3];
+		this->_worker_done = (this->_frame_left == 0);
+	}
+	this->_frame_header.clear();
+	return (true);
+}
+
+//the rest of the body can go from the pipe to the socket untouched
+bool CgiHandler::canSplice() const
+{
+	return (this->_splice_ok && !this->_capture && this->_pool == NULL && this->_headers_done && !this->_chunked
+		&& !this->_head_only && this->_stdout_fd >= 0);
+}
+
+/**
+ * Moves what the script wrote straight from its stdout pipe to sock. Returns the
+ * bytes moved, 0 at EOF, CGI_SPLICE_SOCKET_FULL or CGI_SPLICE_PIPE_EMPTY when either
+ * side would block (FIONREAD tells which, so the caller waits on the right fd), or
+ * CGI_SPLICE_ERROR if the client socket failed.
+ */
+ssize_t CgiHandler::spliceOutput(int sock)
+{
+	ssize_t moved = splice(this->_stdout_fd, NULL, sock, NULL, CGI_SPLICE_SIZE, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+
+	if (moved >= 0)
+		return (moved);
+	if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+	{
+		int available = 0;
+		if (ioctl(this->_stdout_fd, FIONREAD, &available) == 0 && available > 0)
+			return (CGI_SPLICE_SOCKET_FULL);
+		return (CGI_SPLICE_PIPE_EMPTY);
+	}
+	if (errno == EINVAL)
+	{
+		//not supported for these descriptors: fall back to read() and the OutputChain
+		this->_splice_ok = false;
+		return (CGI_SPLICE_PIPE_EMPTY);
+	}
+	return (CGI_SPLICE_ERROR);
+}
+
+//feed script output to the header parser, or straight to the client once headers are out
+bool CgiHandler::_consume(Client &client, const char *data, size_t len)
+{
+	if (this->_headers_done)
+	{
+		_queueBody(client.getOutput(), data, len);
+		return (true);
+	}
+	this->_header_buffer.append(data, len);
+	size_t body_start = 0;
+	if (!_parseHeaderBlock(body_start))
+		return (this->_header_buffer.size() <= CGI_MAX_HEADER_SIZE);
+	if (this->_status == 0)
+		return (false);
+	_queueHeaders(client);
+	if (body_start < this->_header_buffer.size())
+		_queueBody(client.getOutput(), this->_header_buffer.data() + body_start, this->_header_buffer.size() - body_start);
+	this->_header_buffer.clear();
+	return (true);
+}
+
+/**
+ * Looks for the blank line ending the header block. Scripts end lines with "\n"
+ * or "\r\n" and may start with an NPH status line ("HTTP/1.1 200 OK"), so lines are
+ * split on '\n' with a trailing '\r' dropped. Returns false while incomplete.
+ */
+bool CgiHandler::_parseHeaderBlock(size_t &body_start)
+{
+	size_t	pos = 0;
+	size_t	nl;
+
+	//the block is re-parsed from the start until it is complete
+	this->_status = 200;
+	this->_headers.clear();
+	this->_has_content_length = false;
+	while ((nl = this->_header_buffer.find('\n', pos)) != std::string::npos)
+	{
+		std::string line = this->_header_buffer.substr(pos, nl - pos);
+		if (!line.empty() && line[line.size() - 1] == '\r')
+			line.erase(line.size() - 1);
+		pos = nl + 1;
+		if (line.empty())
+		{
+			body_start = pos;
+			this->_headers_done = true;
+			break ;
+		}
+		if (line.compare(0, 5, "HTTP/") == 0)
+		{
+			size_t sp = line.find(' ');
+			this->_status = (sp == std::string::npos) ? 0 : std::atoi(line.c_str() + sp + 1);
+			continue ;
+		}
+		size_t colon = line.find(':');
+		if (colon == std::string::npos || colon == 0)
+		{
+			this->_status = 0;
+			continue ;
+		}
+		std::string name = line.substr(0, colon);
+		size_t value_start = line.find_first_not_of(" \t", colon + 1);
+		std::string value = (value_start == std::string::npos) ? "" : line.substr(value_start);
+		std::string lower = name;
+		for (size_t i = 0; i < lower.size(); ++i)
+			lower[i] = std::tolower(lower[i]);
+		if (lower == "status")
+			this->_status = std::atoi(value.c_str());
+		else
+		{
+			if (lower == "location" && this->_status == 200)
+				this->_status = 302;
+			if (lower == "content-length")
+				this->_has_content_length = true;
+			this->_headers.push_back(std::make_pair(name, value));
+		}
+	}
+	if (this->_headers_done && (this->_status < 100 || this->_status > 599))
+		this->_status = 0;
+	return (this->_headers_done);
+}
+
+/**
+ * Queues the status line and header block. Without a Content-Length from the
+ * script the body is sent chunked to HTTP/1.1 keep-alive clients, and delimited by
+ * closing the connection otherwise.
+ */
+void CgiHandler::_queueHeaders(Client &client)
+{
+	OutputChain	&output = client.getOutput();
+	size_t		status_len;
+	const char	*status_line = WebServer::Utils::statusLine(this->_status, status_len);
+	std::string	block;
+
+	client.setStatus(this->_status);
+	if (status_line != NULL)
+		output.appendSlice(status_line, status_len);
+	else
+	{
+		std::stringstream ss;
+		ss << "HTTP/1.1 " << this->_status << " Unknown\r\n";
+		output.appendMemory(ss.str());
+	}
+	//these statuses never carry a body, whatever the script prints
+	if (this->_status == 204 || this->_status == 304 || this->_status < 200)
+		this->_head_only = true;
+	block = WebServer::Clock::dateHeader() + "Server: webserv\r\n";
+	for (size_t i = 0; i < this->_headers.size(); ++i)
+		block += this->_headers[i].first + ": " + this->_headers[i].second + "\r\n";
+	if (!this->_has_content_length && !this->_head_only)
+	{
+		if (client.getKeepAlive() && client.getRequest().getHttpVersion() == "HTTP/1.1")
+		{
+			this->_chunked = true;
+			block += "Transfer-Encoding: chunked\r\n";
+		}
+		else
+			client.setKeepAlive(false);
+	}
+	if (!client.getKeepAlive())
+		block += "Connection: close\r\n";
+	block += "\r\n";
+	output.appendMemory(block);
+}
+
+void CgiHandler::_queueBody(OutputChain &output, const char *data, size_t len)
+{
+	if (this->_capture && this->_captured.size() + len > CGI_CACHE_ENTRY_MAX)
+	{
+		this->_capture = false;
+		std::string().swap(this->_captured);
+	}
+	else if (this->_capture)
+		this->_captured.append(data, len);
+	if (this->_head_only || len == 0)
+		return ;
+	if (this->_chunked)
+	{
+		char size_line[32];
+		int n = snprintf(size_line, sizeof(size_line), "%lx\r\n", static_cast<unsigned long>(len));
+		output.appendMemory(size_line, n);
+		output.appendMemory(data, len);
+		output.appendMemory("\r\n", 2);
+	}
+	else
+		output.appendMemory(data, len);
+}
+
+//script closed stdout: terminate the chunked body if one was started
+void CgiHandler::finishOutput(Client &client)
+{
+	if (this->_chunked)
+		client.getOutput().appendMemory("0\r\n\r\n", 5);
+}
+
+void CgiHandler::closeStdin()
+{
+	if (this->_stdin_fd >= 0)
+		close(this->_stdin_fd);
+	this->_stdin_fd = -1;
+}
+
+//a pool worker's socket is only forgotten here, the pool keeps or retires it
+void CgiHandler::closeStdout()
+{
+	if (this->_stdout_fd >= 0 && this->_pool == NULL)
+		close(this->_stdout_fd);
+	this->_stdout_fd = -1;
+}
+
+//abort the script and its process group, it is reaped later through the SIGCHLD pipe
+void CgiHandler::kill()
+{
+	if (this->_pid > 0)
+		::kill(-this->_pid, SIGKILL);
+	closeStdin();
+	closeStdout();
+}
+
+pid_t CgiHandler::getPid() const
+{
+	return (this->_pid);
+}
+
+int CgiHandler::getStdinFd() const
+{
+	return (this->_stdin_fd);
+}
+
+int CgiHandler::getStdoutFd() const
+{
+	return (this->_stdout_fd);
+}
+
+int CgiHandler::getClientFd() const
+{
+	return (this->_client_fd);
+}
+
+bool CgiHandler::getHeadersDone() const
+{
+	return (this->_headers_done);
+}
+
+time_t CgiHandler::getStartTime() const
+{
+	return (this->_start_time);
+}
+
+CgiPool *CgiHandler::getPool() const
+{
+	return (this->_pool);
+}
+
+int CgiHandler::getWorkerFd() const
+{
+	return (this->_worker_fd);
+}
+
+bool CgiHandler::getWorkerDone() const
+{
+	return (this->_worker_done);
+}
+
+//keep a copy of the body for the microcache (until it outgrows CGI_CACHE_ENTRY_MAX)
+void CgiHandler::setCapture(bool capture)
+{
+	this->_capture = capture;
+}
+
+bool CgiHandler::getCapture() const
+{
+	return (this->_capture);
+}
+
+const std::string &CgiHandler::getCaptured() const
+{
+	return (this->_captured);
+}
+
+short CgiHandler::getStatus() const
+{
+	return (this->_status);
+}
+
+const std::vector<std::pair<std::string, std::string> > &CgiHandler::getHeaders() const
+{
+	return (this->_headers);
+}
+
+//NAME=value in the arena, name ending with '='
+static char	*envVar(RequestArena &arena, const char *name, const char *value, size_t value_len)
+{
+	return (arena.join(name, strlen(name), value, value_len));
+}
+
+static int	hexValue(char c)
+{
+	if (c >= '0' && c <= '9')
+		return (c - '0');
+	c = std::tolower(c);
+	return ((c >= 'a' && c <= 'f') ? c - 'a' + 10 : -1);
+}
+
+//NAME=path in the arena with the %XX escapes of path decoded; %00 and malformed escapes are kept as they are
+static char	*envPath(RequestArena &arena, const char *name, const char *path, size_t path_len)
+{
+	size_t	name_len = strlen(name);
+	char	*var = static_cast<char *>(arena.allocate(name_len + path_len + 1));
+	char	*out = var + name_len;
+
+	memcpy(var, name, name_len);
+	for (size_t i = 0; i < path_len; ++i)
+	{
+		int high = (path[i] == '%' && i + 2 < path_len) ? hexValue(path[i + 1]) : -1;
+		int low = (high >= 0) ? hexValue(path[i + 2]) : -1;
+		if (low >= 0 && (high | low) != 0)
+		{
+			*out++ = static_cast<char>(high * 16 + low);
+			i += 2;
+		}
+		else
+			*out++ = path[i];
+	}
+	*out = '\0';
+	return (var);
+}
+
+/**
+ * Builds the CGI/1.1 environment (RFC 3875) for script: the location's template
+ * from config load, then the request's own variables and one HTTP_* per header.
+ * The NULL-terminated array and the variables live in the client's RequestArena;
+ * the template entries are the Location's own strings. SCRIPT_NAME is the target
+ * up to the end of the script's file name and PATH_INFO what follows it, both
+ * percent-decoded; QUERY_STRING is passed as received.
+ */
+char **CgiHandler::buildEnv(Client &client, const std::string &script)
+{
+	static const std::vector<std::string>		no_template;
+	static const std::string					no_root;
+	RequestArena								&arena = client.getArena();
+	const HTTPRequest							&request = client.getRequest();
+	const std::string							&target = request.getRequestTarget();
+	const std::map<std::string, std::string>	&headers = request.getHeaders();
+	const std::vector<std::string>				&env_template = client.getLocation() != NULL
+		? client.getLocation()->getCgiEnvTemplate() : no_template;
+	size_t										path_len = std::min(target.find('?'), target.size());
+	const std::string							&root = client.getLocation() != NULL
+		? client.getLocation()->getRoot() : no_root;
+	size_t										script_len = script.size() - std::min(root.size(), script.size());
+	struct sockaddr_in							local;
+	socklen_t									local_len = sizeof(local);
+	char										buffer[INET_ADDRSTRLEN];
+	size_t										n = 0;
+	char										**env = static_cast<char **>(
+		arena.allocate((env_template.size() + 10 + headers.size() + 1) * sizeof(char *)));
+
+	for (size_t i = 0; i < env_template.size(); ++i)
+		env[n++] = const_cast<char *>(env_template[i].c_str());
+	env[n++] = envVar(arena, "SERVER_PROTOCOL=", request.getHttpVersion().data(), request.getHttpVersion().size());
+	buffer[0] = '\0';
+	if (getsockname(client.getFd(), (struct sockaddr *)&local, &local_len) == 0)
+		snprintf(buffer, sizeof(buffer), "%u", ntohs(local.sin_port));
+	env[n++] = envVar(arena, "SERVER_PORT=", buffer, strlen(buffer));
+	env[n++] = envVar(arena, "REQUEST_METHOD=", request.getRequestMethod().data(), request.getRequestMethod().size());
+	env[n++] = envVar(arena, "REQUEST_URI=", target.data(), target.size());
+	//script is root + the start of the target, or root + the target + "/" index for a directory
+	if (script_len <= path_len && target.compare(0, script_len, script, script.size() - script_len, script_len) == 0)
+	{
+		env[n++] = envPath(arena, "SCRIPT_NAME=", target.data(), script_len);
+		env[n++] = envPath(arena, "PATH_INFO=", target.data() + script_len, path_len - script_len);
+	}
+	else
+	{
+		env[n++] = envPath(arena, "SCRIPT_NAME=", script.data() + script.size() - script_len, script_len);
+		env[n++] = envVar(arena, "PATH_INFO=", "", 0);
+	}
+	env[n++] = envVar(arena, "SCRIPT_FILENAME=", script.data(), script.size());
+	if (path_len < target.size())
+		env[n++] = envVar(arena, "QUERY_STRING=", target.data() + path_len + 1, target.size() - path_len - 1);
+	else
+		env[n++] = envVar(arena, "QUERY_STRING=", "", 0);
+	inet_ntop(AF_INET, &client.getAddress().sin_addr, buffer, INET_ADDRSTRLEN);
+	env[n++] = envVar(arena, "REMOTE_ADDR=", buffer, strlen(buffer));
+	snprintf(buffer, sizeof(buffer), "%lu", static_cast<unsigned long>(request.getBody().size()));
+	env[n++] = envVar(arena, "CONTENT_LENGTH=", buffer, strlen(buffer));
+	for (std::map<std::string, std::string>::const_iterator it = headers.begin(); it != headers.end(); ++it)
+	{
+		//"HTTP_" NAME "=" value, NAME upper-cased with '-' turned into '_'
+		const std::string &name = it->first;
+		char *var = static_cast<char *>(arena.allocate(5 + name.size() + 1 + it->second.size() + 1));
+		memcpy(var, "HTTP_", 5);
+		for (size_t i = 0; i < name.size(); ++i)
+			var[5 + i] = (name[i] == '-') ? '_' : std::toupper(name[i]);
+		var[5 + name.size()] = '=';
+		memcpy(var + 5 + name.size() + 1, it->second.data(), it->second.size());
+		var[5 + name.size() + 1 + it->second.size()] = '\0';
+		if (strncmp(var, "HTTP_CONTENT_TYPE=", 18) == 0)
+			env[n++] = var + 5;
+		else if (strncmp(var, "HTTP_CONTENT_LENGTH=", 20) != 0)
+			env[n++] = var;
+	}
+	env[n] = NULL;
+	return (env);
+}
+
+//interpreter configured for the script's extension, empty if it is not a CGI script
+std::string CgiHandler::getInterpreter(const Location &location, const std::string &script)
+{
+	size_t dot = script.rfind('.');
+
+	if (dot == std::string::npos || script.find('/', dot) != std::string::npos)
+		return ("");
+	std::map<std::string, std::string>::const_iterator it = location._ext_path.find(script.substr(dot));
+	if (it == location._ext_path.end())
+		return ("");
+	return (it->second);
+}
+
+void CgiHandler::_sigchldHandler(int sig)
+{
+	int saved_errno = errno;
+
+	(void)sig;
+	if (_signal_pipe[1] >= 0)
+		write(_signal_pipe[1], "c", 1);
+	errno = saved_errno;
+}
+
+/**
+ * Self-pipe for SIGCHLD: the handler writes a byte, the Router watches the read end
+ * with the other descriptors and reaps children from the event loop.
+ */
+void CgiHandler::initSignalPipe()
+{
+	if (_signal_pipe[0] >= 0)
+		return ;
+	if (pipe(_signal_pipe) < 0)
+		throw std::runtime_error("CGI signal pipe: " + std::string(strerror(errno)));
+	for (int i = 0; i < 2; ++i)
+	{
+		fcntl(_signal_pipe[i], F_SETFL, O_NONBLOCK);
+		fcntl(_signal_pipe[i], F_SETFD, FD_CLOEXEC);
+	}
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = _sigchldHandler;
+	sigemptyset(&sa.sa_mask);
+	sa.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+	sigaction(SIGCHLD, &sa, NULL);
+}
+
+int CgiHandler::getSignalFd()
+{
+	return (_signal_pipe[0]);
+}
+
+//drain the self-pipe and collect every exited child without blocking
+void CgiHandler::reapChildren()
+{
+	char	buffer[64];
+	int		status;
+	pid_t	pid;
+
+	while (read(_signal_pipe[0], buffer, sizeof(buffer)) > 0)
+		;
+	while ((pid = waitpid(-1, &status, WNOHANG)) > 0)
+	{
+		if (WIFEXITED(status) && WEXITSTATUS(status) != 0)
+			WS_WARN("CGI process %d exited with status %d", pid, WEXITSTATUS(status));
+	}
+}
@@ -0,0 +1,439 @@
+#include "../includes/CGI/CgiPool.hpp"
+#include "../includes/Utils/Clock.hpp"
+#include "../includes/Logger/Logger.hpp"
+#include <sys/socket.h>
+#include <signal.h>
+#include <spawn.h>
+#include <arpa/inet.h>
+#include <errno.h>
+#include <algorithm>
+
+/*
+ * Worker loop run with "python3 -c". The script runs in-process through runpy with
+ * the request's environment, stdin and stdout swapped in, so modules it imports stay
+ * loaded for the next request. The output is sent back once the script returns.
+ */
+static const char	*PYTHON_BOOTSTRAP =
+	"import io, os, runpy, socket, struct, sys, traceback\n"
+	"conn = socket.socket(fileno=3)\n"
+	"def recv_exact(n):\n"
+	"    data = b''\n"
+	"    while len(data) < n:\n"
+	"        chunk = conn.recv(n - len(data))\n"
+	"        if not chunk:\n"
+	"            sys.exit(0)\n"
+	"        data += chunk\n"
+	"    return data\n"
+	"def recv_frame():\n"
+	"    return recv_exact(struct.unpack('>I', recv_exact(4))[0])\n"
+	"def send_frames(data):\n"
+	"    for i in range(0, len(data), 65536):\n"
+	"        chunk = data[i:i + 65536]\n"
+	"        conn.sendall(struct.pack('>I', len(chunk)) + chunk)\n"
+	"    conn.sendall(struct.pack('>I', 0))\n"
+	"while True:\n"
+	"    env = recv_frame()\n"
+	"    body = recv_frame()\n"
+	"    os.environ.clear()\n"
+	"    for entry in env.split(b'\\0'):\n"
+	"        key, sep, value = entry.partition(b'=')\n"
+	"        if sep:\n"
+	"            os.environb[key] = value\n"
+	"    out = io.BytesIO()\n"
+	"    sys.stdin = io.TextIOWrapper(io.BytesIO(body))\n"
+	"    sys.stdout = io.TextIOWrapper(out, write_through=True)\n"
+	"    sys.argv = [os.environ.get('SCRIPT_FILENAME', '')]\n"
+	"    try:\n"
+	"        runpy.run_path(sys.argv[0], run_name='__main__')\n"
+	"    except SystemExit:\n"
+	"        pass\n"
+	"    except BaseException:\n"
+	"        traceback.print_exc()\n"
+	"    sys.stdout.flush()\n"
+	"    send_frames(out.getvalue())\n";
+
+CgiPool::CgiPool(): _type(CGI_POOL_WORKERS), _unix(false)
+{
+	memset(&this->_unix_address, 0, sizeof(this->_unix_address));
+	memset(&this->_inet_address, 0, sizeof(this->_inet_address));
+	this->_config.workers = 0;
+	this->_config.max_workers = 0;
+	this->_config.max_requests = 0;
+	this->_config.idle_timeout = 0;
+}
+
+/**
+ * For CGI_POOL_FASTCGI, target is the fastcgi_pass address, already validated by
+ * the config parser: "unix:/path" or "ip:port".
+ */
+CgiPool::CgiPool(const std::string &target, const CgiPoolConfig &config, CgiPoolType type):
+	_type(type), _target(target), _config(config), _unix(false)
+{
+	memset(&this->_unix_address, 0, sizeof(this->_unix_address));
+	memset(&this->_inet_address, 0, sizeof(this->_inet_address));
+	if (type != CGI_POOL_FASTCGI)
+		return ;
+	if (target.compare(0, 5, "unix:") == 0)
+	{
+		this->_unix = true;
+		this->_unix_address.sun_family = AF_UNIX;
+		strncpy(this->_unix_address.sun_path, target.c_str() + 5, sizeof(this->_unix_address.sun_path) - 1);
+		return ;
+	}
+	size_t colon = target.find(':');
+	this->_inet_address.sin_family = AF_INET;
+	this->_inet_address.sin_port = htons(std::atoi(target.c_str() + colon + 1));
+	inet_pton(AF_INET, target.substr(0, colon).c_str(), &this->_inet_address.sin_addr);
+}
+
+CgiPool::CgiPool(const CgiPool &other)
+{
+	*this = other;
+}
+
+CgiPool &CgiPool::operator=(const CgiPool &other)
+{
+	if (this != &other)
+	{
+		this->_type = other._type;
+		this->_target = other._target;
+		this->_config = other._config;
+		this->_unix_address = other._unix_address;
+		this->_inet_address = other._inet_address;
+		this->_unix = other._unix;
+		this->_workers = other._workers;
+		this->_pending = other._pending;
+	}
+	return (*this);
+}
+
+//workers are owned by the Router's pool entry and stopped by shutdown(), never on copy
+CgiPool::~CgiPool(){}
+
+//pre-spawn the minimum number of workers
+void CgiPool::start()
+{
+	while (this->_workers.size() < this->_config.workers && _spawn())
+		;
+	if (this->_type == CGI_POOL_FASTCGI)
+		WS_INFO("FastCGI upstream %s, up to %lu connections",
+			this->_target.c_str(), this->_config.max_workers);
+	else
+		WS_INFO("CGI pool for %s started with %lu workers",
+			this->_target.c_str(), this->_workers.size());
+}
+
+bool CgiPool::_spawn()
+{
+	int sv[2];
+
+	if (this->_type == CGI_POOL_FASTCGI)
+		return (_connect());
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0)
+		return (false);
+	fcntl(sv[0], F_SETFD, FD_CLOEXEC);
+	fcntl(sv[1], F_SETFD, FD_CLOEXEC);
+	//the bootstrap talks on fd 3, stray writes to stdout go nowhere
+	posix_spawn_file_actions_t	actions;
+	posix_spawnattr_t			attr;
+	sigset_t					default_signals;
+	posix_spawn_file_actions_init(&actions);
+	posix_spawn_file_actions_adddup2(&actions, sv[1], 3);
+	posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+	posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+	posix_spawnattr_init(&attr);
+	sigemptyset(&default_signals);
+	sigaddset(&default_signals, SIGPIPE);
+	posix_spawnattr_setsigdefault(&attr, &default_signals);
+	posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGDEF);
+	char *argv[4];
+	char *envp[1];
+	argv[0] = const_cast<char *>(this->_target.c_str());
+	argv[1] = const_cast<char *>("-c");
+	argv[2] = const_cast<char *>(PYTHON_BOOTSTRAP);
+	argv[3] = NULL;
+	envp[0] = NULL;
+	pid_t pid;
+	int err = posix_spawn(&pid, argv[0], &actions, &attr, argv, envp);
+	posix_spawn_file_actions_destroy(&actions);
+	posix_spawnattr_destroy(&attr);
+	if (err != 0)
+	{
+		close(sv[0]);
+		close(sv[1]);
+		return (false);
+	}
+	close(sv[1]);
+	fcntl(sv[0], F_SETFL, O_NONBLOCK);
+	CgiWorker worker;
+	worker.pid = pid;
+	worker.fd = sv[0];
+	worker.busy = false;
+	worker.served = 0;
+	worker.last_used = WebServer::Clock::now();
+	this->_workers.push_back(worker);
+	return (true);
+}
+
+/**
+ * Opens a connection to the FastCGI server. The connect is non-blocking: the
+ * request is written once the socket becomes writable, and a refused connection
+ * shows up as a write or read error on it.
+ */
+bool CgiPool::_connect()
+{
+	int fd = socket(this->_unix ? AF_UNIX : AF_INET, SOCK_STREAM, 0);
+
+	if (fd < 0)
+		return (false);
+	fcntl(fd, F_SETFD, FD_CLOEXEC);
+	fcntl(fd, F_SETFL, O_NONBLOCK);
+	int ret = this->_unix ? connect(fd, (struct sockaddr *)&this->_unix_address, sizeof(this->_unix_address))
+		: connect(fd, (struct sockaddr *)&this->_inet_address, sizeof(this->_inet_address));
+	if (ret < 0 && errno != EINPROGRESS)
+	{
+		WS_ERROR("webserv: cannot connect to FastCGI %s: %s",
+			this->_target.c_str(), strerror(errno));
+		close(fd);
+		return (false);
+	}
+	CgiWorker connection;
+	connection.pid = -1;
+	connection.fd = fd;
+	connection.busy = false;
+	connection.served = 0;
+	connection.last_used = WebServer::Clock::now();
+	this->_workers.push_back(connection);
+	return (true);
+}
+
+//stop a worker: closing its socket ends the loop, a busy one is killed outright
+void CgiPool::_retire(size_t index)
+{
+	CgiWorker &worker = this->_workers[index];
+
+	if (worker.busy && worker.pid > 0)
+		kill(worker.pid, SIGKILL);
+	close(worker.fd);
+	this->_workers.erase(this->_workers.begin() + index);
+}
+
+/**
+ * Hands out an idle worker, spawning one if the pool is below max_workers.
+ * Returns the worker's socket, or -1 if the request has to wait in the queue.
+ * failed is set when no worker could be created and none is busy either, so
+ * waiting would never end.
+ */
+int CgiPool::acquire(bool &failed)
+{
+	char	peek;
+	size_t	i = 0;
+
+	failed = false;
+	while (i < this->_workers.size())
+	{
+		CgiWorker &worker = this->_workers[i];
+		if (!worker.busy)
+		{
+			//an idle worker never writes, readable means it died (or the server hung up)
+			ssize_t ret = recv(worker.fd, &peek, 1, MSG_PEEK | MSG_DONTWAIT);
+			if (ret == 0 || (ret < 0 && errno != EAGAIN && errno != EWOULDBLOCK))
+			{
+				_retire(i);
+				continue ;
+			}
+			worker.busy = true;
+			worker.served++;
+			return (worker.fd);
+		}
+		++i;
+	}
+	if (this->_workers.size() >= this->_config.max_workers)
+		return (-1);
+	if (!_spawn())
+	{
+		failed = this->_workers.empty();
+		return (-1);
+	}
+	this->_workers.back().busy = true;
+	this->_workers.back().served++;
+	return (this->_workers.back().fd);
+}
+
+/**
+ * Gives a worker back once its request is over. A worker that did not finish its
+ * response cleanly, or reached max_requests, is retired instead.
+ */
+void CgiPool::release(int worker_fd, bool reusable)
+{
+	for (size_t i = 0; i < this->_workers.size(); ++i)
+	{
+		if (this->_workers[i].fd != worker_fd)
+			continue ;
+		if (!reusable || this->_workers[i].served >= this->_config.max_requests)
+			return (_retire(i));
+		this->_workers[i].busy = false;
+		this->_workers[i].last_used = WebServer::Clock::now();
+		return ;
+	}
+}
+
+void CgiPool::queue(int client_fd, const std::string &script)
+{
+	this->_pending.push_back(std::make_pair(client_fd, script));
+}
+
+bool CgiPool::popPending(int &client_fd, std::string &script)
+{
+	if (this->_pending.empty())
+		return (false);
+	client_fd = this->_pending.front().first;
+	script = this->_pending.front().second;
+	this->_pending.pop_front();
+	return (true);
+}
+
+void CgiPool::dropPending(int client_fd)
+{
+	for (std::deque<std::pair<int, std::string> >::iterator it = this->_pending.begin(); it != this->_pending.end(); ++it)
+	{
+		if (it->first == client_fd)
+		{
+			this->_pending.erase(it);
+			return ;
+		}
+	}
+}
+
+//retire extra workers idle for too long, then refill up to the minimum
+void CgiPool::maintain(time_t now)
+{
+	size_t i = 0;
+
+	while (i < this->_workers.size())
+	{
+		if (this->_workers.size() > this->_config.workers && !this->_workers[i].busy
+			&& now - this->_workers[i].last_used > this->_config.idle_timeout)
+			_retire(i);
+		else
+			++i;
+	}
+	while (this->_workers.size() < this->_config.workers && _spawn())
+		;
+}
+
+void CgiPool::shutdown()
+{
+	while (!this->_workers.empty())
+		_retire(this->_workers.size() - 1);
+	this->_pending.clear();
+}
+
+const std::string &CgiPool::getTarget() const
+{
+	return (this->_target);
+}
+
+CgiPoolType CgiPool::getType() const
+{
+	return (this->_type);
+}
+
+size_t CgiPool::getSize() const
+{
+	return (this->_workers.size());
+}
+
+size_t CgiPool::getPendingCount() const
+{
+	return (this->_pending.size());
+}
+
+//only the Python bootstrap exists, other interpreters keep forking per request
+bool CgiPool::supports(const std::string &interpreter)
+{
+	size_t slash = interpreter.rfind('/');
+
+	return (interpreter.compare(slash == std::string::npos ? 0 : slash + 1, 6, "python") == 0);
+}
+
+//4-byte big-endian length followed by the payload
+std::string CgiPool::frame(const std::string &payload)
+{
+	unsigned long	len = payload.size();
+	char			header[4];
+
+	header[0] = static_cast<char>((len >> 24) & 0xff);
+	header[1] = static_cast<char>((len >> 16) & 0xff);
+	header[2] = static_cast<char>((len >> 8) & 0xff);
+	header[3] = static_cast<char>(len & 0xff);
+	return (std::string(header, 4) + payload);
+}
+
+static void appendRecord(std::string &out, unsigned char type, const char *data, size_t len)
+{
+	unsigned char header[FCGI_HEADER_LEN];
+	size_t padding = (8 - len % 8) % 8;
+
+	header[0] = FCGI_VERSION_1;
+	header[1] = type;
+	header[2] = 0; //every request uses id 1, one request per connection at a time
+	header[3] = 1;
+	header[4] = static_cast<unsigned char>((len >> 8) & 0xff);
+	header[5] = static_cast<unsigned char>(len & 0xff);
+	header[6] = static_cast<unsigned char>(padding);
+	header[7] = 0;
+	out.append(reinterpret_cast<char *>(header), FCGI_HEADER_LEN);
+	out.append(data, len);
+	out.append(padding, '\0');
+}
+
+//content of a stream split over as many records as needed, then the empty record ending it
+static void appendStream(std::string &out, unsigned char type, const std::string &content)
+{
+	for (size_t pos = 0; pos < content.size(); pos += FCGI_RECORD_MAX)
+		appendRecord(out, type, content.data() + pos, std::min(static_cast<size_t>(FCGI_RECORD_MAX), content.size() - pos));
+	appendRecord(out, type, "", 0);
+}
+
+//name-value pair lengths: one byte below 128, four bytes with the high bit set otherwise
+static void appendLength(std::string &out, size_t len)
+{
+	if (len < 128)
+	{
+		out += static_cast<char>(len);
+		return ;
+	}
+	out += static_cast<char>(((len >> 24) & 0x7f) | 0x80);
+	out += static_cast<char>((len >> 16) & 0xff);
+	out += static_cast<char>((len >> 8) & 0xff);
+	out += static_cast<char>(len & 0xff);
+}
+
+/**
+ * Encodes a whole FastCGI responder request: BEGIN_REQUEST with FCGI_KEEP_CONN so
+ * the connection outlives the request, the environment as PARAMS name-value pairs
+ * and the body as STDIN, both streams closed by an empty record.
+ */
+std::string CgiPool::fastcgiRequest(char *const *env, const std::string &body)
+{
+	std::string		request;
+	std::string		params;
+	const char		begin[8] = {0, FCGI_RESPONDER, FCGI_KEEP_CONN, 0, 0, 0, 0, 0};
+
+	appendRecord(request, FCGI_BEGIN_REQUEST, begin, sizeof(begin));
+	for (size_t i = 0; env[i] != NULL; ++i)
+	{
+		const char *eq = strchr(env[i], '=');
+		if (eq == NULL)
+			continue ;
+		size_t value_len = strlen(eq + 1);
+		appendLength(params, eq - env[i]);
+		appendLength(params, value_len);
+		params.append(env[i], eq - env[i]);
+		params.append(eq + 1, value_len);
+	}
+	appendStream(request, FCGI_PARAMS, params);
+	appendStream(request, FCGI_STDIN, body);
+	return (request);
+}
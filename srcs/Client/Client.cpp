@@ -0,0 +1,262 @@
+#include "../includes/Client/Client.hpp"
+#include "../includes/Utils/Clock.hpp"
+#include <string.h>
+
+Client::Client(): _fd(-1), _listen_fd(-1), _state(CLIENT_READING), _status(0), _keep_alive(true),
+	_last_activity(0), _content_length(0), _server(NULL), _location(NULL), _upstream_start(0), _upstream_time(-1)
+{
+	memset(&_address, 0, sizeof(_address));
+	memset(_phases, 0, sizeof(_phases));
+	memset(&_allocs, 0, sizeof(_allocs));
+}
+
+Client::Client(int fd, int listen_fd, const struct sockaddr_in &address): _fd(fd), _listen_fd(listen_fd),
+	_state(CLIENT_READING), _status(0), _keep_alive(true), _last_activity(0), _content_length(0),
+	_server(NULL), _location(NULL), _address(address), _upstream_start(0), _upstream_time(-1)
+{
+	memset(_phases, 0, sizeof(_phases));
+	memset(&_allocs, 0, sizeof(_allocs));
+	_phases[PHASE_ACCEPT] = WebServer::Clock::monotonicUsec();
+	updateTime();
+}
+
+Client::Client(const Client &other)
+{
+	*this = other;
+}
+
+Client &Client::operator=(const Client &other)
+{
+	if (this != &other)
+	{
+		this->_fd = other._fd;
+		this->_listen_fd = other._listen_fd;
+		this->_address = other._address;
+		this->_state = other._state;
+		this->_last_activity = other._last_activity;
+		this->_keep_alive = other._keep_alive;
+		this->_content_length = other._content_length;
+		this->_input = other._input;
+		this->_request = other._request;
+		this->_server = other._server;
+		this->_location = other._location;
+		this->_output = other._output;
+		this->_status = other._status;
+		memcpy(this->_phases, other._phases, sizeof(this->_phases));
+		this->_upstream_start = other._upstream_start;
+		this->_upstream_time = other._upstream_time;
+		this->_allocs = other._allocs;
+	}
+	return (*this);
+}
+
+Client::~Client(){}
+
+//setters
+void Client::setState(ClientState state)
+{
+	this->_state = state;
+}
+
+void Client::setKeepAlive(bool keep_alive)
+{
+	this->_keep_alive = keep_alive;
+}
+
+void Client::setContentLength(size_t content_length)
+{
+	this->_content_length = content_length;
+}
+
+void Client::setRequest(const HTTPRequest &request)
+{
+	this->_request = request;
+}
+
+void Client::setServer(const Server *server)
+{
+	this->_server = server;
+}
+
+void Client::setLocation(const Location *location)
+{
+	this->_location = location;
+}
+
+void Client::updateTime()
+{
+	this->_last_activity = WebServer::Clock::now();
+}
+
+void Client::setStatus(short status)
+{
+	this->_status = status;
+}
+
+//stamps phase the first time the request reaches it
+void Client::markPhase(RequestPhase phase)
+{
+	if (this->_phases[phase] == 0)
+		this->_phases[phase] = WebServer::Clock::monotonicUsec();
+}
+
+void Client::startUpstreamTimer()
+{
+	this->_upstream_start = WebServer::Clock::monotonicUsec();
+}
+
+void Client::stopUpstreamTimer()
+{
+	if (this->_upstream_start != 0)
+		this->_upstream_time = WebServer::Clock::monotonicUsec() - this->_upstream_start;
+	this->_upstream_start = 0;
+}
+
+//getters
+int Client::getFd() const
+{
+	return (this->_fd);
+}
+
+int Client::getListenFd() const
+{
+	return (this->_listen_fd);
+}
+
+const struct sockaddr_in &Client::getAddress() const
+{
+	return (this->_address);
+}
+
+ClientState Client::getState() const
+{
+	return (this->_state);
+}
+
+time_t Client::getLastActivity() const
+{
+	return (this->_last_activity);
+}
+
+bool Client::getKeepAlive() const
+{
+	return (this->_keep_alive);
+}
+
+size_t Client::getContentLength() const
+{
+	return (this->_content_length);
+}
+
+HTTPRequest &Client::getRequest()
+{
+	return (this->_request);
+}
+
+InputBuffer &Client::getInput()
+{
+	return (this->_input);
+}
+
+const HTTPRequest &Client::getRequest() const
+{
+	return (this->_request);
+}
+
+const Server *Client::getServer() const
+{
+	return (this->_server);
+}
+
+const Location *Client::getLocation() const
+{
+	return (this->_location);
+}
+
+OutputChain &Client::getOutput()
+{
+	return (this->_output);
+}
+
+const OutputChain &Client::getOutput() const
+{
+	return (this->_output);
+}
+
+short Client::getStatus() const
+{
+	return (this->_status);
+}
+
+AllocCounts &Client::getAllocs()
+{
+	return (this->_allocs);
+}
+
+const AllocCounts &Client::getAllocs() const
+{
+	return (this->_allocs);
+}
+
+RequestArena &Client::getArena()
+{
+	return (this->_arena);
+}
+
+long Client::getPhase(RequestPhase phase) const
+{
+	return (this->_phases[phase]);
+}
+
+//first byte of the request: request times in the logs and metrics count from here
+long Client::getRequestStart() const
+{
+	return (this->_phases[PHASE_FIRST_BYTE]);
+}
+
+long Client::getUpstreamTime() const
+{
+	return (this->_upstream_time);
+}
+
+//a pooled object takes a newly accepted connection
+void Client::open(int fd, int listen_fd, const struct sockaddr_in &address)
+{
+	this->_fd = fd;
+	this->_listen_fd = listen_fd;
+	this->_address = address;
+	resetRequest();
+	this->_phases[PHASE_ACCEPT] = WebServer::Clock::monotonicUsec();
+	updateTime();
+}
+
+//the connection is closed: drop everything it held, the object stays for reuse
+void Client::release()
+{
+	this->_input.clear();
+	resetRequest();
+	this->_fd = -1;
+	this->_listen_fd = -1;
+}
+
+//forget the finished request, keeping any pipelined bytes already received
+void Client::resetRequest()
+{
+	this->_request.clear();
+	this->_server = NULL;
+	this->_location = NULL;
+	//the output may hold slices of the arena
+	this->_output.clear();
+	this->_arena.reset();
+	this->_state = CLIENT_READING;
+	this->_keep_alive = true;
+	this->_content_length = 0;
+	this->_status = 0;
+	this->_upstream_start = 0;
+	this->_upstream_time = -1;
+	memset(this->_phases, 0, sizeof(this->_phases));
+	memset(&this->_allocs, 0, sizeof(this->_allocs));
+	//a pipelined request already started arriving
+	if (!this->_input.empty())
+		markPhase(PHASE_FIRST_BYTE);
+}
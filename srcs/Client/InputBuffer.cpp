@@ -0,0 +1,115 @@
+#include "../../includes/Client/InputBuffer.hpp"
+#include "../../includes/Utils/BufferPool.hpp"
+#include <string.h>
+
+InputBuffer::InputBuffer(): _data(NULL), _capacity(0), _start(0), _end(0) {}
+
+InputBuffer::InputBuffer(const InputBuffer &other): _data(NULL), _capacity(0), _start(0), _end(0)
+{
+	*this = other;
+}
+
+//the copy borrows a buffer of its own
+InputBuffer &InputBuffer::operator=(const InputBuffer &other)
+{
+	if (this != &other)
+	{
+		clear();
+		if (!other.empty())
+		{
+			_resize(other._capacity);
+			memcpy(this->_data, other.data(), other.size());
+			this->_end = other.size();
+		}
+	}
+	return (*this);
+}
+
+InputBuffer::~InputBuffer()
+{
+	clear();
+}
+
+//moves the unconsumed bytes to the front of a buffer of capacity bytes
+void InputBuffer::_resize(size_t capacity)
+{
+	char	*data = WebServer::BufferPool::borrow(capacity);
+	size_t	len = size();
+
+	if (len > 0)
+		memcpy(data, this->_data + this->_start, len);
+	WebServer::BufferPool::giveBack(this->_data, this->_capacity);
+	this->_data = data;
+	this->_capacity = capacity;
+	this->_start = 0;
+	this->_end = len;
+}
+
+/**
+ * Free space for at least wanted more bytes if the buffer can make it: borrows,
+ * compacts or grows the buffer as needed. room is set to the bytes available at
+ * the returned pointer, possibly fewer than wanted (0 once BUFFER_LARGE is full).
+ */
+char *InputBuffer::reserve(size_t wanted, size_t &room)
+{
+	if (this->_data == NULL)
+		_resize(WebServer::BufferPool::classSize(wanted));
+	else if (this->_capacity - this->_end < wanted)
+	{
+		if (this->_start > 0)
+		{
+			memmove(this->_data, this->_data + this->_start, size());
+			this->_end -= this->_start;
+			this->_start = 0;
+		}
+		if (this->_capacity - this->_end < wanted && this->_capacity < BUFFER_LARGE)
+			_resize(WebServer::BufferPool::classSize(this->_end + wanted));
+	}
+	room = this->_capacity - this->_end;
+	return (this->_data + this->_end);
+}
+
+//len bytes were written at the pointer reserve() returned
+void InputBuffer::commit(size_t len)
+{
+	this->_end += len;
+	if (this->_start == this->_end)
+		clear();
+}
+
+//drops len bytes from the front, giving the buffer back once nothing is left
+void InputBuffer::consume(size_t len)
+{
+	this->_start += len;
+	if (this->_start >= this->_end)
+		clear();
+}
+
+void InputBuffer::clear()
+{
+	WebServer::BufferPool::giveBack(this->_data, this->_capacity);
+	this->_data = NULL;
+	this->_capacity = 0;
+	this->_start = 0;
+	this->_end = 0;
+}
+
+const char *InputBuffer::data() const
+{
+	return (this->_data + this->_start);
+}
+
+size_t InputBuffer::size() const
+{
+	return (this->_end - this->_start);
+}
+
+bool InputBuffer::empty() const
+{
+	return (this->_start == this->_end);
+}
+
+size_t InputBuffer::capacity() const
+{
+	return (this->_capacity);
+}
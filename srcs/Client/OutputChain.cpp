@@ -0,0 +1,265 @@
+#include "../includes/Client/OutputChain.hpp"
+#include <unistd.h>
+#include <errno.h>
+#include <limits.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#ifdef __linux__
+# include <sys/sendfile.h>
+#endif
+
+OutputChain::OutputChain(): _memory_bytes(0), _pending_bytes(0), _sent_bytes(0) {}
+
+OutputChain::OutputChain(const OutputChain &other): _memory_bytes(0), _pending_bytes(0), _sent_bytes(0)
+{
+	*this = other;
+}
+
+// owned file descriptors are dup()ed so each chain closes its own copy
+OutputChain &OutputChain::operator=(const OutputChain &other)
+{
+	if (this != &other)
+	{
+		clear();
+		this->_buffers = other._buffers;
+		for (size_t i = 0; i < this->_buffers.size(); ++i)
+		{
+			if (this->_buffers[i].type == FILE_REGION && this->_buffers[i].owns_fd)
+				this->_buffers[i].fd = dup(this->_buffers[i].fd);
+		}
+		this->_memory_bytes = other._memory_bytes;
+		this->_pending_bytes = other._pending_bytes;
+		this->_sent_bytes = other._sent_bytes;
+	}
+	return (*this);
+}
+
+OutputChain::~OutputChain()
+{
+	clear();
+}
+
+//queue a copy of data, used for anything built per request
+void OutputChain::appendMemory(const std::string &data)
+{
+	appendMemory(data.data(), data.size());
+}
+
+void OutputChain::appendMemory(const char *data, size_t len)
+{
+	if (len == 0)
+		return ;
+	//coalesce small writes into the previous memory buffer to keep the iovec short
+	if (!this->_buffers.empty() && this->_buffers.back().type == MEMORY
+		&& this->_buffers.back().pos == 0 && this->_buffers.back().len < FILE_CHUNK_SIZE)
+	{
+		this->_buffers.back().data.append(data, len);
+		this->_buffers.back().len += len;
+	}
+	else
+	{
+		Buffer buffer;
+		buffer.type = MEMORY;
+		buffer.data.assign(data, len);
+		buffer.ptr = NULL;
+		buffer.len = len;
+		buffer.pos = 0;
+		buffer.fd = -1;
+		buffer.offset = 0;
+		buffer.owns_fd = false;
+		this->_buffers.push_back(buffer);
+	}
+	this->_memory_bytes += len;
+	this->_pending_bytes += len;
+}
+
+//queue bytes without copying, caller guarantees they outlive the response
+void OutputChain::appendSlice(const char *data, size_t len)
+{
+	if (len == 0)
+		return ;
+	Buffer buffer;
+	buffer.type = SLICE;
+	buffer.ptr = data;
+	buffer.len = len;
+	buffer.pos = 0;
+	buffer.fd = -1;
+	buffer.offset = 0;
+	buffer.owns_fd = false;
+	this->_buffers.push_back(buffer);
+	this->_pending_bytes += len;
+}
+
+//queue len bytes of fd starting at offset, read only when the socket can take them
+void OutputChain::appendFile(int fd, off_t offset, size_t len, bool owns_fd)
+{
+	if (len == 0)
+	{
+		if (owns_fd)
+			close(fd);
+		return ;
+	}
+	Buffer buffer;
+	buffer.type = FILE_REGION;
+	buffer.ptr = NULL;
+	buffer.len = len;
+	buffer.pos = 0;
+	buffer.fd = fd;
+	buffer.offset = offset;
+	buffer.owns_fd = owns_fd;
+	this->_buffers.push_back(buffer);
+	this->_pending_bytes += len;
+}
+
+/**
+ * Writes queued buffers to sock until the chain is empty or the socket is full.
+ * Consecutive memory and slice buffers go out in a single writev().
+ */
+FlushStatus OutputChain::flush(int sock)
+{
+	while (!this->_buffers.empty())
+	{
+		FlushStatus status;
+		if (this->_buffers.front().type == FILE_REGION)
+			status = _flushFile(sock);
+		else
+			status = _flushMemory(sock);
+		if (status != FLUSH_DONE)
+			return (status);
+	}
+	return (FLUSH_DONE);
+}
+
+//gather the leading memory/slice buffers into one writev()
+FlushStatus OutputChain::_flushMemory(int sock)
+{
+	struct iovec	iov[OUTPUT_MAX_IOV];
+	int				count = 0;
+
+	for (std::deque<Buffer>::iterator it = this->_buffers.begin();
+		it != this->_buffers.end() && it->type != FILE_REGION && count < OUTPUT_MAX_IOV; ++it)
+	{
+		const char *base = (it->type == MEMORY) ? it->data.data() : it->ptr;
+		iov[count].iov_base = const_cast<char *>(base + it->pos);
+		iov[count].iov_len = it->len - it->pos;
+		count++;
+	}
+	ssize_t written = writev(sock, iov, count);
+	if (written < 0)
+		return ((errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? FLUSH_AGAIN : FLUSH_ERROR);
+	this->_sent_bytes += written;
+	this->_pending_bytes -= written;
+	size_t left = written;
+	while (left > 0)
+	{
+		Buffer &front = this->_buffers.front();
+		size_t remaining = front.len - front.pos;
+		if (left < remaining)
+		{
+			front.pos += left;
+			if (front.type == MEMORY)
+				this->_memory_bytes -= left;
+			return (FLUSH_AGAIN);
+		}
+		left -= remaining;
+		if (front.type == MEMORY)
+			this->_memory_bytes -= remaining;
+		_popFront();
+	}
+	return (FLUSH_DONE);
+}
+
+//send the next piece of the leading file region
+FlushStatus OutputChain::_flushFile(int sock)
+{
+	Buffer	&front = this->_buffers.front();
+	size_t	chunk = front.len - front.pos;
+	ssize_t	written;
+
+	if (chunk > FILE_CHUNK_SIZE)
+		chunk = FILE_CHUNK_SIZE;
+#ifdef __linux__
+	off_t offset = front.offset + front.pos;
+	written = sendfile(sock, front.fd, &offset, chunk);
+#else
+	char	buf[FILE_CHUNK_SIZE];
+	ssize_t	got = pread(front.fd, buf, chunk, front.offset + front.pos);
+	if (got <= 0)
+		return (FLUSH_ERROR);
+	written = send(sock, buf, got, 0);
+#endif
+	if (written < 0)
+		return ((errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? FLUSH_AGAIN : FLUSH_ERROR);
+	//file shrank under us, the promised Content-Length can no longer be honoured
+	if (written == 0)
+		return (FLUSH_ERROR);
+	front.pos += written;
+	this->_sent_bytes += written;
+	this->_pending_bytes -= written;
+	if (front.pos == front.len)
+	{
+		_popFront();
+		return (FLUSH_DONE);
+	}
+	return (static_cast<size_t>(written) < chunk ? FLUSH_AGAIN : FLUSH_DONE);
+}
+
+void OutputChain::_release(Buffer &buffer)
+{
+	if (buffer.type == FILE_REGION && buffer.owns_fd && buffer.fd >= 0)
+		close(buffer.fd);
+	buffer.fd = -1;
+}
+
+void OutputChain::_popFront()
+{
+	_release(this->_buffers.front());
+	this->_buffers.pop_front();
+}
+
+//drop everything still queued, closing owned files
+void OutputChain::clear()
+{
+	for (size_t i = 0; i < this->_buffers.size(); ++i)
+		_release(this->_buffers[i]);
+	this->_buffers.clear();
+	this->_memory_bytes = 0;
+	this->_pending_bytes = 0;
+	this->_sent_bytes = 0;
+}
+
+bool OutputChain::empty() const
+{
+	return (this->_buffers.empty());
+}
+
+bool OutputChain::aboveHighWater() const
+{
+	return (this->_memory_bytes > OUTPUT_HIGH_WATER);
+}
+
+bool OutputChain::belowLowWater() const
+{
+	return (this->_memory_bytes < OUTPUT_LOW_WATER);
+}
+
+size_t OutputChain::getMemoryBytes() const
+{
+	return (this->_memory_bytes);
+}
+
+size_t OutputChain::getPendingBytes() const
+{
+	return (this->_pending_bytes);
+}
+
+size_t OutputChain::getSentBytes() const
+{
+	return (this->_sent_bytes);
+}
+
+//account for bytes written to the socket around the chain (spliced CGI output)
+void OutputChain::addSentBytes(size_t len)
+{
+	this->_sent_bytes += len;
+}
@@ -0,0 +1,131 @@
+#include "../../includes/Client/RequestArena.hpp"
+#include <new>
+#include <string.h>
+
+#define ARENA_ALIGN	8
+
+//chunks given back by the arenas of this thread, ready for reuse
+static __thread void	*t_free = NULL;
+static __thread size_t	t_free_count = 0;
+
+RequestArena::RequestArena(): _chunks(NULL), _last(NULL), _count(0), _large(NULL), _pos(NULL), _end(NULL), _used(0) {}
+
+RequestArena::RequestArena(const RequestArena &other): _chunks(NULL), _last(NULL), _count(0), _large(NULL),
+	_pos(NULL), _end(NULL), _used(0)
+{
+	(void)other;
+}
+
+//the bytes stay with their owner: this arena keeps its own
+RequestArena &RequestArena::operator=(const RequestArena &other)
+{
+	(void)other;
+	return (*this);
+}
+
+RequestArena::~RequestArena()
+{
+	reset();
+}
+
+//a chunk from the thread's free list, or a new one, becomes the current chunk
+void RequestArena::_newChunk()
+{
+	Chunk *chunk = static_cast<Chunk *>(t_free);
+
+	if (chunk != NULL)
+	{
+		t_free = chunk->next;
+		--t_free_count;
+	}
+	else
+		chunk = static_cast<Chunk *>(::operator new(sizeof(Chunk) + ARENA_CHUNK_SIZE));
+	chunk->next = this->_chunks;
+	if (this->_chunks == NULL)
+		this->_last = chunk;
+	this->_chunks = chunk;
+	++this->_count;
+	this->_pos = reinterpret_cast<char *>(chunk + 1);
+	this->_end = this->_pos + ARENA_CHUNK_SIZE;
+}
+
+//size bytes aligned for any scalar, valid until reset(); throws std::bad_alloc
+void *RequestArena::allocate(size_t size)
+{
+	size = (size + ARENA_ALIGN - 1) & ~static_cast<size_t>(ARENA_ALIGN - 1);
+	if (size > ARENA_CHUNK_SIZE)
+	{
+		Chunk *large = static_cast<Chunk *>(::operator new(sizeof(Chunk) + size));
+		large->next = this->_large;
+		this->_large = large;
+		this->_used += size;
+		return (large + 1);
+	}
+	if (this->_pos == NULL || static_cast<size_t>(this->_end - this->_pos) < size)
+		_newChunk();
+	void *ptr = this->_pos;
+	this->_pos += size;
+	this->_used += size;
+	return (ptr);
+}
+
+//NUL-terminated copy of len bytes of data
+char *RequestArena::copy(const char *data, size_t len)
+{
+	char *dst = static_cast<char *>(allocate(len + 1));
+
+	memcpy(dst, data, len);
+	dst[len] = '\0';
+	return (dst);
+}
+
+//NUL-terminated concatenation of a and b, such as "NAME=" and a value
+char *RequestArena::join(const char *a, size_t a_len, const char *b, size_t b_len)
+{
+	char *dst = static_cast<char *>(allocate(a_len + b_len + 1));
+
+	memcpy(dst, a, a_len);
+	memcpy(dst + a_len, b, b_len);
+	dst[a_len + b_len] = '\0';
+	return (dst);
+}
+
+/**
+ * Forgets every allocation. The chunks join the thread's free list in one splice
+ * while it has room for them, oversized allocations are freed.
+ */
+void RequestArena::reset()
+{
+	while (this->_large != NULL)
+	{
+		Chunk *next = this->_large->next;
+		::operator delete(this->_large);
+		this->_large = next;
+	}
+	if (this->_chunks != NULL && t_free_count + this->_count <= ARENA_FREE_MAX)
+	{
+		this->_last->next = static_cast<Chunk *>(t_free);
+		t_free = this->_chunks;
+		t_free_count += this->_count;
+	}
+	else
+	{
+		while (this->_chunks != NULL)
+		{
+			Chunk *next = this->_chunks->next;
+			::operator delete(this->_chunks);
+			this->_chunks = next;
+		}
+	}
+	this->_chunks = NULL;
+	this->_last = NULL;
+	this->_count = 0;
+	this->_pos = NULL;
+	this->_end = NULL;
+	this->_used = 0;
+}
+
+size_t RequestArena::getUsed() const
+{
+	return (this->_used);
+}
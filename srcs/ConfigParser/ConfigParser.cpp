@@ -1,7 +1,23 @@
 #include "../includes/ConfigParser/ConfigParser.hpp"
 #include "../includes/ConfigParser/Location.hpp"
+#include "../includes/HTTPMessage/HTTPResponse/HTTPResponse.hpp"
 
-ConfigParser::ConfigParser(): _server_num(0){}
+std::vector<std::string> splitStrToVect(const std::string &line, const std::string &sep_chars);
+
+ConfigParser::ConfigParser(): _server_num(0), _error_log("stdout"), _log_overflow(LOG_OVERFLOW_BLOCK),
+	_log_level(LOG_LEVEL_INFO), _stall_threshold(WATCHDOG_THRESHOLD)
+{
+	global_handlers["error_log"] = &ConfigParser::handleErrorLog;
+	global_handlers["log_level"] = &ConfigParser::handleLogLevel;
+	global_handlers["log_sample"] = &ConfigParser::handleLogSample;
+	global_handlers["request_trace"] = &ConfigParser::handleRequestTrace;
+	global_handlers["stall_threshold"] = &ConfigParser::handleStallThreshold;
+	_log_sample.every = 0;
+	_log_sample.status = 0;
+	_log_sample.slow_usec = -1;
+	_request_trace.every = 0;
+	_request_trace.slow_usec = -1;
+}
 
 ConfigParser::~ConfigParser(){}
 
@@ -103,6 +119,9 @@ void ConfigParser::splitServerBlocks(std::string &content)
 
 	while (start < content.length())
 	{
+		start = parseGlobalDirectives(start, content);
+		if (start >= content.length())
+			break ;
 		start = getServerBlockStart(start, content);
 		end = getServerBlockEnd(start, content);
 		if (start >= end)
@@ -113,6 +132,37 @@ void ConfigParser::splitServerBlocks(std::string &content)
 	}
 }
 
+/**
+ * Directives outside server blocks apply to the whole process (error_log,
+ * log_level). Parses
+ * those found from start and returns the index of the next server block.
+ */
+size_t ConfigParser::parseGlobalDirectives(size_t start, std::string &content)
+{
+	size_t i = start;
+
+	while (true)
+	{
+		while (i < content.length() && isspace(content[i]))
+			i++;
+		if (i >= content.length())
+			return (i);
+		if (content.compare(i, 6, "server") == 0 && (i + 6 >= content.length() || isspace(content[i + 6]) || content[i + 6] == '{'))
+			return (i);
+		size_t end = content.find(';', i);
+		if (end == std::string::npos)
+			throw ErrorException("Missing ';' after global directive");
+		std::vector<std::string> parameters = splitStrToVect(content.substr(i, end - i + 1), std::string(" \n\t"));
+		std::map<std::string, GlobalHandler>::iterator it = global_handlers.find(parameters[0]);
+		if (it == global_handlers.end())
+			throw ErrorException("Unsupported global directive: " + parameters[0]);
+		if (parameters.size() < 2)
+			throw ErrorException("Missing value for " + parameters[0]);
+		(this->*(it->second))(parameters);
+		i = end + 1;
+	}
+}
+
 // returns the index of the "{" at the start of a server block
 size_t ConfigParser::getServerBlockStart(size_t start, std::string &content)
 {
@@ -188,6 +238,7 @@ void ConfigParser::parseServerBlock(std::string &config, Server &server)
 	handlers["error_page"] = &ConfigParser::handleErrorPage;
 	handlers["client_max_body_size"] = &ConfigParser::handleClientMaxBodySize;
 	handlers["server_name"] = &ConfigParser::handleServerName;
+	handlers["access_log"] = &ConfigParser::handleAccessLog;
 	
 	for (size_t i = 0; i < parameters.size(); i++)
 	{
@@ -224,12 +275,88 @@ void ConfigParser::finaliseServer(Server &server)
 	if (server.getLocationSetFlag() == true)
 		server.setLocationsDefaultValues();
 	checkServersDup();
+	//redirects and error pages are fixed for the life of the config:
+	//render them once here so a hit costs a single write
 	std::vector<Location> location_list = server.getLocations();
-	std::vector<std::string> return_list;
 	for (size_t i = 0; i < location_list.size() ; ++i)
 	{
-
+		if (!location_list[i].getReturn().empty())
+			server.getLocation(location_list[i].getPath())->setReturnResponse(renderRedirect(location_list[i]));
+		if (!location_list[i]._ext_path.empty() || !location_list[i].getFastCgiPass().empty())
+			server.getLocation(location_list[i].getPath())->setCgiEnvTemplate(renderCgiEnv(server));
+		if (location_list[i].getCgiMaxConcurrent() > 0)
+			server.getLocation(location_list[i].getPath())->setBusyResponse(renderBusy(location_list[i]));
 	}
+	const std::map<short, std::string> &error_pages = server.getErrorPages();
+	for (std::map<short, std::string>::const_iterator it = error_pages.begin(); it != error_pages.end(); ++it)
+		server.setErrorResponse(it->first, renderErrorPage(server, it->first, it->second));
+}
+
+//complete redirect response for a location's return directive
+std::string ConfigParser::renderRedirect(const Location &location)
+{
+	HTTPResponse	response(location.getReturnCode());
+	std::string		body = HTTPResponse::defaultErrorBody(location.getReturnCode());
+	std::stringstream	ss;
+
+	ss << body.size();
+	response.setHeader("Server", "webserv");
+	if (!location.getReturnUrl().empty())
+		response.setHeader("Location", location.getReturnUrl());
+	response.setHeader("Content-Type", "text/html");
+	response.setHeader("Content-Length", ss.str());
+	response.setBody(body);
+	return (response.serialise());
+}
+
+//503 for requests turned away by the CGI admission queue, retry once a wait would be over
+std::string ConfigParser::renderBusy(const Location &location)
+{
+	HTTPResponse		response(503);
+	std::string			body = HTTPResponse::defaultErrorBody(503);
+	std::stringstream	ss;
+
+	ss << (location.getCgiQueueTimeout() > 0 ? location.getCgiQueueTimeout() : 1);
+	response.setHeader("Retry-After", ss.str());
+	ss.str("");
+	ss << body.size();
+	response.setHeader("Server", "webserv");
+	response.setHeader("Content-Type", "text/html");
+	response.setHeader("Content-Length", ss.str());
+	response.setBody(body);
+	return (response.serialise());
+}
+
+//CGI variables that do not depend on the request, copied into every script's environment
+std::vector<std::string> ConfigParser::renderCgiEnv(const Server &server)
+{
+	std::vector<std::string> env;
+
+	env.push_back("GATEWAY_INTERFACE=CGI/1.1");
+	env.push_back("SERVER_SOFTWARE=webserv");
+	env.push_back("SERVER_NAME=" + server.getServerName());
+	env.push_back("DOCUMENT_ROOT=" + server.getRoot());
+	env.push_back("REDIRECT_STATUS=200");
+	return (env);
+}
+
+//complete error response, body read from the error_page file or generated if none is set
+std::string ConfigParser::renderErrorPage(const Server &server, short code, const std::string &path)
+{
+	HTTPResponse	response(code);
+	std::string		body;
+	std::stringstream	ss;
+
+	if (!path.empty())
+		body = WebServer::Utils::readFile(server.getRoot() + path);
+	if (body.empty())
+		body = HTTPResponse::defaultErrorBody(code);
+	ss << body.size();
+	response.setHeader("Server", "webserv");
+	response.setHeader("Content-Type", "text/html");
+	response.setHeader("Content-Length", ss.str());
+	response.setBody(body);
+	return (response.serialise());
 }
 
 //Ensure server port, host and name is unique
@@ -262,6 +389,182 @@ std::vector<Server>	ConfigParser::getServers()
 	return (this->_servers);
 }
 
+const std::string &ConfigParser::getErrorLog() const
+{
+	return (this->_error_log);
+}
+
+LogOverflow ConfigParser::getLogOverflow() const
+{
+	return (this->_log_overflow);
+}
+
+int ConfigParser::getLogLevel() const
+{
+	return (this->_log_level);
+}
+
+const SampleConfig &ConfigParser::getLogSample() const
+{
+	return (this->_log_sample);
+}
+
+const TraceConfig &ConfigParser::getRequestTrace() const
+{
+	return (this->_request_trace);
+}
+
+long ConfigParser::getStallThreshold() const
+{
+	return (this->_stall_threshold);
+}
+
+/**
+ * error_log <path|stdout> [overflow=drop|block];
+ * Where the Logger's writer thread writes, and what happens when messages come in
+ * faster than it can write them: dropped and counted, or the server waits.
+ */
+void ConfigParser::handleErrorLog(std::vector<std::string> &parameters)
+{
+	if (parameters.size() > 3)
+		throw ErrorException("Too many values for error_log");
+	WebServer::Utils::checkFinalToken(parameters.back());
+	if (parameters.size() == 3)
+	{
+		if (parameters[2] == "overflow=drop")
+			this->_log_overflow = LOG_OVERFLOW_DROP;
+		else if (parameters[2] == "overflow=block")
+			this->_log_overflow = LOG_OVERFLOW_BLOCK;
+		else
+			throw ErrorException("Invalid error_log option: " + parameters[2]);
+	}
+	if (parameters[1].empty())
+		throw ErrorException("Missing value for error_log");
+	this->_error_log = parameters[1];
+}
+
+/**
+ * log_level <error|warn|info|debug|trace>;
+ * Most verbose messages written, info by default. Levels compiled out with
+ * make LOG_LEVEL=... cannot be turned back on here.
+ */
+void ConfigParser::handleLogLevel(std::vector<std::string> &parameters)
+{
+	if (parameters.size() != 2)
+		throw ErrorException("Invalid values for log_level");
+	WebServer::Utils::checkFinalToken(parameters[1]);
+	int level = WebServer::Logger::parseLevel(parameters[1]);
+	if (level < 0)
+		throw ErrorException("Invalid log_level: " + parameters[1]);
+	this->_log_level = level;
+}
+
+//"200", "200ms" or "2s" in microseconds, -1 if invalid
+static long	parseMilliseconds(std::string value)
+{
+	long unit = 1000;
+
+	if (value.size() > 2 && value.compare(value.size() - 2, 2, "ms") == 0)
+		value.erase(value.size() - 2);
+	else if (!value.empty() && value[value.size() - 1] == 's')
+	{
+		unit = 1000000;
+		value.erase(value.size() - 1);
+	}
+	if (value.empty() || value.find_first_not_of("0123456789") != std::string::npos)
+		return (-1);
+	return (WebServer::Utils::ft_stoi(value) * unit);
+}
+
+/**
+ * log_sample [every=N] [status=code] [slow=time[ms|s]] [vhost=name]... [location=path]...;
+ * Requests dumped in full once answered: any with a status at or above code, slower
+ * than time (milliseconds by default), or to one of the named server names or
+ * locations, and 1 in every N of the others.
+ */
+void ConfigParser::handleLogSample(std::vector<std::string> &parameters)
+{
+	WebServer::Utils::checkFinalToken(parameters.back());
+	for (size_t i = 1; i < parameters.size(); ++i)
+	{
+		size_t eq = parameters[i].find('=');
+		std::string name = parameters[i].substr(0, eq);
+		std::string value = (eq == std::string::npos) ? "" : parameters[i].substr(eq + 1);
+		if (value.empty())
+			throw ErrorException("Invalid log_sample option: " + parameters[i]);
+		if (name == "every" && value.find_first_not_of("0123456789") == std::string::npos)
+			this->_log_sample.every = WebServer::Utils::ft_stoi(value);
+		else if (name == "status" && value.size() == 3 && value.find_first_not_of("0123456789") == std::string::npos
+			&& value[0] >= '1' && value[0] <= '5')
+			this->_log_sample.status = WebServer::Utils::ft_stoi(value);
+		else if (name == "slow")
+		{
+			this->_log_sample.slow_usec = parseMilliseconds(value);
+			if (this->_log_sample.slow_usec < 0)
+				throw ErrorException("Invalid log_sample option: " + parameters[i]);
+		}
+		else if (name == "vhost")
+			this->_log_sample.vhosts.push_back(value);
+		else if (name == "location")
+			this->_log_sample.locations.push_back(value);
+		else
+			throw ErrorException("Invalid log_sample option: " + parameters[i]);
+	}
+}
+
+/**
+ * request_trace <path> [every=N] [slow=time[ms|s]];
+ * Writes the phases of requests slower than time, and of 1 in every N others, to
+ * path as Chrome trace events. Without options every request is traced.
+ */
+void ConfigParser::handleRequestTrace(std::vector<std::string> &parameters)
+{
+	WebServer::Utils::checkFinalToken(parameters.back());
+	if (!this->_request_trace.path.empty())
+		throw ErrorException("request_trace is duplicated");
+	if (parameters[1].empty())
+		throw ErrorException("Missing path for request_trace");
+	this->_request_trace.path = parameters[1];
+	for (size_t i = 2; i < parameters.size(); ++i)
+	{
+		size_t eq = parameters[i].find('=');
+		std::string name = parameters[i].substr(0, eq);
+		std::string value = (eq == std::string::npos) ? "" : parameters[i].substr(eq + 1);
+		if (name == "every" && !value.empty() && value.find_first_not_of("0123456789") == std::string::npos)
+			this->_request_trace.every = WebServer::Utils::ft_stoi(value);
+		else if (name == "slow")
+		{
+			this->_request_trace.slow_usec = parseMilliseconds(value);
+			if (this->_request_trace.slow_usec < 0)
+				throw ErrorException("Invalid request_trace option: " + parameters[i]);
+		}
+		else
+			throw ErrorException("Invalid request_trace option: " + parameters[i]);
+	}
+	if (parameters.size() == 2)
+		this->_request_trace.every = 1;
+}
+
+/**
+ * stall_threshold <time[ms|s]|off>;
+ * Event loop callbacks running longer than time (50ms by default) are logged
+ * with a backtrace and counted in the metrics.
+ */
+void ConfigParser::handleStallThreshold(std::vector<std::string> &parameters)
+{
+	if (parameters.size() != 2)
+		throw ErrorException("Invalid values for stall_threshold");
+	WebServer::Utils::checkFinalToken(parameters[1]);
+	if (parameters[1] == "off")
+	{
+		this->_stall_threshold = 0;
+		return ;
+	}
+	this->_stall_threshold = parseMilliseconds(parameters[1]);
+	if (this->_stall_threshold <= 0)
+		throw ErrorException("Invalid stall_threshold: " + parameters[1]);
+}
+
 void ConfigParser::handleListen(size_t &i, Server &server, std::vector<std::string> &parameters)
 {
 	if (server.getLocationSetFlag() == true)
@@ -382,6 +685,72 @@ void ConfigParser::handleServerName(size_t &i, Server &server, std::vector<std::
 	server.setServerName(parameters[i]);
 }
 
+/**
+ * access_log <path> [format=combined|json] [buffer=<size>[k|m]] [flush=<seconds>[s|m]];
+ * One record per completed request, written in batches of buffer bytes or every
+ * flush seconds. Server blocks naming the same path share the file.
+ */
+void ConfigParser::handleAccessLog(size_t &i, Server &server, std::vector<std::string> &parameters)
+{
+	AccessLogConfig config = server.getAccessLog();
+
+	if (server.getLocationSetFlag() == true)
+		throw  ErrorException("parameters after location");
+	if (!config.path.empty())
+		throw  ErrorException("access_log is duplicated");
+	config.path = parameters[++i];
+	bool last = (config.path.find(";") != std::string::npos);
+	if (last)
+		WebServer::Utils::checkFinalToken(config.path);
+	while (!last)
+	{
+		if (++i >= parameters.size())
+			throw ErrorException("Missing ';' after access_log");
+		std::string option = parameters[i];
+		last = (option.find(";") != std::string::npos);
+		if (last)
+			WebServer::Utils::checkFinalToken(option);
+		size_t eq = option.find('=');
+		std::string name = option.substr(0, eq);
+		std::string value = (eq == std::string::npos) ? "" : option.substr(eq + 1);
+		unsigned long unit = 1;
+		if (name == "format" && (value == "combined" || value == "json"))
+			config.format = (value == "json") ? ACCESS_LOG_JSON : ACCESS_LOG_COMBINED;
+		else if ((name == "buffer" || name == "flush") && !value.empty())
+		{
+			char suffix = value[value.size() - 1];
+			bool has_unit = false;
+			if (name == "buffer" && (suffix == 'k' || suffix == 'm'))
+			{
+				unit = (suffix == 'k') ? 1024 : 1024 * 1024;
+				has_unit = true;
+			}
+			if (name == "flush" && (suffix == 's' || suffix == 'm'))
+			{
+				unit = (suffix == 'm') ? 60 : 1;
+				has_unit = true;
+			}
+			if (has_unit)
+				value.erase(value.size() - 1);
+			//any other suffix, such as buffer=10s, is an error
+			if (value.empty() || value.find_first_not_of("0123456789") != std::string::npos)
+				throw ErrorException("Invalid access_log option: " + option);
+			unsigned long number = WebServer::Utils::ft_stoi(value) * unit;
+			if (number == 0)
+				throw ErrorException("Invalid access_log option: " + option);
+			if (name == "buffer")
+				config.buffer_size = number;
+			else
+				config.flush_interval = number;
+		}
+		else
+			throw ErrorException("Invalid access_log option: " + option);
+	}
+	if (config.path.empty())
+		throw ErrorException("Missing path for access_log");
+	server.setAccessLog(config);
+}
+
 void ConfigParser::handleClientMaxBodySize(size_t &i, Server &server, std::vector<std::string> &parameters)
 {
 	if (server.getLocationSetFlag() == true)
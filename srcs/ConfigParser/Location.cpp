@@ -12,6 +12,15 @@ Location::Location()
 	this->_alias = "";
 	this->_client_max_body_size = MAX_CONTENT_LENGTH;
 	this->_methods.reserve(3);
+	this->_cgi_pool.workers = 0;
+	this->_cgi_pool.max_workers = 0;
+	this->_cgi_pool.max_requests = 0;
+	this->_cgi_pool.idle_timeout = 0;
+	this->_fastcgi_max_conns = 0;
+	this->_cgi_max_concurrent = 0;
+	this->_cgi_queue_size = 0;
+	this->_cgi_queue_timeout = 0;
+	this->_metrics = false;
 	this->methods_flag = false;
 	this->autoindex_flag = false;
 	this->maxsize_flag = false;
@@ -33,10 +42,21 @@ Location &Location::operator=(const Location &src)
 		this->_cgi_path = src._cgi_path;
 		this->_cgi_ext = src._cgi_ext;
 		this->_return = src._return;
+		this->_return_response = src._return_response;
 		this->_alias = src._alias;
 		this->_methods = src._methods;
 		this->_ext_path = src._ext_path;
 		this->_client_max_body_size = src._client_max_body_size;
+		this->_cgi_pool = src._cgi_pool;
+		this->_fastcgi_pass = src._fastcgi_pass;
+		this->_fastcgi_max_conns = src._fastcgi_max_conns;
+		this->_cgi_env = src._cgi_env;
+		this->_cgi_max_concurrent = src._cgi_max_concurrent;
+		this->_cgi_queue_size = src._cgi_queue_size;
+		this->_cgi_queue_timeout = src._cgi_queue_timeout;
+		this->_busy_response = src._busy_response;
+		this->_cache_valid = src._cache_valid;
+		this->_metrics = src._metrics;
 		this->methods_flag = src.methods_flag;
 		this->maxsize_flag = src.maxsize_flag;
 		this->autoindex_flag = src.autoindex_flag;
@@ -74,8 +94,7 @@ void Location::setIndex(std::string index)
 
 void Location::setMethods(std::vector<std::string> methods)
 {
-	for (size_t i = 0; i < 3; i++)
-		this->_methods[i] = 0;
+	this->_methods.assign(3, 0);
 	const std::string allowed_methods[] = {"GET", "POST", "DELETE"};
 	for (size_t i = 0; i < methods.size(); i++)
 	{
@@ -99,6 +118,12 @@ void Location::setReturn(std::string ret)
 	this->_return = ret;
 }
 
+//pre-serialised redirect response, built once at config load
+void Location::setReturnResponse(const std::string &response)
+{
+	this->_return_response = response;
+}
+
 void Location::setAlias(std::string alias)
 {
 	this->_alias = alias;
@@ -114,6 +139,49 @@ void Location::setCgiExtension(std::vector<std::string> ext)
 	this->_cgi_ext = ext;
 }
 
+void Location::setCgiPool(const CgiPoolConfig &pool)
+{
+	this->_cgi_pool = pool;
+}
+
+void Location::setFastCgiPass(const std::string &address, size_t max_conns)
+{
+	this->_fastcgi_pass = address;
+	this->_fastcgi_max_conns = max_conns;
+}
+
+void Location::setCgiEnvTemplate(const std::vector<std::string> &env)
+{
+	this->_cgi_env = env;
+}
+
+void Location::setCgiMaxConcurrent(size_t max)
+{
+	this->_cgi_max_concurrent = max;
+}
+
+void Location::setCgiQueue(size_t size, time_t timeout)
+{
+	this->_cgi_queue_size = size;
+	this->_cgi_queue_timeout = timeout;
+}
+
+//pre-serialised 503 sent when the CGI admission queue is full or a wait times out
+void Location::setBusyResponse(const std::string &response)
+{
+	this->_busy_response = response;
+}
+
+void Location::setCacheValid(short code, time_t ttl)
+{
+	this->_cache_valid[code] = ttl;
+}
+
+void Location::setMetrics(bool metrics)
+{
+	this->_metrics = metrics;
+}
+
 void Location::setMethodsFlag(bool flag)
 {
 	this->methods_flag = flag;
@@ -179,6 +247,27 @@ const std::string &Location::getReturn() const
 	return (this->_return);
 }
 
+const std::string &Location::getReturnResponse() const
+{
+	return (this->_return_response);
+}
+
+//_return is stored as "301/tours", "404" for a code alone, or just "/tours" when no code was given
+short Location::getReturnCode() const
+{
+	if (this->_return.length() >= 3 && std::isdigit(this->_return[0]))
+		return (WebServer::Utils::ft_stoi(this->_return.substr(0, 3)));
+	return (302);
+}
+
+//empty for a code alone
+std::string Location::getReturnUrl() const
+{
+	if (this->_return.length() >= 3 && std::isdigit(this->_return[0]))
+		return (this->_return.substr(3));
+	return (this->_return);
+}
+
 const std::string &Location::getAlias() const
 {
 	return (this->_alias);
@@ -199,6 +288,56 @@ const unsigned long &Location::getMaxBodySize() const
 	return (this->_client_max_body_size);
 }
 
+const CgiPoolConfig &Location::getCgiPool() const
+{
+	return (this->_cgi_pool);
+}
+
+const std::string &Location::getFastCgiPass() const
+{
+	return (this->_fastcgi_pass);
+}
+
+size_t Location::getFastCgiMaxConns() const
+{
+	return (this->_fastcgi_max_conns);
+}
+
+const std::vector<std::string> &Location::getCgiEnvTemplate() const
+{
+	return (this->_cgi_env);
+}
+
+size_t Location::getCgiMaxConcurrent() const
+{
+	return (this->_cgi_max_concurrent);
+}
+
+size_t Location::getCgiQueueSize() const
+{
+	return (this->_cgi_queue_size);
+}
+
+time_t Location::getCgiQueueTimeout() const
+{
+	return (this->_cgi_queue_timeout);
+}
+
+const std::string &Location::getBusyResponse() const
+{
+	return (this->_busy_response);
+}
+
+const std::map<short, time_t> &Location::getCacheValid() const
+{
+	return (this->_cache_valid);
+}
+
+bool Location::getMetrics() const
+{
+	return (this->_metrics);
+}
+
 const bool &Location::getMethodsFlag() const
 {
 	return (this->methods_flag);
@@ -255,6 +394,18 @@ void Location::printLocationDetails() const
 	}
 	std::cout << std::endl;
 
+	if (_cgi_pool.workers > 0)
+		std::cout << "CGI Pool: " << _cgi_pool.workers << " max=" << _cgi_pool.max_workers
+			<< " requests=" << _cgi_pool.max_requests << " idle=" << _cgi_pool.idle_timeout << std::endl;
+	if (_cgi_max_concurrent > 0)
+		std::cout << "CGI Max Concurrent: " << _cgi_max_concurrent << " queue=" << _cgi_queue_size
+			<< " timeout=" << _cgi_queue_timeout << std::endl;
+	for (std::map<short, time_t>::const_iterator it = _cache_valid.begin(); it != _cache_valid.end(); ++it)
+		std::cout << "Cache Valid: " << it->first << " " << it->second << "s" << std::endl;
+	if (_metrics)
+		std::cout << "Metrics: on" << std::endl;
+	if (!_fastcgi_pass.empty())
+		std::cout << "FastCGI Pass: " << _fastcgi_pass << " max=" << _fastcgi_max_conns << std::endl;
 	std::cout << "Client Max Body Size: " << _client_max_body_size << std::endl;
 	std::cout << "Methods Flag: " << methods_flag << std::endl;
 	std::cout << "Autoindex Flag: " << autoindex_flag << std::endl;
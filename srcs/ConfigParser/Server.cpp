@@ -2,6 +2,7 @@
 #include "../includes/Utils/Utils.hpp"
 #include "../includes/ConfigParser/Location.hpp"
 #include "../includes/Logger/Logger.hpp"
+#include <sys/un.h>
 
 Server::Server()
 {
@@ -14,6 +15,9 @@ Server::Server()
 	this->location_flag = false;
 	this->autoindex_flag = false;
 	this->maxsize_flag = false;
+	this->_access_log.format = ACCESS_LOG_COMBINED;
+	this->_access_log.buffer_size = ACCESS_LOG_BUFFER;
+	this->_access_log.flush_interval = ACCESS_LOG_FLUSH;
 }
 
 Server::~Server(){}
@@ -33,6 +37,7 @@ Server &Server::operator=(const Server &src)
 		this->_autoindex = src._autoindex;
 		this->_client_max_body_size = src._client_max_body_size;
 		this->_error_pages_map = src._error_pages_map;
+		this->_error_responses = src._error_responses;
 		this->_locations = src._locations;
 		this->_server_address = src._server_address;
 		this->location_flag = src.location_flag;
@@ -40,6 +45,7 @@ Server &Server::operator=(const Server &src)
 		this->maxsize_flag = src.maxsize_flag;
 		this->_listen_fds = src._listen_fds;
 		this->_host_port_pairs = src._host_port_pairs;
+		this->_access_log = src._access_log;
 	}
 	return (*this);
 }
@@ -150,6 +156,12 @@ void Server::setErrorPages(const std::vector<std::string> &parameters)
 	}
 }
 
+//store the pre-serialised response for an error code
+void Server::setErrorResponse(short code, const std::string &response)
+{
+	this->_error_responses[code] = response;
+}
+
 void Server::parseLocationBlocks(std::string path, std::vector<std::string> parameters)
 {
 	Location new_location;
@@ -164,6 +176,12 @@ void Server::parseLocationBlocks(std::string path, std::vector<std::string> para
 	handlers["alias"] = &Server::handleAlias;
 	handlers["cgi_ext"] = &Server::handleCgiExt;
 	handlers["cgi_path"] = &Server::handleCgiPath;
+	handlers["cgi_pool"] = &Server::handleCgiPool;
+	handlers["fastcgi_pass"] = &Server::handleFastCgiPass;
+	handlers["cgi_max_concurrent"] = &Server::handleCgiMaxConcurrent;
+	handlers["cgi_queue"] = &Server::handleCgiQueue;
+	handlers["cache_valid"] = &Server::handleCacheValid;
+	handlers["metrics"] = &Server::handleMetrics;
 	handlers["client_max_body_size"] = &Server::handleClientMaxBodySize;
 	
 	new_location.setPath(path);
@@ -303,6 +321,16 @@ const std::vector< std::pair<std::string, uint16_t> > &Server::getHostPortPairs(
 	return (this->_host_port_pairs);
 }
 
+void Server::setAccessLog(const AccessLogConfig &config)
+{
+	this->_access_log = config;
+}
+
+const AccessLogConfig &Server::getAccessLog() const
+{
+	return (this->_access_log);
+}
+
 const struct sockaddr_in &Server::getServerAddress() const
 {
 	return (this->_server_address);
@@ -317,6 +345,38 @@ const std::string &Server::getErrorPagePath(short key)
 	return (it->second);
 }
 
+// pre-serialised error response for status code, NULL if none was rendered
+const std::string *Server::getErrorResponse(short key) const
+{
+	std::map<short, std::string>::const_iterator it = this->_error_responses.find(key);
+	if (it == this->_error_responses.end())
+		return (NULL);
+	return (&it->second);
+}
+
+// find the Location with the longest path prefixing uri, NULL if none matches
+const Location *Server::matchLocation(const std::string &uri) const
+{
+	const Location	*best = NULL;
+	size_t			best_len = 0;
+
+	for (size_t i = 0; i < this->_locations.size(); ++i)
+	{
+		const std::string &path = this->_locations[i].getPath();
+		if (uri.compare(0, path.length(), path) != 0)
+			continue ;
+		//prefix must end on a segment boundary: "/red" matches "/red/x" but not "/redx"
+		if (path != "/" && uri.length() > path.length() && uri[path.length()] != '/')
+			continue ;
+		if (best == NULL || path.length() > best_len)
+		{
+			best = &this->_locations[i];
+			best_len = path.length();
+		}
+	}
+	return (best);
+}
+
 // find Location by its path
 const std::vector<Location>::iterator Server::getLocation(std::string key)
 {
@@ -381,6 +441,9 @@ void Server::checkLocation(Location &location) const
 		// check if the number of Cgi paths matches with number of extensions
 		if (location.getCgiPath().size() != location.getCgiExtension().size())
 			throw ErrorException("Failed CGI validation");
+		//without a limit no request ever waits: the queue would be ignored
+		if (location.getCgiQueueTimeout() != 0 && location.getCgiMaxConcurrent() == 0)
+			throw ErrorException("cgi_queue requires cgi_max_concurrent");
 		std::vector<std::string>::const_iterator it;
 		for (it = location.getCgiPath().begin(); it != location.getCgiPath().end(); ++it)
 		{
@@ -414,7 +477,8 @@ void Server::checkLocation(Location &location) const
 	{
 		if (!checkLocationPath(location.getPath()))
 			throw ErrorException("Invalid path for location" + location.getPath());
-		if (location.getReturn().empty() && !WebServer::Utils::checkFileIsReadable(location.getRoot() + location.getPath() + "/", location.getIndex()))
+		if (location.getReturn().empty() && location.getFastCgiPass().empty() && !location.getMetrics()
+			&& !WebServer::Utils::checkFileIsReadable(location.getRoot() + location.getPath() + "/", location.getIndex()))
 		{
 			throw ErrorException("Invalid Index for location" + location.getPath());
 		}
@@ -555,6 +619,17 @@ void Server::handleReturn(size_t &i, Location& new_location, std::vector<std::st
 	if (parameters[i].find(';') != std::string::npos)
 	{
 		WebServer::Utils::checkFinalToken(parameters[i]);
+		//a code alone ("return 404;") answers with that status and no Location
+		if (std::isdigit(parameters[i][0]))
+		{
+			if (parameters[i].length() != 3
+				|| parameters[i].find_first_not_of("0123456789") != std::string::npos)
+				throw ErrorException("Invalid info for return");
+			size_t len;
+			int statusCode = WebServer::Utils::ft_stoi(parameters[i]);
+			if (statusCode < 200 || WebServer::Utils::statusLine(statusCode, len) == NULL)
+				throw ErrorException("Invalid info for return");
+		}
 		new_location.setReturn(parameters[i]);
 	}
 	else
@@ -633,6 +708,191 @@ void Server::handleCgiPath(size_t &i, Location& new_location, std::vector<std::s
 	new_location.setCgiPath(path);
 }
 
+/**
+ * cgi_pool <workers> [max=<n>] [requests=<n>] [idle=<seconds>];
+ * Keeps workers interpreter processes warm for the location's scripts. The pool
+ * grows up to max under load, recycles a worker after requests requests and
+ * retires extra workers idle for longer than idle seconds.
+ */
+void Server::handleCgiPool(size_t &i, Location& new_location, std::vector<std::string> &parameters)
+{
+	if (new_location.getPath() != "/cgi-bin")
+		throw ErrorException("parameters cgi_pool only allowed for /cgi-bin");
+	if (new_location.getCgiPool().workers != 0)
+		throw ErrorException("cgi_pool of location is duplicated");
+	CgiPoolConfig pool;
+	bool last = false;
+	pool.max_requests = 1000;
+	pool.idle_timeout = 60;
+	i++;
+	last = (parameters[i].find(";") != std::string::npos);
+	if (last)
+		WebServer::Utils::checkFinalToken(parameters[i]);
+	pool.workers = WebServer::Utils::ft_stoi(parameters[i]);
+	pool.max_workers = pool.workers;
+	while (!last)
+	{
+		if (++i >= parameters.size())
+			throw ErrorException("Token is invalid");
+		last = (parameters[i].find(";") != std::string::npos);
+		if (last)
+			WebServer::Utils::checkFinalToken(parameters[i]);
+		size_t eq = parameters[i].find('=');
+		if (eq == std::string::npos)
+			throw ErrorException("Invalid cgi_pool option: " + parameters[i]);
+		std::string key = parameters[i].substr(0, eq);
+		int value = WebServer::Utils::ft_stoi(parameters[i].substr(eq + 1));
+		if (key == "max")
+			pool.max_workers = value;
+		else if (key == "requests")
+			pool.max_requests = value;
+		else if (key == "idle")
+			pool.idle_timeout = value;
+		else
+			throw ErrorException("Invalid cgi_pool option: " + parameters[i]);
+	}
+	if (pool.workers == 0 || pool.max_workers < pool.workers || pool.max_requests == 0)
+		throw ErrorException("Invalid values for cgi_pool");
+	new_location.setCgiPool(pool);
+}
+
+/**
+ * fastcgi_pass unix:<path> | <ip>:<port> [max=<n>];
+ * Sends the location's requests to a FastCGI application server over at most
+ * max persistent connections (8 by default).
+ */
+void Server::handleFastCgiPass(size_t &i, Location& new_location, std::vector<std::string> &parameters)
+{
+	if (!new_location.getFastCgiPass().empty())
+		throw ErrorException("fastcgi_pass of location is duplicated");
+	size_t max_conns = 8;
+	std::string address = parameters[++i];
+	if (address.find(";") == std::string::npos)
+	{
+		if (i + 1 >= parameters.size() || parameters[i + 1].compare(0, 4, "max=") != 0)
+			throw ErrorException("Invalid fastcgi_pass option");
+		i++;
+		WebServer::Utils::checkFinalToken(parameters[i]);
+		max_conns = WebServer::Utils::ft_stoi(parameters[i].substr(4));
+	}
+	else
+		WebServer::Utils::checkFinalToken(address);
+	if (address.compare(0, 5, "unix:") == 0)
+	{
+		if (address.size() == 5 || address.size() - 5 >= sizeof(((struct sockaddr_un *)0)->sun_path))
+			throw ErrorException("Invalid fastcgi_pass socket path: " + address);
+	}
+	else
+	{
+		size_t colon = address.find(':');
+		if (colon == std::string::npos || colon + 1 == address.size() || !WebServer::Utils::isValidIP(address.substr(0, colon))
+			|| WebServer::Utils::ft_stoi(address.substr(colon + 1)) > 65535)
+			throw ErrorException("Invalid fastcgi_pass address: " + address);
+	}
+	if (max_conns == 0)
+		throw ErrorException("Invalid values for fastcgi_pass");
+	new_location.setFastCgiPass(address, max_conns);
+}
+
+//cgi_max_concurrent <n>; scripts allowed to run at once for the location
+void Server::handleCgiMaxConcurrent(size_t &i, Location& new_location, std::vector<std::string> &parameters)
+{
+	if (new_location.getPath() != "/cgi-bin")
+		throw ErrorException("parameters cgi_max_concurrent only allowed for /cgi-bin");
+	if (new_location.getCgiMaxConcurrent() != 0)
+		throw ErrorException("cgi_max_concurrent of location is duplicated");
+	i++;
+	WebServer::Utils::checkFinalToken(parameters[i]);
+	size_t max = WebServer::Utils::ft_stoi(parameters[i]);
+	if (max == 0)
+		throw ErrorException("Invalid value for cgi_max_concurrent");
+	new_location.setCgiMaxConcurrent(max);
+}
+
+/**
+ * cgi_queue <n> [timeout=<seconds>];
+ * Requests over cgi_max_concurrent wait in a FIFO of at most n entries, for at
+ * most timeout seconds (5 by default), before being answered with 503.
+ */
+void Server::handleCgiQueue(size_t &i, Location& new_location, std::vector<std::string> &parameters)
+{
+	if (new_location.getPath() != "/cgi-bin")
+		throw ErrorException("parameters cgi_queue only allowed for /cgi-bin");
+	if (new_location.getCgiQueueTimeout() != 0)
+		throw ErrorException("cgi_queue of location is duplicated");
+	time_t timeout = 5;
+	std::string size = parameters[++i];
+	if (size.find(";") == std::string::npos)
+	{
+		if (i + 1 >= parameters.size() || parameters[i + 1].compare(0, 8, "timeout=") != 0)
+			throw ErrorException("Invalid cgi_queue option");
+		i++;
+		WebServer::Utils::checkFinalToken(parameters[i]);
+		timeout = WebServer::Utils::ft_stoi(parameters[i].substr(8));
+	}
+	else
+		WebServer::Utils::checkFinalToken(size);
+	if (timeout == 0)
+		throw ErrorException("Invalid values for cgi_queue");
+	new_location.setCgiQueue(WebServer::Utils::ft_stoi(size), timeout);
+}
+
+/**
+ * cache_valid <code> [<code> ...] <time>;
+ * Keeps GET responses from the location's scripts with one of these statuses in
+ * the microcache for time (seconds, or with an s, m or h suffix). May be repeated
+ * with different times for different statuses.
+ */
+void Server::handleCacheValid(size_t &i, Location& new_location, std::vector<std::string> &parameters)
+{
+	std::vector<short> codes;
+
+	while (parameters[++i].find(";") == std::string::npos)
+	{
+		if (i + 1 >= parameters.size())
+			throw ErrorException("Invalid cache_valid option");
+		short code = WebServer::Utils::ft_stoi(parameters[i]);
+		if (code < 200 || code > 599)
+			throw ErrorException("Invalid status for cache_valid: " + parameters[i]);
+		codes.push_back(code);
+	}
+	if (codes.empty())
+		throw ErrorException("Missing status for cache_valid");
+	WebServer::Utils::checkFinalToken(parameters[i]);
+	std::string value = parameters[i];
+	time_t unit = 1;
+	if (!value.empty() && std::string("smh").find(value[value.size() - 1]) != std::string::npos)
+	{
+		unit = (value[value.size() - 1] == 'h') ? 3600 : (value[value.size() - 1] == 'm') ? 60 : 1;
+		value.erase(value.size() - 1);
+	}
+	if (value.empty())
+		throw ErrorException("Invalid time for cache_valid");
+	time_t ttl = WebServer::Utils::ft_stoi(value) * unit;
+	if (ttl == 0)
+		throw ErrorException("Invalid time for cache_valid");
+	for (size_t j = 0; j < codes.size(); ++j)
+	{
+		if (new_location.getCacheValid().count(codes[j]))
+			throw ErrorException("cache_valid of location is duplicated");
+		new_location.setCacheValid(codes[j], ttl);
+	}
+}
+
+/**
+ * metrics on|off;
+ * The location answers every request with the counters and latency histograms
+ * of the whole server, as text or, when asked for, in Prometheus format.
+ */
+void Server::handleMetrics(size_t &i, Location& new_location, std::vector<std::string> &parameters)
+{
+	i++;
+	WebServer::Utils::checkFinalToken(parameters[i]);
+	if (parameters[i] != "on" && parameters[i] != "off")
+		throw ErrorException("Invalid value for metrics: " + parameters[i]);
+	new_location.setMetrics(parameters[i] == "on");
+}
+
 void Server::handleClientMaxBodySize(size_t &i, Location& new_location, std::vector<std::string> &parameters)
 {
 	if (new_location.getMaxSizeFlag()) //check if max body size already set
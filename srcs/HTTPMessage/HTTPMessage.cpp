@@ -33,6 +33,7 @@ HTTPMessage::HTTPMessage(const HTTPMessage& src) { *this = src; }
 HTTPMessage& HTTPMessage::operator=(const HTTPMessage& src)
 {
 	if (this != &src) {
+		this->_start_line = src._start_line;
 		this->_headers = src._headers;
 		this->_body = src._body;
 	}
@@ -60,6 +61,28 @@ void HTTPMessage::setBody(string body)
 	this->_body = body;
 }
 
+/**
+ * Appends to the body of the HTTP message, as its bytes arrive.
+ *
+ * @param data The bytes to append.
+ * @param len The number of bytes.
+ */
+void HTTPMessage::appendBody(const char *data, size_t len)
+{
+	this->_body.append(data, len);
+}
+
+/**
+ * Empties the HTTP message and frees its memory: assigning an empty message
+ * would keep the capacity of a large body.
+ */
+void HTTPMessage::clear()
+{
+	string().swap(this->_start_line);
+	this->_headers.clear();
+	string().swap(this->_body);
+}
+
 /**
  * Retrieves the value of a header field by name.
  *
@@ -84,7 +107,7 @@ string HTTPMessage::getFieldName(const string& name) const
  *
  * @returns A vector of KeyValue objects representing the headers.
  */
-const std::map<string, string> HTTPMessage::getHeaders() const
+const std::map<string, string> &HTTPMessage::getHeaders() const
 {
 	return this->_headers;
 }
@@ -94,7 +117,7 @@ const std::map<string, string> HTTPMessage::getHeaders() const
  *
  * @returns The body content as a string.
  */
-string HTTPMessage::getBody() const
+const string &HTTPMessage::getBody() const
 {
 	return this->_body;
 }
@@ -1,4 +1,5 @@
 # include "../../../includes/HTTPMessage/HTTPRequest/HTTPRequest.hpp"
+# include <algorithm>
 
 /**
  * @brief Default constructor for HTTPRequest.
@@ -30,6 +31,7 @@ HTTPRequest::HTTPRequest(const HTTPRequest& src): HTTPMessage() { *this = src; }
 HTTPRequest& HTTPRequest::operator=(const HTTPRequest& src)
 {
 	if (this != &src) {
+		HTTPMessage::operator=(src);
 		this->_method = src._method;
         this->_request_target = src._request_target;
         this->_http_version = src._http_version;
@@ -47,142 +49,162 @@ HTTPRequest& HTTPRequest::operator=(const HTTPRequest& src)
  */
 HTTPRequest::HTTPRequest(const string& message)
 {
-	this->_parseMessage(message);
+	this->parse(message.data(), message.size());
+}
+
+/**
+ * @brief Parses a raw HTTP message into this (freshly constructed) request.
+ *
+ * The message is read where it lies, typically at the front of a connection's
+ * receive buffer: only the parsed fields are copied out of it.
+ *
+ * @param message The first byte of the raw HTTP request message.
+ * @param length The length of the message.
+ * @throws std::exception As _parseMessage() does.
+ */
+void HTTPRequest::parse(const char *message, size_t length)
+{
+	this->_parseMessage(message, length);
 	this->checker();
 }
 
 
+/**
+ * @brief Empties the request for the next one, freeing its memory.
+ */
+void HTTPRequest::clear()
+{
+	HTTPMessage::clear();
+	string().swap(this->_method);
+	string().swap(this->_request_target);
+	string().swap(this->_http_version);
+}
+
 // Private Parsers
 /**
- * @brief Parses the raw HTTP message string into components.
+ * @brief Finds the first CRLF (or any other sequence) in [begin, end).
+ *
+ * @return const char* The start of the sequence, or end if it does not occur.
+ */
+static const char	*findSequence(const char *begin, const char *end, const char *seq)
+{
+	const void *found = memmem(begin, end - begin, seq, strlen(seq));
+
+	return (found ? static_cast<const char *>(found) : end);
+}
+
+/**
+ * @brief Parses the raw HTTP message into components.
  *
  * Splits the message into the start-line, headers, and body. Validates the structure
  * of each component and ensures compliance with HTTP grammar.
  *
- * @param message The raw HTTP message as a string.
+ * @param message The raw HTTP message.
+ * @param length The length of the message.
  * @throws std::runtime_error If critical components like the start-line or headers are missing.
- * @throws std::out_of_range If the header length exceeds the message size.
  */
-void HTTPRequest::_parseMessage(const std::string& message) {
+void HTTPRequest::_parseMessage(const char *message, size_t length) {
+    const char *end = message + length;
+
     // Check if the message contains a CRLF to separate the start line from headers
-    size_t startLineEnd = message.find(CRLF);
-    if (startLineEnd == std::string::npos) {
+    const char *startLineEnd = findSequence(message, end, CRLF);
+    if (startLineEnd == end) {
         throw HTTPRequest::HeadersDoNotExist();
     }
 
     // Parse the start line (e.g., request/response line)
-    this->_parseStartline(message.substr(0, startLineEnd));
+    this->_parseStartline(message, startLineEnd);
 
     // Find the position of the field line separator (empty line between headers and body)
-    size_t fieldLinePos = message.find(FIELD_LINE_SEPARATOR, startLineEnd + string(CRLF).size());
-    if (fieldLinePos == std::string::npos) {
+    // (searched from the end of the start line so a request without any header is found too)
+    const char *fieldLinePos = findSequence(startLineEnd, end, FIELD_LINE_SEPARATOR);
+    if (fieldLinePos == end) {
         throw std::runtime_error("FIELD_LINE_SEPARATOR not found after headers");
     }
 
-    // Calculate the length of the headers section
-    size_t headersStart = startLineEnd + string(CRLF).size();
-    size_t headerLength = fieldLinePos - headersStart;
-
-    // Ensure header length is within bounds
-    if (headersStart + headerLength > message.size()) {
-        throw std::out_of_range("Header length exceeds message size");
-    }
-
     // Parse headers
-    this->_parseHeaders(message.substr(headersStart, headerLength));
-
-    // Calculate the position where the body starts
-    size_t bodyStart = fieldLinePos + string(FIELD_LINE_SEPARATOR).size();
+    if (fieldLinePos > startLineEnd)
+        this->_parseHeaders(startLineEnd + strlen(CRLF), fieldLinePos);
 
     // Parse the body if it exists
-    if (bodyStart < message.size()) {
-        this->_parseBody(message.substr(bodyStart));
+    const char *bodyStart = fieldLinePos + strlen(FIELD_LINE_SEPARATOR);
+    if (bodyStart < end) {
+        this->_parseBody(bodyStart, end);
     }
 
-    // Split the start line into components
-    std::vector<string> split_string = WebServer::Utils::splitString(this->_start_line);
-    if (split_string.size() != 3)
+    // Split the start line into method, request target and HTTP version,
+    // separated by exactly one space each
+    size_t first = this->_start_line.find(' ');
+    size_t second = (first == string::npos) ? string::npos : this->_start_line.find(' ', first + 1);
+    if (second == string::npos || this->_start_line.find(' ', second + 1) != string::npos)
         throw RequestLineError();
-
-    // Set method, request target, and HTTP version
-    this->_setMethod(split_string[0]);
-    this->_setRequestTarget(split_string[1]);
-    this->_setHttpVersion(split_string[2]);
-
-    // Clear the split string vector
-    split_string.clear();
+    this->_method.assign(this->_start_line, 0, first);
+    this->_request_target.assign(this->_start_line, first + 1, second - first - 1);
+    this->_http_version.assign(this->_start_line, second + 1, string::npos);
 }
 
 /**
  * @brief Parses the start-line of the HTTP request.
  *
- * Extracts and validates the HTTP method, request target, and HTTP version
- * from the start-line. Ensures compliance with HTTP/1.1 specifications.
+ * Keeps the start-line (e.g., "GET /index.html HTTP/1.1"), _parseMessage()
+ * splits it once the rest of the message is parsed.
  *
- * @param start_line The start-line string (e.g., "GET /index.html HTTP/1.1").
- * @throws std::runtime_error If the start-line format is invalid or contains unsupported components.
+ * @param begin The first byte of the start-line.
+ * @param end The CRLF ending it.
  */
-void HTTPRequest::_parseStartline(const string& start_line)
+void HTTPRequest::_parseStartline(const char *begin, const char *end)
 {
-	this->_start_line = start_line;
+	this->_start_line.assign(begin, end);
 }
 
 /**
  * @brief Parses the headers section of the HTTP message.
  *
- * Splits the headers into key-value pairs and validates each pair. Skips malformed
- * or whitespace-preceded lines to prevent security vulnerabilities like request smuggling.
+ * Walks the CRLF separated lines in place, splitting each into a key-value pair.
+ * Rejects malformed or whitespace-preceded lines to prevent security
+ * vulnerabilities like request smuggling.
  *
- * @param headers The headers section as a string.
- * @throws std::runtime_error If a header line is malformed.
+ * @param begin The first byte of the first header line.
+ * @param end The CRLF ending the last header line.
+ * @throws HeadersDoNotExist If a header line is malformed.
  */
-void HTTPRequest::_parseHeaders(const string& headers)
+void HTTPRequest::_parseHeaders(const char *begin, const char *end)
 {
-	std::vector<string> key_value;
-	std::vector<string> tmp = WebServer::Utils::splitString(headers, CRLF);
-	for (size_t i = 0; i < tmp.size(); i++)
+	const char *line = begin;
+
+	while (true)
 	{
-		key_value = WebServer::Utils::splitString(tmp[i], ": ");
-		this->_headers[key_value[0]] = key_value[1];
+		const char *line_end = findSequence(line, end, CRLF);
+		const char *colon = std::find(line, line_end, ':');
+		// a field line without a name or starting with whitespace is rejected
+		if (colon == line_end || colon == line || isspace(*line))
+			throw HeadersDoNotExist();
+		const char *value = colon + 1;
+		while (value < line_end && (*value == ' ' || *value == '\t'))
+			++value;
+		const char *value_end = line_end;
+		while (value_end > value && (value_end[-1] == ' ' || value_end[-1] == '\t'))
+			--value_end;
+		this->_headers[string(line, colon)].assign(value, value_end);
+		if (line_end == end)
+			break ;
+		line = line_end + strlen(CRLF);
 	}
 }
 
 /**
  * @brief Parses the body of the HTTP message.
  *
- * Validates the body length against the `Content-Length` header. If the body length
- * does not match the declared length, an error is thrown.
+ * Keeps whatever followed the header block in the message.
  *
- * @param body The body content as a string.
- * @throws std::runtime_error If the body length does not match the expected length.
+ * @param begin The first byte of the body.
+ * @param end The end of the message.
  */
-
-void HTTPRequest::_parseBody(const string& body)
+void HTTPRequest::_parseBody(const char *begin, const char *end)
 {
-	this->_body = body;
+	this->_body.assign(begin, end);
 }
 
-/**
- * @brief Sets the HTTP method of the request.
- *
- * @param method The HTTP method (e.g., GET, POST).
- */
-void HTTPRequest::_setMethod(const string& method) { this->_method = method; }
-
-/**
- * @brief Sets the request target of the HTTP request.
- *
- * @param request_target The target resource of the HTTP request (e.g., "/index.html").
- */
-void HTTPRequest::_setRequestTarget(const string& request_target) { this->_request_target = request_target; }
-
-/**
- * @brief Sets the HTTP version of the request.
- *
- * @param http_version The HTTP version (e.g., "HTTP/1.1").
- */
-void HTTPRequest::_setHttpVersion(const string& http_version) { this->_http_version = http_version; }
-
 // Getters
 
 /**
@@ -190,21 +212,21 @@ void HTTPRequest::_setHttpVersion(const string& http_version) { this->_http_vers
  *
  * @return string The HTTP method (e.g., GET, POST).
  */
-string HTTPRequest::getRequestMethod() const { return this->_method; }
+const string &HTTPRequest::getRequestMethod() const { return this->_method; }
 
 /**
  * @brief Retrieves the request target of the HTTP request.
  *
  * @return string The target resource (e.g., "/index.html").
  */
-string HTTPRequest::getRequestTarget() const { return this->_request_target; }
+const string &HTTPRequest::getRequestTarget() const { return this->_request_target; }
 
 /**
  * @brief Retrieves the HTTP version of the request.
  *
  * @return string The HTTP version (e.g., "HTTP/1.1").
  */
-string HTTPRequest::getHttpVersion() const { return this->_http_version; }
+const string &HTTPRequest::getHttpVersion() const { return this->_http_version; }
 
 /**
  * @brief Abstract method for additional validation or checks.
@@ -213,5 +235,6 @@ string HTTPRequest::getHttpVersion() const { return this->_http_version; }
  */
 void HTTPRequest::checker()
 {
-	std::map<string, string> headers = this->getHeaders();
+	const std::map<string, string> &headers = this->getHeaders();
+	(void)headers;
 }
@@ -14,6 +14,12 @@
 
 HTTPResponse::HTTPResponse()
 {
+	setStatusCode(200);
+}
+
+HTTPResponse::HTTPResponse(short status_code)
+{
+	setStatusCode(status_code);
 }
 
 HTTPResponse::HTTPResponse(HTTPResponse &copy): HTTPMessage()
@@ -28,5 +34,49 @@ HTTPResponse::~HTTPResponse()
 HTTPResponse	&HTTPResponse::operator=(HTTPResponse &copy)
 {
 	HTTPMessage::operator=(copy);
+	this->_status_code = copy._status_code;
 	return *this;
 }
+
+// Sets the status code and takes the matching status line from the pre-rendered table
+void	HTTPResponse::setStatusCode(short status_code)
+{
+	size_t				len;
+	const char			*line = WebServer::Utils::statusLine(status_code, len);
+
+	this->_status_code = status_code;
+	if (line != NULL)
+	{
+		this->_start_line.assign(line, len - 2);
+		return ;
+	}
+	std::stringstream	ss;
+	ss << "HTTP/1.1 " << status_code << " Undefined";
+	this->_start_line = ss.str();
+}
+
+short	HTTPResponse::getStatusCode() const
+{
+	return (this->_status_code);
+}
+
+// Renders the complete response: status line, headers, blank line and body
+string	HTTPResponse::serialise() const
+{
+	return (this->_start_line + CRLF + this->getMessage());
+}
+
+// Minimal html body used when no error_page is configured for a status code
+string	HTTPResponse::defaultErrorBody(short status_code)
+{
+	std::stringstream	ss;
+
+	ss << status_code << " " << WebServer::Utils::statusCodeString(status_code);
+	return ("<html><head><title>" + ss.str() + "</title></head><body><center><h1>"
+		+ ss.str() + "</h1></center><hr><center>webserv</center></body></html>");
+}
+
+// A response is built by the server from a known status code: nothing to validate
+void	HTTPResponse::checker()
+{
+}
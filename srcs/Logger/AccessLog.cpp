@@ -0,0 +1,229 @@
+#include "../../includes/Logger/AccessLog.hpp"
+#include "../../includes/Client/Client.hpp"
+#include "../../includes/Utils/Clock.hpp"
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stdio.h>
+#include <arpa/inet.h>
+
+volatile sig_atomic_t AccessLog::_reopen = 0;
+std::vector<AccessLog *> AccessLog::_open_logs;
+
+AccessLog::AccessLog(): _fd(-1), _last_flush(0)
+{
+	this->_config.format = ACCESS_LOG_COMBINED;
+	this->_config.buffer_size = ACCESS_LOG_BUFFER;
+	this->_config.flush_interval = ACCESS_LOG_FLUSH;
+}
+
+AccessLog::AccessLog(const AccessLogConfig &config): _config(config), _fd(-1), _last_flush(0) {}
+
+AccessLog::AccessLog(const AccessLog &other)
+{
+	*this = other;
+}
+
+AccessLog &AccessLog::operator=(const AccessLog &other)
+{
+	if (this != &other)
+	{
+		this->_config = other._config;
+		this->_fd = other._fd;
+		this->_buffer = other._buffer;
+		this->_last_flush = other._last_flush;
+	}
+	return (*this);
+}
+
+//the file is owned by the Router's entry and closed explicitly, never on copy
+AccessLog::~AccessLog(){}
+
+bool AccessLog::open()
+{
+	this->_fd = ::open(this->_config.path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+	this->_buffer.reserve(this->_config.buffer_size);
+	this->_last_flush = WebServer::Clock::now();
+	if (this->_fd < 0)
+		return (false);
+	_open_logs.push_back(this);
+	return (true);
+}
+
+void AccessLog::close()
+{
+	flush();
+	if (this->_fd >= 0)
+		::close(this->_fd);
+	this->_fd = -1;
+	for (size_t i = 0; i < _open_logs.size(); ++i)
+	{
+		if (_open_logs[i] == this)
+		{
+			_open_logs.erase(_open_logs.begin() + i);
+			break ;
+		}
+	}
+}
+
+//write what is buffered to the old file, then continue in a fresh one at the same path
+bool AccessLog::reopen()
+{
+	close();
+	return (open());
+}
+
+/* values come from the client: quotes, backslashes and control bytes are escaped */
+void AccessLog::_appendEscaped(std::string &out, const std::string &value, bool json)
+{
+	char	hex[8];
+
+	for (size_t i = 0; i < value.size(); ++i)
+	{
+		unsigned char c = value[i];
+		if (c == '"' || c == '\\')
+		{
+			out += '\\';
+			out += c;
+		}
+		else if (c < 0x20 || c == 0x7f)
+		{
+			snprintf(hex, sizeof(hex), json ? "\\u%04x" : "\\x%02X", c);
+			out += hex;
+		}
+		else
+			out += c;
+	}
+}
+
+/**
+ * Appends the record of the request client just completed. Combined format:
+ *   addr - - [time] "METHOD target VERSION" status bytes "referer" "user-agent" "vhost" request_time cgi_time
+ * with times in seconds and "-" when no CGI ran. JSON carries the same fields.
+ */
+void AccessLog::log(const Client &client, const std::string &vhost)
+{
+	const HTTPRequest					&request = client.getRequest();
+	const std::map<std::string, std::string>	&headers = request.getHeaders();
+	std::map<std::string, std::string>::const_iterator	it;
+	char								addr[INET_ADDRSTRLEN];
+	char								numbers[128];
+	std::string							referer;
+	std::string							agent;
+	bool								json = (this->_config.format == ACCESS_LOG_JSON);
+
+	inet_ntop(AF_INET, &client.getAddress().sin_addr, addr, sizeof(addr));
+	if ((it = headers.find("Referer")) != headers.end())
+		referer = it->second;
+	if ((it = headers.find("User-Agent")) != headers.end())
+		agent = it->second;
+	long	now = WebServer::Clock::monotonicUsec();
+	double	request_time = client.getRequestStart() ? (now - client.getRequestStart()) / 1e6 : 0;
+	double	upstream_time = client.getUpstreamTime() / 1e6;
+	if (json)
+	{
+		this->_buffer += "{\"time\":\"" + WebServer::Clock::accessTime() + "\",\"remote_addr\":\"" + addr + "\",\"vhost\":\"";
+		_appendEscaped(this->_buffer, vhost, true);
+		this->_buffer += "\",\"method\":\"";
+		_appendEscaped(this->_buffer, request.getRequestMethod(), true);
+		this->_buffer += "\",\"target\":\"";
+		_appendEscaped(this->_buffer, request.getRequestTarget(), true);
+		this->_buffer += "\",\"protocol\":\"";
+		_appendEscaped(this->_buffer, request.getHttpVersion(), true);
+		snprintf(numbers, sizeof(numbers), "\",\"status\":%d,\"bytes_sent\":%lu,\"request_time\":%.3f,\"upstream_time\":",
+			client.getStatus(), static_cast<unsigned long>(client.getOutput().getSentBytes()), request_time);
+		this->_buffer += numbers;
+		if (client.getUpstreamTime() < 0)
+			this->_buffer += "null";
+		else
+		{
+			snprintf(numbers, sizeof(numbers), "%.3f", upstream_time);
+			this->_buffer += numbers;
+		}
+		this->_buffer += ",\"referer\":\"";
+		_appendEscaped(this->_buffer, referer, true);
+		this->_buffer += "\",\"user_agent\":\"";
+		_appendEscaped(this->_buffer, agent, true);
+		this->_buffer += "\"}\n";
+	}
+	else
+	{
+		this->_buffer += std::string(addr) + " - - [" + WebServer::Clock::accessTime() + "] \"";
+		if (request.getRequestMethod().empty())
+			this->_buffer += "-";
+		else
+		{
+			_appendEscaped(this->_buffer, request.getRequestMethod(), false);
+			this->_buffer += " ";
+			_appendEscaped(this->_buffer, request.getRequestTarget(), false);
+			this->_buffer += " ";
+			_appendEscaped(this->_buffer, request.getHttpVersion(), false);
+		}
+		snprintf(numbers, sizeof(numbers), "\" %d %lu \"", client.getStatus(),
+			static_cast<unsigned long>(client.getOutput().getSentBytes()));
+		this->_buffer += numbers;
+		_appendEscaped(this->_buffer, referer.empty() ? "-" : referer, false);
+		this->_buffer += "\" \"";
+		_appendEscaped(this->_buffer, agent.empty() ? "-" : agent, false);
+		this->_buffer += "\" \"";
+		_appendEscaped(this->_buffer, vhost, false);
+		if (client.getUpstreamTime() < 0)
+			snprintf(numbers, sizeof(numbers), "\" %.3f -\n", request_time);
+		else
+			snprintf(numbers, sizeof(numbers), "\" %.3f %.3f\n", request_time, upstream_time);
+		this->_buffer += numbers;
+	}
+	if (this->_buffer.size() >= this->_config.buffer_size)
+		flush();
+}
+
+void AccessLog::flush()
+{
+	size_t	written = 0;
+
+	while (this->_fd >= 0 && written < this->_buffer.size())
+	{
+		ssize_t n = write(this->_fd, this->_buffer.data() + written, this->_buffer.size() - written);
+		if (n < 0 && errno == EINTR)
+			continue ;
+		if (n <= 0)
+			break ;
+		written += n;
+	}
+	//a failing disk loses records rather than growing the buffer without bound
+	this->_buffer.clear();
+	this->_last_flush = WebServer::Clock::now();
+}
+
+//called from the event loop's periodic checks: write out records older than flush_interval
+void AccessLog::tick(time_t now)
+{
+	if (!this->_buffer.empty() && now - this->_last_flush >= this->_config.flush_interval)
+		flush();
+}
+
+const std::string &AccessLog::getPath() const
+{
+	return (this->_config.path);
+}
+
+void AccessLog::handleSignal(int sig)
+{
+	(void)sig;
+	_reopen = 1;
+}
+
+//true once per SIGUSR1
+bool AccessLog::reopenRequested()
+{
+	if (!_reopen)
+		return (false);
+	_reopen = 0;
+	return (true);
+}
+
+void AccessLog::flushAll()
+{
+	for (size_t i = 0; i < _open_logs.size(); ++i)
+		_open_logs[i]->flush();
+}
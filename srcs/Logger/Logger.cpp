@@ -1,10 +1,24 @@
 # include "../../includes/Logger/Logger.hpp"
+# include "../../includes/Utils/Clock.hpp"
+# include "../../includes/Utils/AllocStats.hpp"
+# include <unistd.h>
+# include <fcntl.h>
+# include <errno.h>
+# include <poll.h>
+# include <sched.h>
+# include <signal.h>
+# include <string.h>
 
 /**
  * @brief Default constructor for Logger.
  * initialises a Logger object. Private to enforce Singleton design.
  */
-WebServer::Logger::Logger() {}
+WebServer::Logger::Logger(): _slots(NULL), _enqueue_pos(0), _dequeue_pos(0), _dropped(0), _sleeping(0),
+	_running(0), _fd(STDOUT_FILENO), _color(true), _overflow(LOG_OVERFLOW_BLOCK)
+{
+	this->_wake_pipe[0] = -1;
+	this->_wake_pipe[1] = -1;
+}
 
 /**
  * @brief Destructor for Logger.
@@ -38,6 +52,7 @@ WebServer::Logger& WebServer::Logger::operator=(const Logger &other)
 
 WebServer::Logger* WebServer::Logger::instancePtr = NULL; /**< Static pointer to the Singleton instance of Logger. */
 pthread_mutex_t WebServer::Logger::mtx = PTHREAD_MUTEX_INITIALIZER; /**< Mutex to ensure thread safety during Singleton instance creation. */
+int WebServer::Logger::_level = LOG_LEVEL_INFO; /**< Runtime level until log_level says otherwise. */
 
 /**
  * @brief Retrieves the Singleton instance of the Logger class.
@@ -57,11 +72,125 @@ WebServer::Logger* WebServer::Logger::getInstance() {
 }
 
 /**
- * @brief Logs a formatted message to the console with the specified color.
+ * @brief Sets the most verbose level logged at runtime.
+ *
+ * Levels above LOG_COMPILED_LEVEL stay off whatever is set here.
+ *
+ * @param level One of the LOG_LEVEL_* values.
+ */
+void	WebServer::Logger::setLevel(int level)
+{
+	_level = level;
+}
+
+/**
+ * @brief Converts a level name from the configuration.
+ *
+ * @param name error, warn, info, debug or trace.
+ * @return int The LOG_LEVEL_* value, or -1 for an unknown name.
+ */
+int	WebServer::Logger::parseLevel(const string &name)
+{
+	const char	*names[] = {"error", "warn", "info", "debug", "trace"};
+
+	for (int i = 0; i < 5; ++i)
+	{
+		if (name == names[i])
+			return (i);
+	}
+	return (-1);
+}
+
+/**
+ * @brief Starts the writer thread.
+ *
+ * Records are written to path ("stdout" for the console), appended to if it is a
+ * file. Colors are kept only when the output is a terminal.
+ *
+ * @param path The file to log to, or "stdout".
+ * @param overflow What logMsg() does when the ring is full.
+ * @return bool false if the file or the thread could not be created; logging then
+ * stays synchronous on stdout.
+ */
+bool	WebServer::Logger::start(const string &path, LogOverflow overflow)
+{
+	int			fd = STDOUT_FILENO;
+	sigset_t	all;
+	sigset_t	previous;
+
+	if (this->_running)
+		return (true);
+	if (path != "stdout")
+		fd = open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+	if (fd < 0)
+		return (false);
+	if (pipe(this->_wake_pipe) < 0)
+	{
+		if (fd != STDOUT_FILENO)
+			close(fd);
+		return (false);
+	}
+	for (int i = 0; i < 2; ++i)
+	{
+		fcntl(this->_wake_pipe[i], F_SETFL, O_NONBLOCK);
+		fcntl(this->_wake_pipe[i], F_SETFD, FD_CLOEXEC);
+	}
+	if (this->_slots == NULL)
+		this->_slots = new LogSlot[LOG_RING_SLOTS];
+	for (size_t i = 0; i < LOG_RING_SLOTS; ++i)
+		this->_slots[i].sequence = i;
+	this->_enqueue_pos = 0;
+	this->_dequeue_pos = 0;
+	this->_fd = fd;
+	this->_color = isatty(fd);
+	this->_overflow = overflow;
+	__atomic_store_n(&this->_running, 1, __ATOMIC_SEQ_CST);
+	//signals stay with the main thread: the writer starts with all of them blocked
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &previous);
+	int err = pthread_create(&this->_thread, NULL, &WebServer::Logger::_writerLoop, this);
+	pthread_sigmask(SIG_SETMASK, &previous, NULL);
+	if (err != 0)
+	{
+		__atomic_store_n(&this->_running, 0, __ATOMIC_SEQ_CST);
+		close(this->_wake_pipe[0]);
+		close(this->_wake_pipe[1]);
+		if (fd != STDOUT_FILENO)
+			close(fd);
+		this->_fd = STDOUT_FILENO;
+		return (false);
+	}
+	return (true);
+}
+
+/**
+ * @brief Stops the writer thread once it wrote every published record.
+ *
+ * Later messages are written synchronously again.
+ */
+void	WebServer::Logger::stop()
+{
+	if (!__atomic_load_n(&this->_running, __ATOMIC_SEQ_CST))
+		return ;
+	__atomic_store_n(&this->_running, 0, __ATOMIC_SEQ_CST);
+	_writeAll(this->_wake_pipe[1], "", 1);
+	pthread_join(this->_thread, NULL);
+	close(this->_wake_pipe[0]);
+	close(this->_wake_pipe[1]);
+	if (this->_fd != STDOUT_FILENO)
+		close(this->_fd);
+	this->_fd = STDOUT_FILENO;
+	this->_color = true;
+}
+
+/**
+ * @brief Logs a formatted message with the specified color.
  *
  * This method uses ANSI escape codes to print the message in the given color.
  * It supports printf-style formatting for the message. Timestamps are automatically
- * appended to each log entry.
+ * appended to each log entry. With the writer thread running, the record is
+ * formatted into the ring and written later; nothing here blocks unless the ring
+ * is full and the overflow policy is LOG_OVERFLOW_BLOCK.
  *
  * @param color The color code for the message (e.g., `RED`, `CYAN`).
  * @param msg The format string for the message.
@@ -69,52 +198,221 @@ WebServer::Logger* WebServer::Logger::getInstance() {
  */
 void	WebServer::Logger::logMsg(const char *color, const char* msg, ...)
 {
-	char		output[8192];
 	va_list		args;
-	
-	va_start(args, msg); 
-	//vsnprintf(buffer, sizeof(buffer), msg, va_list)
-	// returns the number of characters written if there were no size elimit
-	int n = vsnprintf(output, sizeof(output), msg, args);
+	size_t		pos;
+
+	va_start(args, msg);
+	if (!__atomic_load_n(&this->_running, __ATOMIC_ACQUIRE))
+	{
+		char output[LOG_RECORD_SIZE];
+		size_t len = _format(output, sizeof(output), color, msg, args);
+		va_end(args);
+		_writeAll(STDOUT_FILENO, output, len);
+		return ;
+	}
+	LogSlot *slot = _claim(pos);
+	if (slot == NULL)
+	{
+		va_end(args);
+		__atomic_add_fetch(&this->_dropped, 1, __ATOMIC_RELAXED);
+		return ;
+	}
+	slot->length = _format(slot->data, sizeof(slot->data), color, msg, args);
 	va_end(args);
-	// Check for buffer overflow
+	//publish, then wake the writer if it went to sleep on an empty ring
+	__atomic_store_n(&slot->sequence, pos + 1, __ATOMIC_SEQ_CST);
+	if (__atomic_exchange_n(&this->_sleeping, 0, __ATOMIC_SEQ_CST))
+		_wake();
+}
+
+/**
+ * @brief Renders one record: color, timestamp, message, reset and newline.
+ *
+ * A message longer than the record is cut and marked with "...".
+ *
+ * @return size_t The record's length.
+ */
+size_t	WebServer::Logger::_format(char *buffer, size_t size, const char *color, const char *msg, va_list args)
+{
+	const string	&stamp = WebServer::Clock::logTime();
+	const char		*reset = this->_color ? RESET : "";
+	size_t			tail = strlen(reset) + 1;
+	size_t			len = 0;
+
+	if (!this->_color)
+		color = "";
+	len = snprintf(buffer, size - tail, "%s%s", color, stamp.c_str());
+	int n = vsnprintf(buffer + len, size - tail - len, msg, args);
 	if (n < 0)
+		n = snprintf(buffer + len, size - tail - len, "(unformattable log message)");
+	if (static_cast<size_t>(n) >= size - tail - len)
+	{
+		len = size - tail - 1;
+		memcpy(buffer + len - 3, "...", 3);
+	}
+	else
+		len += n;
+	memcpy(buffer + len, reset, tail - 1);
+	len += tail - 1;
+	buffer[len++] = '\n';
+	return (len);
+}
+
+/**
+ * @brief Claims the next free slot of the ring.
+ *
+ * A slot is free when its sequence equals the position being claimed; producers
+ * race for the position with a compare-and-swap and the winner owns the slot until
+ * it publishes the record. A slot one lap behind means the ring is full.
+ *
+ * @return LogSlot* The claimed slot, or NULL if the ring is full and records are dropped.
+ */
+WebServer::LogSlot	*WebServer::Logger::_claim(size_t &pos)
+{
+	pos = __atomic_load_n(&this->_enqueue_pos, __ATOMIC_RELAXED);
+	while (true)
+	{
+		LogSlot	&slot = this->_slots[pos & (LOG_RING_SLOTS - 1)];
+		size_t	sequence = __atomic_load_n(&slot.sequence, __ATOMIC_ACQUIRE);
+		long	diff = static_cast<long>(sequence) - static_cast<long>(pos);
+
+		if (diff == 0)
+		{
+			if (__atomic_compare_exchange_n(&this->_enqueue_pos, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				return (&slot);
+		}
+		else if (diff < 0)
+		{
+			if (this->_overflow == LOG_OVERFLOW_DROP)
+				return (NULL);
+			_wake();
+			sched_yield();
+			pos = __atomic_load_n(&this->_enqueue_pos, __ATOMIC_RELAXED);
+		}
+		else
+			pos = __atomic_load_n(&this->_enqueue_pos, __ATOMIC_RELAXED);
+	}
+}
+
+void	WebServer::Logger::_wake()
+{
+	char	byte = 0;
+
+	if (write(this->_wake_pipe[1], &byte, 1) < 0)
+		return ;
+}
+
+/**
+ * @brief Moves the published records into batch, writing it out whenever it fills.
+ *
+ * @return bool true if at least one record was taken.
+ */
+bool	WebServer::Logger::_drain(char *batch, size_t &batch_len)
+{
+	bool	found = false;
+
+	while (true)
+	{
+		LogSlot &slot = this->_slots[this->_dequeue_pos & (LOG_RING_SLOTS - 1)];
+		if (__atomic_load_n(&slot.sequence, __ATOMIC_SEQ_CST) != this->_dequeue_pos + 1)
+			return (found);
+		if (batch_len + slot.length > LOG_BATCH_SIZE)
+		{
+			_writeAll(this->_fd, batch, batch_len);
+			batch_len = 0;
+		}
+		memcpy(batch + batch_len, slot.data, slot.length);
+		batch_len += slot.length;
+		//hand the slot back to producers for the next lap
+		__atomic_store_n(&slot.sequence, this->_dequeue_pos + LOG_RING_SLOTS, __ATOMIC_RELEASE);
+		this->_dequeue_pos++;
+		found = true;
+	}
+}
+
+/**
+ * @brief Body of the writer thread.
+ *
+ * Drains the ring and writes each batch with a single write(), reports records
+ * dropped to a full ring, and sleeps on the wake pipe when there is nothing left.
+ * Producers only touch the pipe when _sleeping is set, which the writer sets before
+ * its last look at the ring, so a record published meanwhile is never missed.
+ */
+void	*WebServer::Logger::_writerLoop(void *arg)
+{
+	Logger			*logger = static_cast<Logger *>(arg);
+	static char		batch[LOG_BATCH_SIZE];
+	size_t			batch_len = 0;
+	struct pollfd	wake;
+	char			drain[64];
+
+	WebServer::AllocStats::nameThread("logger");
+	wake.fd = logger->_wake_pipe[0];
+	wake.events = POLLIN;
+	while (true)
 	{
-		cerr << "Error: Failed to format log message." << endl;
-		return;
+		logger->_drain(batch, batch_len);
+		size_t dropped = __atomic_exchange_n(&logger->_dropped, 0, __ATOMIC_RELAXED);
+		if (dropped > 0)
+		{
+			char notice[128];
+			int n = snprintf(notice, sizeof(notice), "webserv: %lu log messages dropped, the log ring was full\n",
+				static_cast<unsigned long>(dropped));
+			if (batch_len + n > LOG_BATCH_SIZE)
+			{
+				_writeAll(logger->_fd, batch, batch_len);
+				batch_len = 0;
+			}
+			memcpy(batch + batch_len, notice, n);
+			batch_len += n;
+		}
+		if (batch_len > 0)
+		{
+			_writeAll(logger->_fd, batch, batch_len);
+			batch_len = 0;
+		}
+		if (!__atomic_load_n(&logger->_running, __ATOMIC_SEQ_CST))
+		{
+			//last records published before stop()
+			if (logger->_drain(batch, batch_len))
+				_writeAll(logger->_fd, batch, batch_len);
+			return (NULL);
+		}
+		__atomic_store_n(&logger->_sleeping, 1, __ATOMIC_SEQ_CST);
+		if (logger->_drain(batch, batch_len))
+		{
+			__atomic_store_n(&logger->_sleeping, 0, __ATOMIC_SEQ_CST);
+			continue ;
+		}
+		poll(&wake, 1, LOG_IDLE_WAIT);
+		while (read(wake.fd, drain, sizeof(drain)) > 0)
+			;
 	}
-	if (static_cast<size_t>(n) >= sizeof(output))
+}
+
+void	WebServer::Logger::_writeAll(int fd, const char *data, size_t len)
+{
+	while (len > 0)
 	{
-		cerr << "Warning: Log message truncated due to buffer size." << endl;
+		ssize_t n = write(fd, data, len);
+		if (n < 0 && errno == EINTR)
+			continue ;
+		if (n <= 0)
+			return ;
+		data += n;
+		len -= n;
 	}
-	string date = getCurrTime();
-	cout << color << date << output << RESET << endl;
 }
 
 /**
  * @brief Retrieves the current time as a formatted string.
  *
- * The timestamp includes the current date and time in GST (GMT+8). If the hour exceeds 24,
- * the date is adjusted accordingly.
+ * The timestamp includes the current date and time in GST (GMT+8). It is rendered
+ * by WebServer::Clock at most once per second rather than on every log line.
  *
  * @return string The current timestamp in a formatted string.
  */
 string WebServer::Logger::getCurrTime()
 {
-	char date[50];
-	time_t now = time(0);
-	// gmtime converts time_t value into a tm struct, and
-	// returns a pointer to this tm struct
-	// tm struct fields: tm_year, tm_month, tm_hour, etc...
-	struct tm tm = *gmtime(&now);
-	// Add global time shift(GST) and adjust date 
-	tm.tm_hour += GST;
-	if (tm.tm_hour >= 24)
-	{
-		tm.tm_hour -= 24;
-		tm.tm_mday += 1;
-	}
-	// Formats the time stored in tm struct into string
-	strftime(date, sizeof(date), "[%Y-%m-%d  %H:%M:%S]   ", &tm);
-	return (string(date));
+	return (WebServer::Clock::logTime());
 }
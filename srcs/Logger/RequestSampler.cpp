@@ -0,0 +1,105 @@
+#include "../../includes/Logger/RequestSampler.hpp"
+#include "../../includes/Logger/Logger.hpp"
+#include "../../includes/Client/Client.hpp"
+#include "../../includes/ConfigParser/Location.hpp"
+#include "../../includes/Utils/Clock.hpp"
+#include <algorithm>
+#include <stdio.h>
+
+RequestSampler::RequestSampler(): _count(0)
+{
+	this->_config.every = 0;
+	this->_config.status = 0;
+	this->_config.slow_usec = -1;
+}
+
+RequestSampler::RequestSampler(const SampleConfig &config): _config(config), _count(0) {}
+
+RequestSampler::RequestSampler(const RequestSampler &other)
+{
+	*this = other;
+}
+
+RequestSampler &RequestSampler::operator=(const RequestSampler &other)
+{
+	if (this != &other)
+	{
+		this->_config = other._config;
+		this->_count = other._count;
+	}
+	return (*this);
+}
+
+RequestSampler::~RequestSampler(){}
+
+bool RequestSampler::enabled() const
+{
+	return (this->_config.every || this->_config.status || this->_config.slow_usec >= 0
+		|| !this->_config.vhosts.empty() || !this->_config.locations.empty());
+}
+
+//why the request is dumped, NULL if it is not
+const char *RequestSampler::_reason(const Client &client, long usec, const std::string &vhost)
+{
+	if (this->_config.status && client.getStatus() >= this->_config.status)
+		return ("status");
+	if (this->_config.slow_usec >= 0 && usec > this->_config.slow_usec)
+		return ("slow");
+	if (std::find(this->_config.vhosts.begin(), this->_config.vhosts.end(), vhost) != this->_config.vhosts.end())
+		return ("vhost");
+	if (client.getLocation() && std::find(this->_config.locations.begin(), this->_config.locations.end(),
+		client.getLocation()->getPath()) != this->_config.locations.end())
+		return ("location");
+	if (this->_config.every && ++this->_count >= this->_config.every)
+	{
+		this->_count = 0;
+		return ("sampled");
+	}
+	return (NULL);
+}
+
+//bytes of the client's choosing are shown as '.' unless printable
+static std::string	printable(const std::string &value, size_t max)
+{
+	std::string out = value.substr(0, max);
+
+	for (size_t i = 0; i < out.size(); ++i)
+	{
+		if ((out[i] < 0x20 && out[i] != '\n') || out[i] == 0x7f)
+			out[i] = '.';
+	}
+	return (out);
+}
+
+/* called once the response to client's request is sent */
+void RequestSampler::sample(const Client &client, const std::string &vhost)
+{
+	if (!enabled() || !WebServer::Logger::enabled(LOG_LEVEL_INFO))
+		return ;
+	long usec = client.getRequestStart() ? WebServer::Clock::monotonicUsec() - client.getRequestStart() : 0;
+	const char *reason = _reason(client, usec, vhost);
+	if (reason == NULL)
+		return ;
+	const HTTPRequest &request = client.getRequest();
+	const std::map<std::string, std::string> &headers = request.getHeaders();
+	std::string dump = "\n";
+	char cgi_time[32] = "-";
+	char body_size[32];
+	for (std::map<std::string, std::string>::const_iterator it = headers.begin(); it != headers.end(); ++it)
+		dump += "  " + it->first + ": " + printable(it->second, std::string::npos) + "\n";
+	std::string body = request.getBody();
+	if (!body.empty())
+	{
+		snprintf(body_size, sizeof(body_size), "%lu", static_cast<unsigned long>(body.size()));
+		dump += std::string("  body (") + body_size + " bytes): " + printable(body, SAMPLE_BODY_MAX)
+			+ (body.size() > SAMPLE_BODY_MAX ? "..." : "") + "\n";
+	}
+	dump.erase(dump.size() - 1);
+	if (client.getUpstreamTime() >= 0)
+		snprintf(cgi_time, sizeof(cgi_time), "%.3f ms", client.getUpstreamTime() / 1000.0);
+	WS_INFO("Sampled request (%s) from client %d to %s: %s %s %s -> %d, %lu bytes, %.3f ms, CGI %s%s", reason,
+		client.getFd(), vhost.c_str(), printable(request.getRequestMethod(), 16).c_str(),
+		printable(request.getRequestTarget(), std::string::npos).c_str(), printable(request.getHttpVersion(), 16).c_str(),
+		client.getStatus(), static_cast<unsigned long>(client.getOutput().getSentBytes()), usec / 1000.0,
+		cgi_time, dump.c_str());
+}
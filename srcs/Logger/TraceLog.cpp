@@ -0,0 +1,198 @@
+#include "../../includes/Logger/TraceLog.hpp"
+#include "../../includes/Client/Client.hpp"
+#include "../../includes/ConfigParser/Location.hpp"
+#include "../../includes/Utils/Clock.hpp"
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stdio.h>
+#include <sys/stat.h>
+
+TraceLog *TraceLog::_active = NULL;
+
+//name of the span starting at each phase and ending at the next one reached
+static const char	*g_phase_spans[PHASE_COUNT] = {"idle", "read headers", "route", "read body", "handler",
+	"cgi", "send", NULL};
+
+TraceLog::TraceLog(): _fd(-1), _pid(getpid()), _count(0), _last_flush(0)
+{
+	this->_config.every = 0;
+	this->_config.slow_usec = -1;
+}
+
+TraceLog::TraceLog(const TraceLog &other)
+{
+	*this = other;
+}
+
+TraceLog &TraceLog::operator=(const TraceLog &other)
+{
+	if (this != &other)
+	{
+		this->_config = other._config;
+		this->_fd = other._fd;
+		this->_pid = other._pid;
+		this->_buffer = other._buffer;
+		this->_count = other._count;
+		this->_last_flush = other._last_flush;
+		this->_traced_fds = other._traced_fds;
+	}
+	return (*this);
+}
+
+//the file is closed explicitly by its owner, never on copy
+TraceLog::~TraceLog(){}
+
+bool TraceLog::open(const TraceConfig &config)
+{
+	struct stat	file_stat;
+
+	this->_config = config;
+	this->_fd = ::open(config.path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+	if (this->_fd < 0)
+		return (false);
+	if (fstat(this->_fd, &file_stat) == 0 && file_stat.st_size == 0)
+		this->_buffer = "[\n";
+	this->_buffer.reserve(TRACE_LOG_BUFFER);
+	this->_last_flush = WebServer::Clock::now();
+	_active = this;
+	return (true);
+}
+
+void TraceLog::close()
+{
+	flush();
+	if (this->_fd >= 0)
+		::close(this->_fd);
+	this->_fd = -1;
+	if (_active == this)
+		_active = NULL;
+}
+
+bool TraceLog::enabled() const
+{
+	return (this->_fd >= 0);
+}
+
+//one event on the track of connection tid; a duration below 0 makes an instant event
+void TraceLog::_event(const char *name, const char *phase, int tid, long start, long duration)
+{
+	char	event[256];
+
+	if (duration < 0)
+		snprintf(event, sizeof(event), "{\"name\":\"%s\",\"cat\":\"connection\",\"ph\":\"%s\",\"s\":\"t\",\"ts\":%ld,\"pid\":%d,\"tid\":%d},\n",
+			name, phase, start, this->_pid, tid);
+	else
+		snprintf(event, sizeof(event), "{\"name\":\"%s\",\"cat\":\"phase\",\"ph\":\"%s\",\"ts\":%ld,\"dur\":%ld,\"pid\":%d,\"tid\":%d},\n",
+			name, phase, start, duration, this->_pid, tid);
+	this->_buffer += event;
+}
+
+static void	appendJson(std::string &out, const std::string &value)
+{
+	char	hex[8];
+
+	for (size_t i = 0; i < value.size(); ++i)
+	{
+		unsigned char c = value[i];
+		if (c == '"' || c == '\\')
+		{
+			out += '\\';
+			out += c;
+		}
+		else if (c < 0x20 || c == 0x7f)
+		{
+			snprintf(hex, sizeof(hex), "\\u%04x", c);
+			out += hex;
+		}
+		else
+			out += c;
+	}
+}
+
+/**
+ * Called once client's response is sent: traces the request when it was slower
+ * than slow, and 1 in every of the others.
+ */
+void TraceLog::record(const Client &client, const std::string &vhost)
+{
+	long	start = client.getPhase(PHASE_FIRST_BYTE);
+	long	end = client.getPhase(PHASE_RESPONSE_END);
+	char	numbers[128];
+
+	if (this->_fd < 0 || start == 0 || end == 0)
+		return ;
+	bool slow = this->_config.slow_usec >= 0 && end - start > this->_config.slow_usec;
+	if (!slow && !(this->_config.every && ++this->_count >= this->_config.every))
+		return ;
+	if (!slow)
+		this->_count = 0;
+	if (this->_traced_fds.insert(client.getFd()).second)
+	{
+		snprintf(numbers, sizeof(numbers), "\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"fd %d\"}},\n",
+			this->_pid, client.getFd(), client.getFd());
+		this->_buffer += std::string("{\"name\":\"thread_name\",\"ph\":\"M\",") + numbers;
+	}
+	const HTTPRequest &request = client.getRequest();
+	this->_buffer += "{\"name\":\"";
+	appendJson(this->_buffer, request.getRequestMethod() + " " + request.getRequestTarget());
+	snprintf(numbers, sizeof(numbers), "\",\"cat\":\"request\",\"ph\":\"X\",\"ts\":%ld,\"dur\":%ld,\"pid\":%d,\"tid\":%d,\"args\":{\"status\":%d,\"vhost\":\"",
+		start, end - start, this->_pid, client.getFd(), client.getStatus());
+	this->_buffer += numbers;
+	appendJson(this->_buffer, vhost);
+	this->_buffer += "\",\"location\":\"";
+	if (client.getLocation())
+		appendJson(this->_buffer, client.getLocation()->getPath());
+	this->_buffer += "\"}},\n";
+	int from = -1;
+	for (int phase = 0; phase < PHASE_COUNT; ++phase)
+	{
+		if (client.getPhase(static_cast<RequestPhase>(phase)) == 0)
+			continue ;
+		if (from >= 0)
+		{
+			long from_ts = client.getPhase(static_cast<RequestPhase>(from));
+			_event(g_phase_spans[from], "X", client.getFd(), from_ts, client.getPhase(static_cast<RequestPhase>(phase)) - from_ts);
+		}
+		from = phase;
+	}
+	if (this->_buffer.size() >= TRACE_LOG_BUFFER)
+		flush();
+}
+
+//connection fd closed: marked on its track if it had traced requests
+void TraceLog::closed(int fd)
+{
+	if (this->_fd < 0 || this->_traced_fds.erase(fd) == 0)
+		return ;
+	_event("close", "i", fd, WebServer::Clock::monotonicUsec(), -1);
+}
+
+void TraceLog::flush()
+{
+	size_t	written = 0;
+
+	while (this->_fd >= 0 && written < this->_buffer.size())
+	{
+		ssize_t n = write(this->_fd, this->_buffer.data() + written, this->_buffer.size() - written);
+		if (n < 0 && errno == EINTR)
+			continue ;
+		if (n <= 0)
+			break ;
+		written += n;
+	}
+	this->_buffer.clear();
+	this->_last_flush = WebServer::Clock::now();
+}
+
+void TraceLog::tick(time_t now)
+{
+	if (!this->_buffer.empty() && now - this->_last_flush >= TRACE_LOG_FLUSH)
+		flush();
+}
+
+void TraceLog::flushActive()
+{
+	if (_active != NULL)
+		_active->flush();
+}
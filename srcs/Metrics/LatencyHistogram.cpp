@@ -0,0 +1,99 @@
+#include "../../includes/Metrics/LatencyHistogram.hpp"
+#include <cstring>
+
+LatencyHistogram::LatencyHistogram(): _count(0), _sum(0), _max(0)
+{
+	memset(this->_counts, 0, sizeof(this->_counts));
+}
+
+LatencyHistogram::LatencyHistogram(const LatencyHistogram &other)
+{
+	*this = other;
+}
+
+LatencyHistogram &LatencyHistogram::operator=(const LatencyHistogram &other)
+{
+	if (this != &other)
+	{
+		memcpy(this->_counts, other._counts, sizeof(this->_counts));
+		this->_count = other._count;
+		this->_sum = other._sum;
+		this->_max = other._max;
+	}
+	return (*this);
+}
+
+LatencyHistogram::~LatencyHistogram(){}
+
+/* values in [16 << e, 32 << e) share a power of two and are split by their top five bits */
+size_t LatencyHistogram::_index(unsigned long long usec)
+{
+	if (usec < 2 * HISTOGRAM_SUB_BUCKETS)
+		return (usec);
+	size_t shift = (63 - __builtin_clzll(usec)) - 4;
+	size_t index = shift * HISTOGRAM_SUB_BUCKETS + (usec >> shift);
+	return (index < HISTOGRAM_BUCKETS ? index : HISTOGRAM_BUCKETS - 1);
+}
+
+//largest value falling into bucket index
+unsigned long long LatencyHistogram::_upper(size_t index)
+{
+	if (index < 2 * HISTOGRAM_SUB_BUCKETS)
+		return (index);
+	size_t shift = index / HISTOGRAM_SUB_BUCKETS - 1;
+	unsigned long long sub = index - shift * HISTOGRAM_SUB_BUCKETS;
+	return (((sub + 1) << shift) - 1);
+}
+
+void LatencyHistogram::record(unsigned long long usec)
+{
+	++this->_counts[_index(usec)];
+	++this->_count;
+	this->_sum += usec;
+	if (usec > this->_max)
+		this->_max = usec;
+}
+
+void LatencyHistogram::merge(const LatencyHistogram &other)
+{
+	for (size_t i = 0; i < HISTOGRAM_BUCKETS; ++i)
+		this->_counts[i] += other._counts[i];
+	this->_count += other._count;
+	this->_sum += other._sum;
+	if (other._max > this->_max)
+		this->_max = other._max;
+}
+
+//value at or below which fraction of the recorded values lie, 0 when empty
+unsigned long long LatencyHistogram::percentile(double fraction) const
+{
+	unsigned long long target = static_cast<unsigned long long>(fraction * this->_count + 0.999999);
+	unsigned long long seen = 0;
+
+	if (this->_count == 0)
+		return (0);
+	if (target == 0)
+		target = 1;
+	for (size_t i = 0; i < HISTOGRAM_BUCKETS; ++i)
+	{
+		seen += this->_counts[i];
+		if (seen >= target)
+			return (_upper(i) < this->_max ? _upper(i) : this->_max);
+	}
+	return (this->_max);
+}
+
+unsigned long long LatencyHistogram::getCount() const
+{
+	return (this->_count);
+}
+
+unsigned long long LatencyHistogram::getSum() const
+{
+	return (this->_sum);
+}
+
+unsigned long long LatencyHistogram::getMax() const
+{
+	return (this->_max);
+}
@@ -0,0 +1,270 @@
+#include "../../includes/Metrics/Metrics.hpp"
+#include "../../includes/Utils/Clock.hpp"
+#include "../../includes/Utils/BufferPool.hpp"
+#include <sstream>
+#include <iomanip>
+
+//quantiles reported for every latency histogram
+static const double	g_quantiles[] = {0.5, 0.9, 0.99, 0.999};
+static const char	*g_quantile_names[] = {"p50", "p90", "p99", "p999"};
+
+Metrics::Metrics(): _accepts(0), _bytes_in(0), _started(WebServer::Clock::now()) {}
+
+Metrics::Metrics(const Metrics &other)
+{
+	*this = other;
+}
+
+Metrics &Metrics::operator=(const Metrics &other)
+{
+	if (this != &other)
+	{
+		this->_stats = other._stats;
+		this->_accepts = other._accepts;
+		this->_bytes_in = other._bytes_in;
+		this->_stalls = other._stalls;
+		this->_started = other._started;
+	}
+	return (*this);
+}
+
+Metrics::~Metrics(){}
+
+void Metrics::accepted()
+{
+	++this->_accepts;
+}
+
+void Metrics::received(size_t bytes)
+{
+	this->_bytes_in += bytes;
+}
+
+//a response was sent: location is empty for requests no location matched
+void Metrics::completed(const std::string &server, const std::string &location, short status,
+	size_t bytes_out, long usec, const AllocCounts &allocs)
+{
+	RequestStats &stats = this->_stats[std::make_pair(server, location)];
+
+	++stats.requests;
+	stats.bytes_out += bytes_out;
+	++stats.statuses[status];
+	stats.latency.record(usec > 0 ? usec : 0);
+	stats.allocs.allocs += allocs.allocs;
+	stats.allocs.frees += allocs.frees;
+	stats.allocs.bytes += allocs.bytes;
+}
+
+//an event loop callback (or a whole iteration) held the loop for usec
+void Metrics::stalled(const std::string &callback, long usec)
+{
+	std::pair<unsigned long long, long> &stalls = this->_stalls[callback];
+
+	++stalls.first;
+	if (usec > stalls.second)
+		stalls.second = usec;
+}
+
+/**
+ * stub_status style:
+ *   Active connections: 3
+ *   Reading: 0 Writing: 1 Idle: 2
+ *   ...
+ * followed by a block per server name and location.
+ */
+std::string Metrics::renderText(const ConnectionCounts &connections) const
+{
+	std::ostringstream	out;
+	unsigned long long	requests = 0;
+	unsigned long long	bytes_out = 0;
+	LatencyHistogram	latency;
+
+	for (StatsMap::const_iterator it = this->_stats.begin(); it != this->_stats.end(); ++it)
+	{
+		requests += it->second.requests;
+		bytes_out += it->second.bytes_out;
+		latency.merge(it->second.latency);
+	}
+	out << std::fixed << std::setprecision(3);
+	out << "Active connections: " << connections.reading + connections.writing + connections.idle << "\n"
+		<< "Reading: " << connections.reading << " Writing: " << connections.writing << " Idle: " << connections.idle << "\n"
+		<< "Accepts: " << this->_accepts << " Requests: " << requests << "\n"
+		<< "Bytes in: " << this->_bytes_in << " Bytes out: " << bytes_out << "\n"
+		<< "Uptime: " << WebServer::Clock::now() - this->_started << "s\n";
+	out << "Latency (ms):";
+	for (size_t q = 0; q < 4; ++q)
+		out << " " << g_quantile_names[q] << " " << latency.percentile(g_quantiles[q]) / 1000.0;
+	out << " max " << latency.getMax() / 1000.0 << "\n";
+	out << "Event loop stalls:";
+	if (this->_stalls.empty())
+		out << " 0";
+	for (std::map<std::string, std::pair<unsigned long long, long> >::const_iterator it = this->_stalls.begin();
+		it != this->_stalls.end(); ++it)
+		out << " " << it->first << " " << it->second.first << " (max " << it->second.second / 1000.0 << " ms)";
+	out << "\n";
+	out << "Input buffers (borrowed/pooled):";
+	for (int i = 0; i < BUFFER_CLASSES; ++i)
+	{
+		BufferClassStats buffers = WebServer::BufferPool::stats(i);
+		out << " " << buffers.size / 1024 << "k " << buffers.borrowed << "/" << buffers.pooled;
+	}
+	out << "\n";
+	if (WebServer::AllocStats::enabled())
+		_renderAllocs(out);
+	for (StatsMap::const_iterator it = this->_stats.begin(); it != this->_stats.end(); ++it)
+	{
+		const RequestStats &stats = it->second;
+		out << "\nServer " << (it->first.first.empty() ? "-" : it->first.first)
+			<< " location " << (it->first.second.empty() ? "-" : it->first.second) << "\n"
+			<< "  Requests: " << stats.requests << " Bytes out: " << stats.bytes_out << "\n"
+			<< "  Status:";
+		for (std::map<short, unsigned long long>::const_iterator s = stats.statuses.begin(); s != stats.statuses.end(); ++s)
+			out << " " << s->first << ":" << s->second;
+		out << "\n  Latency (ms):";
+		for (size_t q = 0; q < 4; ++q)
+			out << " " << g_quantile_names[q] << " " << stats.latency.percentile(g_quantiles[q]) / 1000.0;
+		out << " max " << stats.latency.getMax() / 1000.0 << "\n";
+		if (WebServer::AllocStats::enabled() && stats.requests > 0)
+			out << "  Allocations per request: " << static_cast<double>(stats.allocs.allocs) / stats.requests
+				<< " (" << static_cast<double>(stats.allocs.bytes) / stats.requests << " bytes)\n";
+	}
+	return (out.str());
+}
+
+//"Allocations:" then a line per thread: new/delete calls and bytes by phase
+void Metrics::_renderAllocs(std::ostream &out)
+{
+	std::vector<ThreadAllocStats> threads = WebServer::AllocStats::snapshot();
+
+	out << "Allocations:\n";
+	for (size_t t = 0; t < threads.size(); ++t)
+	{
+		bool any = false;
+		out << "  " << (threads[t].name ? threads[t].name : "thread") << ":";
+		for (int p = 0; p < ALLOC_PHASE_COUNT; ++p)
+		{
+			const AllocCounts &counts = threads[t].phases[p];
+			if (counts.allocs == 0 && counts.frees == 0)
+				continue ;
+			out << " " << WebServer::AllocStats::phaseName(p) << " " << counts.allocs << "/" << counts.frees
+				<< " (" << counts.bytes << " bytes)";
+			any = true;
+		}
+		out << (any ? "\n" : " none\n");
+	}
+}
+
+//label values are quoted: backslash, double quote and newline are escaped
+std::string Metrics::_label(const std::string &value)
+{
+	std::string out;
+
+	for (size_t i = 0; i < value.size(); ++i)
+	{
+		if (value[i] == '\\' || value[i] == '"')
+			out += '\\';
+		if (value[i] == '\n')
+			out += "\\n";
+		else
+			out += value[i];
+	}
+	return (out);
+}
+
+/* Prometheus text exposition format 0.0.4, latencies as summaries in seconds */
+std::string Metrics::renderPrometheus(const ConnectionCounts &connections) const
+{
+	std::ostringstream	out;
+
+	out << std::setprecision(9);
+	out << "# HELP webserv_connections Open client connections by state.\n"
+		<< "# TYPE webserv_connections gauge\n"
+		<< "webserv_connections{state=\"reading\"} " << connections.reading << "\n"
+		<< "webserv_connections{state=\"writing\"} " << connections.writing << "\n"
+		<< "webserv_connections{state=\"idle\"} " << connections.idle << "\n"
+		<< "# HELP webserv_accepts_total Accepted client connections.\n"
+		<< "# TYPE webserv_accepts_total counter\n"
+		<< "webserv_accepts_total " << this->_accepts << "\n"
+		<< "# HELP webserv_received_bytes_total Bytes read from clients.\n"
+		<< "# TYPE webserv_received_bytes_total counter\n"
+		<< "webserv_received_bytes_total " << this->_bytes_in << "\n"
+		<< "# HELP webserv_start_time_seconds Time the server started, in seconds since the epoch.\n"
+		<< "# TYPE webserv_start_time_seconds gauge\n"
+		<< "webserv_start_time_seconds " << this->_started << "\n";
+	out << "# HELP webserv_input_buffers Receive buffers lent to connections or idle in the pool, by size.\n"
+		<< "# TYPE webserv_input_buffers gauge\n";
+	for (int i = 0; i < BUFFER_CLASSES; ++i)
+	{
+		BufferClassStats buffers = WebServer::BufferPool::stats(i);
+		out << "webserv_input_buffers{size=\"" << buffers.size << "\",state=\"borrowed\"} " << buffers.borrowed << "\n"
+			<< "webserv_input_buffers{size=\"" << buffers.size << "\",state=\"pooled\"} " << buffers.pooled << "\n";
+	}
+	out << "# HELP webserv_event_loop_stalls_total Event loop callbacks that ran past the stall threshold.\n"
+		<< "# TYPE webserv_event_loop_stalls_total counter\n";
+	for (std::map<std::string, std::pair<unsigned long long, long> >::const_iterator it = this->_stalls.begin();
+		it != this->_stalls.end(); ++it)
+		out << "webserv_event_loop_stalls_total{callback=\"" << it->first << "\"} " << it->second.first << "\n";
+	out << "# HELP webserv_event_loop_stall_max_seconds Longest stall, by callback.\n"
+		<< "# TYPE webserv_event_loop_stall_max_seconds gauge\n";
+	for (std::map<std::string, std::pair<unsigned long long, long> >::const_iterator it = this->_stalls.begin();
+		it != this->_stalls.end(); ++it)
+		out << "webserv_event_loop_stall_max_seconds{callback=\"" << it->first << "\"} " << it->second.second / 1e6 << "\n";
+	if (WebServer::AllocStats::enabled())
+	{
+		std::vector<ThreadAllocStats> threads = WebServer::AllocStats::snapshot();
+		out << "# HELP webserv_allocations_total Calls to operator new, by thread and request phase.\n"
+			<< "# TYPE webserv_allocations_total counter\n";
+		for (size_t t = 0; t < threads.size(); ++t)
+			for (int p = 0; p < ALLOC_PHASE_COUNT; ++p)
+				out << "webserv_allocations_total{thread=\"" << _label(threads[t].name ? threads[t].name : "thread")
+					<< "\",phase=\"" << WebServer::AllocStats::phaseName(p) << "\"} " << threads[t].phases[p].allocs << "\n";
+		out << "# HELP webserv_frees_total Calls to operator delete, by thread and request phase.\n"
+			<< "# TYPE webserv_frees_total counter\n";
+		for (size_t t = 0; t < threads.size(); ++t)
+			for (int p = 0; p < ALLOC_PHASE_COUNT; ++p)
+				out << "webserv_frees_total{thread=\"" << _label(threads[t].name ? threads[t].name : "thread")
+					<< "\",phase=\"" << WebServer::AllocStats::phaseName(p) << "\"} " << threads[t].phases[p].frees << "\n";
+		out << "# HELP webserv_allocated_bytes_total Bytes asked of operator new, by thread and request phase.\n"
+			<< "# TYPE webserv_allocated_bytes_total counter\n";
+		for (size_t t = 0; t < threads.size(); ++t)
+			for (int p = 0; p < ALLOC_PHASE_COUNT; ++p)
+				out << "webserv_allocated_bytes_total{thread=\"" << _label(threads[t].name ? threads[t].name : "thread")
+					<< "\",phase=\"" << WebServer::AllocStats::phaseName(p) << "\"} " << threads[t].phases[p].bytes << "\n";
+		out << "# HELP webserv_request_allocations_total Calls to operator new charged to requests, by server and location.\n"
+			<< "# TYPE webserv_request_allocations_total counter\n";
+		for (StatsMap::const_iterator it = this->_stats.begin(); it != this->_stats.end(); ++it)
+			out << "webserv_request_allocations_total{server=\"" << _label(it->first.first) << "\",location=\""
+				<< _label(it->first.second) << "\"} " << it->second.allocs.allocs << "\n";
+		out << "# HELP webserv_request_allocated_bytes_total Bytes allocated for requests, by server and location.\n"
+			<< "# TYPE webserv_request_allocated_bytes_total counter\n";
+		for (StatsMap::const_iterator it = this->_stats.begin(); it != this->_stats.end(); ++it)
+			out << "webserv_request_allocated_bytes_total{server=\"" << _label(it->first.first) << "\",location=\""
+				<< _label(it->first.second) << "\"} " << it->second.allocs.bytes << "\n";
+	}
+	out << "# HELP webserv_requests_total Requests answered, by server, location and status.\n"
+		<< "# TYPE webserv_requests_total counter\n";
+	for (StatsMap::const_iterator it = this->_stats.begin(); it != this->_stats.end(); ++it)
+	{
+		std::string labels = "server=\"" + _label(it->first.first) + "\",location=\"" + _label(it->first.second) + "\"";
+		for (std::map<short, unsigned long long>::const_iterator s = it->second.statuses.begin(); s != it->second.statuses.end(); ++s)
+			out << "webserv_requests_total{" << labels << ",status=\"" << s->first << "\"} " << s->second << "\n";
+	}
+	out << "# HELP webserv_sent_bytes_total Response bytes sent, headers included.\n"
+		<< "# TYPE webserv_sent_bytes_total counter\n";
+	for (StatsMap::const_iterator it = this->_stats.begin(); it != this->_stats.end(); ++it)
+		out << "webserv_sent_bytes_total{server=\"" << _label(it->first.first) << "\",location=\""
+			<< _label(it->first.second) << "\"} " << it->second.bytes_out << "\n";
+	out << "# HELP webserv_request_duration_seconds Time from the first byte of a request to the last byte of its response.\n"
+		<< "# TYPE webserv_request_duration_seconds summary\n";
+	for (StatsMap::const_iterator it = this->_stats.begin(); it != this->_stats.end(); ++it)
+	{
+		const LatencyHistogram &latency = it->second.latency;
+		std::string labels = "server=\"" + _label(it->first.first) + "\",location=\"" + _label(it->first.second) + "\"";
+		for (size_t q = 0; q < 4; ++q)
+			out << "webserv_request_duration_seconds{" << labels << ",quantile=\"" << g_quantiles[q] << "\"} "
+				<< latency.percentile(g_quantiles[q]) / 1e6 << "\n";
+		out << "webserv_request_duration_seconds_sum{" << labels << "} " << latency.getSum() / 1e6 << "\n"
+			<< "webserv_request_duration_seconds_count{" << labels << "} " << latency.getCount() << "\n";
+	}
+	return (out.str());
+}
@@ -0,0 +1,151 @@
+#include "../../includes/Router/ConnectionTable.hpp"
+#include <stdlib.h>
+#include <new>
+
+static const FdEntry	g_unused = {FD_UNUSED, -1, 0, NULL};
+
+ConnectionTable::ConnectionTable(): _entries(NULL), _size(0) {}
+
+ConnectionTable::~ConnectionTable()
+{
+	for (size_t i = 0; i < this->_active.size(); ++i)
+		_destroy(this->_active[i]);
+	for (size_t i = 0; i < this->_pool.size(); ++i)
+		_destroy(this->_pool[i]);
+	free(this->_entries);
+}
+
+void ConnectionTable::_destroy(Client *client)
+{
+	client->~Client();
+	free(client);
+}
+
+//room for fds 0 to max_fds - 1, false if the array cannot be allocated
+bool ConnectionTable::allocate(size_t max_fds)
+{
+	FdEntry *entries = static_cast<FdEntry *>(calloc(max_fds, sizeof(FdEntry)));
+
+	if (entries == NULL)
+		return (false);
+	for (size_t fd = 0; fd < this->_size && fd < max_fds; ++fd)
+		entries[fd] = this->_entries[fd];
+	free(this->_entries);
+	this->_entries = entries;
+	this->_size = max_fds;
+	return (true);
+}
+
+size_t ConnectionTable::size() const
+{
+	return (this->_size);
+}
+
+//what fd is, an FD_UNUSED entry for an fd outside the table
+const FdEntry &ConnectionTable::entry(int fd) const
+{
+	if (fd < 0 || static_cast<size_t>(fd) >= this->_size)
+		return (g_unused);
+	return (this->_entries[fd]);
+}
+
+//the connection on fd, NULL if fd is not an open client
+Client *ConnectionTable::client(int fd) const
+{
+	const FdEntry &fd_entry = entry(fd);
+
+	return (fd_entry.kind == FD_CLIENT ? fd_entry.client : NULL);
+}
+
+/**
+ * Registers the connection accepted on fd with a pooled Client, or a new one.
+ * Returns NULL if fd does not fit in the table or no memory is left.
+ */
+Client *ConnectionTable::open(int fd, int listen_fd, const struct sockaddr_in &address)
+{
+	Client	*client;
+	void	*memory;
+
+	if (fd < 0 || static_cast<size_t>(fd) >= this->_size)
+		return (NULL);
+	if (!this->_pool.empty())
+	{
+		client = this->_pool.back();
+		this->_pool.pop_back();
+	}
+	else
+	{
+		if (posix_memalign(&memory, CLIENT_ALIGN, sizeof(Client)) != 0)
+			return (NULL);
+		client = new (memory) Client();
+	}
+	client->open(fd, listen_fd, address);
+	FdEntry &fd_entry = this->_entries[fd];
+	fd_entry.kind = FD_CLIENT;
+	fd_entry.client_fd = -1;
+	fd_entry.index = this->_active.size();
+	fd_entry.client = client;
+	this->_active.push_back(client);
+	return (client);
+}
+
+//forgets the client on fd: its memory is released and the object pooled
+void ConnectionTable::close(int fd)
+{
+	Client *client = this->client(fd);
+
+	if (client == NULL)
+		return ;
+	//the last active client takes the freed position
+	unsigned int index = this->_entries[fd].index;
+	Client *last = this->_active.back();
+	this->_active[index] = last;
+	this->_entries[last->getFd()].index = index;
+	this->_active.pop_back();
+	this->_entries[fd] = g_unused;
+	client->release();
+	if (this->_pool.size() < CLIENT_POOL_KEEP)
+		this->_pool.push_back(client);
+	else
+		_destroy(client);
+}
+
+void ConnectionTable::setListen(int fd)
+{
+	if (fd < 0 || static_cast<size_t>(fd) >= this->_size)
+		return ;
+	this->_entries[fd] = g_unused;
+	this->_entries[fd].kind = FD_LISTEN;
+}
+
+void ConnectionTable::setCgi(int fd, int client_fd)
+{
+	if (fd < 0 || static_cast<size_t>(fd) >= this->_size)
+		return ;
+	this->_entries[fd] = g_unused;
+	this->_entries[fd].kind = FD_CGI;
+	this->_entries[fd].client_fd = client_fd;
+}
+
+//forgets a listening socket or CGI fd
+void ConnectionTable::clear(int fd)
+{
+	if (fd < 0 || static_cast<size_t>(fd) >= this->_size || this->_entries[fd].kind == FD_CLIENT)
+		return ;
+	this->_entries[fd] = g_unused;
+}
+
+size_t ConnectionTable::activeCount() const
+{
+	return (this->_active.size());
+}
+
+Client *ConnectionTable::active(size_t index) const
+{
+	return (this->_active[index]);
+}
+
+size_t ConnectionTable::pooledCount() const
+{
+	return (this->_pool.size());
+}
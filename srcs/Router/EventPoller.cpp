@@ -0,0 +1,97 @@
+#include "../../includes/Router/EventPoller.hpp"
+#include "../../includes/Logger/Logger.hpp"
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+EventPoller::EventPoller(): _epoll_fd(-1) {}
+
+EventPoller::~EventPoller()
+{
+	if (this->_epoll_fd >= 0)
+		close(this->_epoll_fd);
+}
+
+bool EventPoller::open()
+{
+	this->_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	return (this->_epoll_fd >= 0);
+}
+
+//registers, changes or drops fd so the kernel watches exactly interest
+void EventPoller::_update(int fd, unsigned char interest)
+{
+	struct epoll_event	event;
+	unsigned char		previous = this->_interest[fd];
+
+	if (interest == previous)
+		return ;
+	this->_interest[fd] = interest;
+	memset(&event, 0, sizeof(event));
+	event.data.fd = fd;
+	if (interest & POLL_READ)
+		event.events |= EPOLLIN;
+	if (interest & POLL_WRITE)
+		event.events |= EPOLLOUT;
+	int op = (interest == 0) ? EPOLL_CTL_DEL : (previous == 0 ? EPOLL_CTL_ADD : EPOLL_CTL_MOD);
+	if (epoll_ctl(this->_epoll_fd, op, fd, &event) == 0)
+		return ;
+	//an fd closed without remove() left stale interest, or a reused number is still registered
+	if (op == EPOLL_CTL_MOD && errno == ENOENT)
+		op = EPOLL_CTL_ADD;
+	else if (op == EPOLL_CTL_ADD && errno == EEXIST)
+		op = EPOLL_CTL_MOD;
+	else if (op == EPOLL_CTL_DEL && (errno == ENOENT || errno == EBADF))
+		return ;
+	else
+		op = -1;
+	if (op == -1 || epoll_ctl(this->_epoll_fd, op, fd, &event) < 0)
+		WS_ERROR("webserv: epoll_ctl error on fd %d: %s", fd, strerror(errno));
+}
+
+void EventPoller::add(int fd, int interest)
+{
+	if (fd < 0)
+		return ;
+	if (static_cast<size_t>(fd) >= this->_interest.size())
+		this->_interest.resize(fd + 1, 0);
+	_update(fd, this->_interest[fd] | interest);
+}
+
+void EventPoller::remove(int fd, int interest)
+{
+	if (fd < 0 || static_cast<size_t>(fd) >= this->_interest.size())
+		return ;
+	_update(fd, this->_interest[fd] & ~interest);
+}
+
+bool EventPoller::watching(int fd, int interest) const
+{
+	if (fd < 0 || static_cast<size_t>(fd) >= this->_interest.size())
+		return (false);
+	return ((this->_interest[fd] & interest) != 0);
+}
+
+//ready fds, 0 on timeout, -1 with errno set on error
+int EventPoller::wait(int timeout_ms)
+{
+	return (epoll_wait(this->_epoll_fd, this->_events, POLLER_MAX_EVENTS, timeout_ms));
+}
+
+int EventPoller::readyFd(int index) const
+{
+	return (this->_events[index].data.fd);
+}
+
+//checked against the current interest: an earlier callback of the batch may have changed it
+bool EventPoller::readable(int index) const
+{
+	return ((this->_events[index].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+		&& watching(this->_events[index].data.fd, POLL_READ));
+}
+
+bool EventPoller::writable(int index) const
+{
+	return ((this->_events[index].events & (EPOLLOUT | EPOLLHUP | EPOLLERR))
+		&& watching(this->_events[index].data.fd, POLL_WRITE));
+}
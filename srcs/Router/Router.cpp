@@ -1,6 +1,15 @@
 #include "../../includes/Router/Router.hpp"
 #include "../../includes/Logger/Logger.hpp"
 #include "../includes/HTTPMessage/HTTPRequest/HTTPRequest.hpp"
+#include "../includes/HTTPMessage/HTTPResponse/HTTPResponse.hpp"
+#include "../includes/ConfigParser/Location.hpp"
+#include "../includes/Utils/Clock.hpp"
+#include "../includes/Utils/BufferPool.hpp"
+#include "../includes/CGI/CgiHandler.hpp"
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <netinet/tcp.h>
+#include <algorithm>
 
 Router::Router(){}
 
@@ -8,8 +17,7 @@ Router::~Router(){}
 
 void Router::setupServers(std::vector<Server> servers)
 {
-	WebServer::Logger *logManager = WebServer::Logger::getInstance();
-	logManager->logMsg(CYAN, "Initializing Servers...");
+	WS_INFO("Initializing Servers...");
 	_servers = servers;
 	for (size_t i = 0; i < _servers.size(); ++i)
 	{
@@ -32,9 +40,11 @@ void Router::setupServers(std::vector<Server> servers)
 			if (used_fd == 0)
 			{
 				int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+				if (listen_fd != -1)
+					fcntl(listen_fd, F_SETFD, FD_CLOEXEC); //CGI children must not inherit sockets
 				if (listen_fd  == -1)
 				{
-					logManager->logMsg(RED, "webserv: socket error %s   Closing ....", strerror(errno));
+					WS_ERROR("webserv: socket error %s   Closing ....", strerror(errno));
 					exit(EXIT_FAILURE);
 				}
 				int option_value = 1;
@@ -42,27 +52,30 @@ void Router::setupServers(std::vector<Server> servers)
 				_servers[i].setServerAddress(pair.first, pair.second);
 				if (bind(listen_fd, (struct sockaddr *) &_servers[i].getServerAddress(), sizeof(_servers[i].getServerAddress())) == -1)
 				{
-					logManager->logMsg(RED, "webserv: bind error %s   Closing ....", strerror(errno));
+					WS_ERROR("webserv: bind error %s   Closing ....", strerror(errno));
 					exit(EXIT_FAILURE);
 				}
                 _servers[i].addListenFds(listen_fd);
-                fds_to_servers_map[listen_fd].push_back(_servers[i]);
+				if (fds_to_servers.size() <= static_cast<size_t>(listen_fd))
+					fds_to_servers.resize(listen_fd + 1);
+                fds_to_servers[listen_fd].push_back(_servers[i]);
+				_listen_fds.push_back(listen_fd);
 				pairs_to_fds_map[pair] = listen_fd;
             }
 			else
 			{
                 // Reuse the existing socket
                 _servers[i].addListenFds(used_fd);
-				for (std::map<int, std::vector<Server> >::const_iterator it = fds_to_servers_map.begin();
-				it != fds_to_servers_map.end(); ++it)
+				for (size_t l = 0; l < _listen_fds.size(); ++l)
 				{
-					for (size_t j = 0; j < it->second.size() ; ++j)
+					const std::vector<Server> &servers = fds_to_servers[_listen_fds[l]];
+					for (size_t j = 0; j < servers.size() ; ++j)
 					{
-						if (it->second[j].getServerName() == _servers[i].getServerName())
+						if (servers[j].getServerName() == _servers[i].getServerName())
 							throw std::invalid_argument("Duplicate Server Name and Host:Port pair");
 					}
 				}
-				fds_to_servers_map[used_fd].push_back(_servers[i]);
+				fds_to_servers[used_fd].push_back(_servers[i]);
             }
 		}
 	}
@@ -70,60 +83,104 @@ void Router::setupServers(std::vector<Server> servers)
 }
 
 /**
- * Runs main loop that goes through all file descriptors from 0 till the biggest fd in the set.
- * - check file descriptors returend from select():
+ * Runs main loop that goes through the file descriptors epoll reports ready.
+ * - check file descriptors returned from EventPoller::wait():
  *      if server fd --> accept new client
- *      if client fd in read_set --> read message from client
- *      if client fd in write_set:
+ *      if client fd readable --> read message from client
+ *      if client fd writable:
  *          1- If it's a CGI response and Body still not sent to CGI child process --> Send request body to CGI child process.
  *          2- If it's a CGI response and Body was sent to CGI child process --> Read outupt from CGI child process.
- *          3- If it's a normal response --> Send response to client.
- * - servers and clients sockets will be added to _recv_set_pool initially,
- *   after that, when a request is fully parsed, socket will be moved to _write_set_pool
+ *          3- If it's a normal response --> flush the client's OutputChain.
+ * - servers and clients sockets are watched for reading initially,
+ *   after that, when a request is fully parsed, socket will be watched for writing
  */
 void	Router::runServers()
 {
-	fd_set	recv_set_cpy;
-	fd_set	write_set_cpy;
-	int		select_ret;
+	int		ready;
 
-	_biggest_fd = 0;
+	WebServer::AllocStats::nameThread("event-loop");
 	initialiseSets();
-	struct timeval timer;
-	while (true)
-	{
-		timer.tv_sec = 1;
-		timer.tv_usec = 0;
-		recv_set_cpy = _recv_fd_pool;
-		write_set_cpy = _write_fd_pool;
-		WebServer::Logger *logManager = WebServer::Logger::getInstance();
-		//select(int nfds, fd_set *readfds, fd_set *writefds, fd_set *exceptfds, struct timeval *timeout)
-		//nfds: Highest-numbered fd + 1 for monitoring
-		//exceptfds: Fd set to monitor for errors
-		// timeout: Maximum time select() should block, if NULL, select() blocks indefinitely
-		// Returns >0 for the number of fds read of I/O
-		// Returns 0 if timeout occurred(no fd is ready)
-		// Returns <0 if error occurred(signal interrupt, invalid parameters)
-		// Interrupted System Call(EINTR), Invalid parameters(EBADF, EINVAL), Resource Issues(ENOMEM)
-		if ((select_ret = select(_biggest_fd + 1, &recv_set_cpy, &write_set_cpy, NULL, &timer)) < 0)
-		{
-			logManager->logMsg(RED, "webserv: select error %s   Closing ....", strerror(errno));
+	while (!WebServer::Utils::stopSignal())
+	{
+		//wakes at least once per second so timeouts are checked
+		//Returns >0 for the number of fds ready for I/O
+		//Returns 0 if timeout occurred(no fd is ready)
+		//Returns <0 if error occurred(signal interrupt EINTR, invalid epoll fd)
+		if ((ready = _poller.wait(1000)) < 0)
+		{
+			if (errno == EINTR)
+				continue ;
+			WS_ERROR("webserv: epoll_wait error %s   Closing ....", strerror(errno));
 			exit(1);
 		}
-		for (int i = 0; i <= _biggest_fd; ++i)
+		WebServer::Clock::update();
+		_watchdog.beginIteration();
+		for (int e = 0; e < ready; ++e)
 		{
-			if (FD_ISSET(i, &recv_set_cpy) && fds_to_servers_map.count(i))
+			int				i = _poller.readyFd(e);
+			bool			readable = _poller.readable(e);
+			bool			writable = _poller.writable(e);
+			const FdEntry	&entry = _connections.entry(i);
+
+			if (readable && i == CgiHandler::getSignalFd())
 			{
+				_watchdog.begin("reap", i);
+				CgiHandler::reapChildren();
+			}
+			else if (readable && entry.kind == FD_LISTEN)
+			{
+				_watchdog.begin("accept", i);
 				acceptNewConnection(i);
 			}
+			else if ((readable || writable) && entry.kind == FD_CGI)
+			{
+				int client_fd = entry.client_fd;
+				Client &client = *_connections.client(client_fd);
+				_watchdog.begin("cgi", client_fd);
+				WebServer::AllocStats::attach(&client.getAllocs());
+				if (writable)
+					sendCgiBody(client, _cgi_map[client_fd]);
+				else
+					readCgiResponse(client, _cgi_map[client_fd]);
+			}
+			else if (entry.kind == FD_CLIENT)
+			{
+				Client *client = entry.client;
+				//a client waiting for its CGI response is watched for hang-ups while written to
+				if (readable)
+				{
+					_watchdog.begin("read", i);
+					WebServer::AllocStats::attach(&client->getAllocs());
+					readRequest(i, *client);
+					endCallback();
+				}
+				if (!writable || _connections.client(i) != client || !_poller.watching(i, POLL_WRITE))
+					continue ;
+				_watchdog.begin("write", i);
+				WebServer::AllocStats::attach(&client->getAllocs());
+				sendResponse(i, *client);
+			}
+			else
+				continue ;
+			endCallback();
 		}
+		_watchdog.begin("timers", -1);
+		checkTimeout();
+		endCallback();
+		long elapsed = _watchdog.endIteration();
+		if (elapsed > 0)
+			reportStall("iteration", "iteration", -1, NULL, elapsed, "");
 	}
+	WS_INFO("webserv: signal %d received, closing....", WebServer::Utils::stopSignal());
+	//write out buffered access log records and trace events
+	AccessLog::flushAll();
+	TraceLog::flushActive();
 }
 
 /**
  * Accept new incomming connection.
  * Create new Client object and add it to _client_map
- * Add client socket to _recv_fd_pool
+ * Watch client socket for reading
 */
 void	Router::acceptNewConnection(int listen_fd)
 {
@@ -136,11 +193,11 @@ void	Router::acceptNewConnection(int listen_fd)
 	//client_address contains client's address information(IP and Port)
 	//Returns new fd used for communication with the client
 	//Returns -1 if  fail
-	WebServer::Logger *logManager = WebServer::Logger::getInstance();
 	if ((client_socket = accept(listen_fd, (struct sockaddr *)&client_address,
 	(socklen_t*)&client_address_size)) == -1)
 	{
-		logManager->logMsg(RED, "webserv: accept error %s", strerror(errno));
+		if (errno != EAGAIN && errno != EWOULDBLOCK)
+			WS_ERROR("webserv: accept error %s", strerror(errno));
 		return ;
 	}
 	//inet_ntop converts an IP address from binary format to string
@@ -151,49 +208,1119 @@ void	Router::acceptNewConnection(int listen_fd)
 	// size: size of the destination buffer. Must be large enough to hold result string.
 	// For IPv4 at least INET_ADDSTRLEN. Defined as 16 in <netinet/in.h>
 	// Returns dst, or NULL if fail
-	logManager->logMsg(LIGHT_BLUE, "New Connection From %s, Assigned Socket %d",inet_ntop(AF_INET, &client_address, buf, INET_ADDRSTRLEN), client_socket);
-	addToFdSet(client_socket, _recv_fd_pool); //add client socket to recv fd pool
-	/*
-	if (fcntl(client_socket, F_SETFL, O_NONBLOCK) < 0) //set to non-block mode
+	WS_DEBUG("New Connection From %s, Assigned Socket %d",inet_ntop(AF_INET, &client_address.sin_addr, buf, INET_ADDRSTRLEN), client_socket);
+	if (fcntl(client_socket, F_SETFL, O_NONBLOCK) < 0 //set to non-block mode
+		|| fcntl(client_socket, F_SETFD, FD_CLOEXEC) < 0) //keep it out of CGI children
 	{
-		logManager->logMsg(RED, "webserv: fcntl error %s", strerror(errno));
-		removeFromFdSet(client_socket, _recv_fd_pool);
+		WS_ERROR("webserv: fcntl error %s", strerror(errno));
 		close(client_socket);
 		return ;
 	}
-	*/
-	logManager->logMsg(LIGHTMAGENTA, "+++++++ Connection Accepted ++++++++\n");
-
-	char buffer[30000] = {0};
-	int valread = read(client_socket, buffer, 30000);
-	string hello = "HTTP/1.1 200 OK\nContent-Type: text/plain\nContent-Length: 12\n\nnihao world!";
-	logManager->logMsg(YELLOW, "------- Header -------\n");
-	logManager->logMsg(YELLOW, "%s\n", buffer);
-	HTTPRequest request(buffer);
-	logManager->logMsg(LIGHT_BLUE, "------- Getters -------\n");
-	logManager->logMsg(LIGHT_BLUE, "Start line: %s\n", request.getStarline().c_str());
-	cout << LIGHT_BLUE << "Field line:\n" << request.getRequestMethod() << endl;
-	cout << LIGHT_BLUE << "test test\n" << request.getHttpVersion() << endl;
-	logManager->logMsg(LIGHT_BLUE, "Message Body: %s\n", request.getBody().c_str());
-	logManager->logMsg(LIGHT_BLUE, "+++++++ Sending Message ++++++++\n");
-	send(client_socket, hello.c_str(), hello.size(), 0);
-	logManager->logMsg(LIGHT_BLUE, "------------------Hello message sent-------------------%d\n", valread);
-	close(client_socket);
-	removeFromFdSet(client_socket, _recv_fd_pool);
-	client_socket = -1;
-}
-
-/* initialise recv+write fd_sets and add all server listening sockets to _recv_fd_pool. */
+	//headers leave in one writev() and a file body follows with sendfile(): without
+	//TCP_NODELAY that second segment waits for the client's delayed ACK (~40 ms)
+	int nodelay = 1;
+	setsockopt(client_socket, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+	if (_connections.open(client_socket, listen_fd, client_address) == NULL)
+	{
+		WS_ERROR("webserv: no room for connection %d", client_socket);
+		close(client_socket);
+		return ;
+	}
+	_metrics.accepted();
+	_poller.add(client_socket, POLL_READ); //add client socket to recv fd pool
+	WS_DEBUG("+++++++ Connection Accepted ++++++++\n");
+}
+
+/**
+ * Reads whatever the client sent without blocking into the client's InputBuffer,
+ * sized for what is expected next: BUFFER_SMALL for a request line and headers
+ * (grown while they do not fit), the rest of the body while one is being read.
+ * A complete request is handed to parseRequest().
+ */
+void	Router::readRequest(const int &fd, Client &client)
+{
+	if (client.getState() == CLIENT_WRITING)
+		return (watchHangup(fd, client));
+	InputBuffer	&input = client.getInput();
+	size_t		wanted = BUFFER_SMALL;
+	size_t		room;
+
+	if (client.getState() == CLIENT_READING_BODY)
+		wanted = client.getContentLength() - client.getRequest().getBody().size();
+	char *buffer = input.reserve(wanted, room);
+	//only a header block without its blank line fills the largest buffer
+	if (room == 0)
+		return (rejectRequest(client, 400));
+	ssize_t	bytes_read = recv(fd, buffer, room, 0);
+
+	//an empty buffer goes straight back to the pool
+	input.commit(bytes_read > 0 ? bytes_read : 0);
+	if (bytes_read == 0)
+	{
+		closeConnection(fd);
+		return ;
+	}
+	if (bytes_read < 0)
+	{
+		if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+			closeConnection(fd);
+		return ;
+	}
+	client.updateTime();
+	_metrics.received(bytes_read);
+	client.markPhase(PHASE_FIRST_BYTE);
+	parseRequest(client);
+}
+
+/**
+ * The socket of a client waiting for its CGI response became readable. End of
+ * stream or an error means nobody will read the response: the connection is
+ * closed, which kills the script, returns its pool worker and frees its queue
+ * entry or slot. Bytes of a pipelined request are kept for after the response;
+ * past MAX_HEADER_SIZE the socket is no longer watched and a hang-up shows up as
+ * a write error instead.
+ */
+void	Router::watchHangup(const int &fd, Client &client)
+{
+	InputBuffer	&input = client.getInput();
+	size_t		room;
+	char		*buffer = input.reserve(BUFFER_SMALL, room);
+
+	if (room == 0)
+		return (_poller.remove(fd, POLL_READ));
+	ssize_t	bytes_read = recv(fd, buffer, room, 0);
+
+	input.commit(bytes_read > 0 ? bytes_read : 0);
+	if (bytes_read == 0 || (bytes_read < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+	{
+		if (cgiBusy(fd))
+			WS_INFO("Client %d went away, cancelling its CGI request", fd);
+		return (closeConnection(fd));
+	}
+	if (bytes_read < 0)
+		return ;
+	_metrics.received(bytes_read);
+	if (input.size() > MAX_HEADER_SIZE)
+		_poller.remove(fd, POLL_READ);
+}
+
+/**
+ * Consumes one request from the client's buffer once it is complete:
+ * - the header block is parsed as soon as the blank line arrives, and the request
+ *   is routed so Content-Length can be checked against client_max_body_size.
+ * - body bytes move to the request as they arrive, until Content-Length of them.
+ * Anything after the request stays buffered for the next keep-alive request.
+ */
+void	Router::parseRequest(Client &client)
+{
+	InputBuffer	&input = client.getInput();
+
+	ALLOC_PHASE(ALLOC_PHASE_PARSE);
+	_watchdog.stage("parse");
+	if (client.getState() == CLIENT_READING)
+	{
+		const char *header_end = static_cast<const char *>(memmem(input.data(), input.size(),
+			FIELD_LINE_SEPARATOR, strlen(FIELD_LINE_SEPARATOR)));
+		if (header_end == NULL)
+		{
+			if (input.size() > MAX_HEADER_SIZE)
+				rejectRequest(client, 400);
+			return ;
+		}
+		size_t body_start = header_end - input.data() + strlen(FIELD_LINE_SEPARATOR);
+		WS_TRACE("------- Header -------\n");
+		WS_TRACE("%s\n", string(input.data(), header_end).c_str());
+		try
+		{
+			client.getRequest().parse(input.data(), body_start);
+			client.markPhase(PHASE_HEADERS);
+		}
+		catch (std::exception &e)
+		{
+			WS_WARN("webserv: bad request: %s", e.what());
+			rejectRequest(client, 400);
+			return ;
+		}
+		assignServer(client);
+		client.markPhase(PHASE_LOCATION);
+		const std::map<string, string> &headers = client.getRequest().getHeaders();
+		std::map<string, string>::const_iterator it = headers.find("Content-Length");
+		size_t content_length = 0;
+		if (it != headers.end())
+		{
+			char *end = NULL;
+			content_length = strtoul(it->second.c_str(), &end, 10);
+			if (it->second.empty() || *end != '\0')
+				return (rejectRequest(client, 400));
+		}
+		else if (headers.count("Transfer-Encoding"))
+			return (rejectRequest(client, 501));
+		size_t max_body = client.getLocation() ? client.getLocation()->getMaxBodySize()
+			: client.getServer()->getClientMaxBodySize();
+		if (content_length > max_body)
+			return (rejectRequest(client, 413));
+		client.setContentLength(content_length);
+		client.setState(CLIENT_READING_BODY);
+		input.consume(body_start);
+	}
+	size_t missing = client.getContentLength() - client.getRequest().getBody().size();
+	size_t take = std::min(missing, input.size());
+	if (take > 0)
+	{
+		client.getRequest().appendBody(input.data(), take);
+		input.consume(take);
+	}
+	if (take < missing)
+		return ;
+	WS_TRACE("------- Getters -------\n");
+	WS_TRACE("Start line: %s\n", client.getRequest().getStarline().c_str());
+	WS_TRACE("Message Body: %s\n", client.getRequest().getBody().c_str());
+	handleRequest(client);
+	WS_TRACE("+++++++ Sending Message ++++++++\n");
+	sendResponse(client.getFd(), client);
+}
+
+/* answer a request that cannot be read any further with an error, then close */
+void	Router::rejectRequest(Client &client, short code)
+{
+	if (client.getServer() == NULL)
+		client.setServer(&fds_to_servers[client.getListenFd()][0]);
+	client.setKeepAlive(false);
+	client.getInput().clear();
+	queueErrorResponse(client, code);
+	sendResponse(client.getFd(), client);
+}
+
+/* resolve the virtual server and location for the parsed request, and keep-alive */
+void	Router::assignServer(Client &client)
+{
+	ALLOC_PHASE(ALLOC_PHASE_ROUTE);
+	const HTTPRequest	&request = client.getRequest();
+	const Server		&server = selectServer(client.getListenFd(), request);
+	string				target = request.getRequestTarget();
+
+	client.setServer(&server);
+	client.setLocation(server.matchLocation(target.substr(0, target.find('?'))));
+	const std::map<string, string> &headers = request.getHeaders();
+	std::map<string, string>::const_iterator it = headers.find("Connection");
+	if (request.getHttpVersion() == "HTTP/1.0")
+		client.setKeepAlive(it != headers.end() && it->second == "keep-alive");
+	else
+		client.setKeepAlive(it == headers.end() || it->second != "close");
+}
+
+/**
+ * Builds the response for a complete request into the client's OutputChain.
+ */
+void	Router::handleRequest(Client &client)
+{
+	const HTTPRequest	&request = client.getRequest();
+	const Server		&server = *client.getServer();
+	const Location		*location = client.getLocation();
+	const string		&method = request.getRequestMethod();
+
+	ALLOC_PHASE(ALLOC_PHASE_HANDLE);
+	client.markPhase(PHASE_HANDLER);
+	_watchdog.stage("handler");
+	if (location != NULL)
+		_watchdog.locate(location->getPath().c_str());
+	if (request.getHttpVersion() != "HTTP/1.1" && request.getHttpVersion() != "HTTP/1.0")
+		return (queueErrorResponse(client, 505));
+	if (location == NULL && !server.getLocations().empty())
+		return (queueErrorResponse(client, 404));
+	if (location != NULL && !location->getReturnResponse().empty())
+		return (queuePrebuilt(client, location->getReturnResponse()));
+	if (location != NULL && !location->getMethods().empty())
+	{
+		const string allowed[] = {"GET", "POST", "DELETE"};
+		bool found = false;
+		for (size_t i = 0; i < 3; ++i)
+		{
+			if ((method == allowed[i] || (method == "HEAD" && i == 0)) && location->getMethods()[i])
+				found = true;
+		}
+		if (!found)
+			return (queueErrorResponse(client, 405));
+	}
+	if (location != NULL && location->getMetrics())
+		return (serveMetrics(client));
+	if (location != NULL && (!location->getFastCgiPass().empty() || !location->_ext_path.empty()))
+		return (serveDynamic(client));
+	if (method == "GET" || method == "HEAD")
+		return (serveStatic(client));
+	queueErrorResponse(client, 501);
+}
+
+/**
+ * Front of CGI and FastCGI locations with cache_valid: a GET is answered from the
+ * microcache when a fresh entry exists, waits when an identical request is already
+ * running its script, and otherwise runs the script with its response captured.
+ */
+void	Router::serveDynamic(Client &client)
+{
+	const HTTPRequest	&request = client.getRequest();
+	const Location		&location = *client.getLocation();
+	time_t				now = WebServer::Clock::now();
+
+	if (location.getCacheValid().empty() || request.getRequestMethod() != "GET"
+		|| request.getHeaders().count("Authorization"))
+		return (runCgi(client));
+	string key = _cgi_cache.key(cacheBase(client), request);
+	const CgiCacheEntry *entry = _cgi_cache.lookup(key, now);
+	if (entry != NULL)
+	{
+		WS_DEBUG("Cache hit for %s", request.getRequestTarget().c_str());
+		return (queueCached(client, *entry, now));
+	}
+	if (!_cgi_cache.beginFill(key))
+	{
+		//the same response is being produced: wait for it instead of running the script again
+		_cgi_cache.wait(key, client.getFd());
+		_cache_waiting[client.getFd()] = key;
+		return (waitForCgi(client));
+	}
+	_cache_fills[client.getFd()] = key;
+	runCgi(client);
+}
+
+void	Router::runCgi(Client &client)
+{
+	if (!client.getLocation()->getFastCgiPass().empty())
+		return (startFastCgi(client));
+	startCgi(client);
+}
+
+/**
+ * Starts the script for a request to a CGI location and registers its pipes with
+ * the event loop. Files without a configured cgi_ext are served as static files.
+ */
+void	Router::startCgi(Client &client)
+{
+	const Location	&location = *client.getLocation();
+	string			target = client.getRequest().getRequestTarget();
+
+	target = target.substr(0, target.find('?'));
+	if (target.find("/..") != string::npos)
+		return (queueErrorResponse(client, 400));
+	//"/cgi-bin/x.py/extra" runs x.py, the rest is its PATH_INFO
+	for (size_t slash = target.find('/', 1); slash != string::npos; slash = target.find('/', slash + 1))
+	{
+		if (WebServer::Utils::getPathType(location.getRoot() + target.substr(0, slash)) == IS_FILE)
+		{
+			target.erase(slash);
+			break ;
+		}
+	}
+	string script = location.getRoot() + target;
+	if (WebServer::Utils::getPathType(script) == IS_DIRECTORY)
+		script += "/" + location.getIndex();
+	string interpreter = CgiHandler::getInterpreter(location, script);
+	if (interpreter.empty())
+	{
+		const string &method = client.getRequest().getRequestMethod();
+		if (method == "GET" || method == "HEAD")
+			return (serveStatic(client));
+		return (queueErrorResponse(client, 405));
+	}
+	if (WebServer::Utils::getPathType(script) != IS_FILE)
+		return (queueErrorResponse(client, 404));
+	std::map<string, CgiAdmission>::iterator admission = _cgi_admissions.find(location.getRoot() + location.getPath());
+	if (admission != _cgi_admissions.end() && !_cgi_slots.count(client.getFd()))
+	{
+		if (!admission->second.tryEnter())
+		{
+			if (!admission->second.enqueue(client.getFd(), WebServer::Clock::now()))
+				return (queuePrebuilt(client, location.getBusyResponse()));
+			//over cgi_max_concurrent: wait for a slot
+			_cgi_queued[client.getFd()] = &admission->second;
+			return (waitForCgi(client));
+		}
+		_cgi_slots[client.getFd()] = &admission->second;
+	}
+	std::map<std::pair<string, string>, CgiPool>::iterator pool = _cgi_pools.find(std::make_pair(location.getRoot() + location.getPath(), interpreter));
+	if (pool != _cgi_pools.end())
+		return (submitToPool(client, pool->second, script));
+	CgiHandler &cgi = _cgi_map[client.getFd()];
+	if (!cgi.start(client, script, interpreter))
+	{
+		WS_ERROR("webserv: cannot start CGI %s: %s", script.c_str(), strerror(errno));
+		_cgi_map.erase(client.getFd());
+		return (queueErrorResponse(client, 500));
+	}
+	WS_DEBUG("CGI %s started, pid %d", script.c_str(), cgi.getPid());
+	watchCgi(client, cgi);
+}
+
+/**
+ * Sends a request to a location's FastCGI upstream. The script path is only passed
+ * on as SCRIPT_FILENAME, the application server decides what it maps to.
+ */
+void	Router::startFastCgi(Client &client)
+{
+	const Location	&location = *client.getLocation();
+	string			target = client.getRequest().getRequestTarget();
+
+	target = target.substr(0, target.find('?'));
+	if (target.find("/..") != string::npos)
+		return (queueErrorResponse(client, 400));
+	submitToPool(client, _cgi_pools[std::make_pair(string("fastcgi_pass"), location.getFastCgiPass())], location.getRoot() + target);
+}
+
+/* run the request on a free worker, or queue it until one is released */
+void	Router::submitToPool(Client &client, CgiPool &pool, const string &script)
+{
+	bool	failed;
+	int		worker_fd = pool.acquire(failed);
+
+	if (worker_fd >= 0)
+		return (runPooledCgi(client, pool, script, worker_fd));
+	if (failed)
+		return (queueErrorResponse(client, 502));
+	//every worker is busy: wait for one
+	pool.queue(client.getFd(), script);
+	_cgi_waiting[client.getFd()] = &pool;
+	waitForCgi(client);
+}
+
+/**
+ * Gives back the admission slot held by a client's request, if any, and starts
+ * the requests waiting for one, oldest first.
+ */
+void	Router::releaseCgiSlot(int client_fd)
+{
+	std::map<int, CgiAdmission *>::iterator slot = _cgi_slots.find(client_fd);
+
+	if (slot == _cgi_slots.end())
+		return ;
+	CgiAdmission *admission = slot->second;
+	int waiting_fd;
+	admission->leave();
+	_cgi_slots.erase(slot);
+	while (admission->popWaiting(waiting_fd))
+	{
+		_cgi_queued.erase(waiting_fd);
+		_cgi_slots[waiting_fd] = admission;
+		Client &client = *_connections.client(waiting_fd);
+		startCgi(client);
+		if (!cgiBusy(waiting_fd))
+			sendResponse(waiting_fd, client);
+	}
+}
+
+/* answer requests that waited for a slot longer than cgi_queue's timeout with 503 */
+void	Router::expireCgiQueues(time_t now)
+{
+	std::vector<int> expired;
+
+	for (std::map<string, CgiAdmission>::iterator it = _cgi_admissions.begin(); it != _cgi_admissions.end(); ++it)
+		it->second.expire(now, expired);
+	for (size_t i = 0; i < expired.size(); ++i)
+	{
+		Client &client = *_connections.client(expired[i]);
+		_cgi_queued.erase(expired[i]);
+		WS_WARN("CGI queue timeout for client %d", expired[i]);
+		queuePrebuilt(client, client.getLocation()->getBusyResponse());
+		sendResponse(expired[i], client);
+	}
+}
+
+/* send a request to the pool worker behind worker_fd */
+void	Router::runPooledCgi(Client &client, CgiPool &pool, const string &script, int worker_fd)
+{
+	CgiHandler &cgi = _cgi_map[client.getFd()];
+
+	if (!cgi.startPooled(client, script, pool, worker_fd))
+	{
+		WS_ERROR("webserv: cannot start CGI %s: %s", script.c_str(), strerror(errno));
+		_cgi_map.erase(client.getFd());
+		pool.release(worker_fd, true);
+		return (queueErrorResponse(client, 500));
+	}
+	WS_DEBUG("CGI %s sent to pool worker %d", script.c_str(), worker_fd);
+	watchCgi(client, cgi);
+}
+
+/* hand workers freed up to the requests queued on the pool, oldest first */
+void	Router::dispatchPending(CgiPool &pool)
+{
+	int		client_fd;
+	string	script;
+
+	while (pool.getPendingCount() > 0)
+	{
+		bool failed;
+		int worker_fd = pool.acquire(failed);
+		if (worker_fd < 0 && !failed)
+			return ;
+		pool.popPending(client_fd, script);
+		_cgi_waiting.erase(client_fd);
+		Client &client = *_connections.client(client_fd);
+		if (worker_fd < 0)
+			queueErrorResponse(client, 502);
+		else
+			runPooledCgi(client, pool, script, worker_fd);
+		if (!_cgi_map.count(client_fd))
+			sendResponse(client_fd, client);
+	}
+}
+
+/* register a started script's descriptors with the event loop */
+void	Router::watchCgi(Client &client, CgiHandler &cgi)
+{
+	if (cgi.getStdinFd() >= 0)
+	{
+		_connections.setCgi(cgi.getStdinFd(), client.getFd());
+		_poller.add(cgi.getStdinFd(), POLL_WRITE);
+	}
+	_connections.setCgi(cgi.getStdoutFd(), client.getFd());
+	_poller.add(cgi.getStdoutFd(), POLL_READ);
+	cgi.setCapture(_cache_fills.count(client.getFd()) != 0);
+	client.startUpstreamTimer();
+	client.markPhase(PHASE_CGI_SPAWN);
+	waitForCgi(client);
+}
+
+/**
+ * The client's request is with a script or waiting for one. No further request is
+ * handled until this response is complete, but the socket stays in the read set
+ * so a client hanging up is noticed (see watchHangup()) and its CGI work cancelled.
+ */
+void	Router::waitForCgi(Client &client)
+{
+	client.setState(CLIENT_WRITING);
+	if (!_poller.watching(client.getFd(), POLL_READ))
+		_poller.add(client.getFd(), POLL_READ);
+}
+
+/* stream the request body into the script's stdin */
+void	Router::sendCgiBody(Client &client, CgiHandler &cgi)
+{
+	int stdin_fd = cgi.getStdinFd();
+
+	if (cgi.sendBody() < 0)
+		WS_INFO("CGI %d stopped reading its body", cgi.getPid());
+	client.updateTime();
+	if (cgi.getStdinFd() < 0)
+	{
+		_poller.remove(stdin_fd, POLL_WRITE);
+		_connections.clear(stdin_fd);
+	}
+}
+
+/**
+ * Relays what the script printed into the client's OutputChain and tries to send it
+ * right away. Reading pauses while the chain is above its high-water mark and
+ * resumes from sendResponse() once the client drained it.
+ */
+void	Router::readCgiResponse(Client &client, CgiHandler &cgi)
+{
+	int		client_fd = client.getFd();
+
+	if (cgi.canSplice())
+	{
+		if (client.getOutput().empty())
+			return (spliceCgiOutput(client, cgi));
+		//the buffered head goes first: wait until sendResponse() drained it
+		_poller.remove(cgi.getStdoutFd(), POLL_READ);
+		return ;
+	}
+	ssize_t	ret = cgi.readOutput(client);
+
+	if (ret == -1)
+		return ;
+	if (ret == -2 || (ret == 0 && !cgi.getHeadersDone()))
+	{
+		if (cgi.getPool() != NULL)
+			WS_ERROR("webserv: CGI worker %d of %s sent an invalid response",
+				cgi.getWorkerFd(), cgi.getPool()->getTarget().c_str());
+		else
+			WS_ERROR("webserv: CGI %d sent an invalid response", cgi.getPid());
+		closeCgi(client_fd, true);
+		queueErrorResponse(client, 502);
+		return (sendResponse(client_fd, client));
+	}
+	if (ret == 0)
+	{
+		cgi.finishOutput(client);
+		closeCgi(client_fd, false);
+		return (sendResponse(client_fd, client));
+	}
+	client.updateTime();
+	if (client.getOutput().aboveHighWater() && _poller.watching(cgi.getStdoutFd(), POLL_READ))
+		_poller.remove(cgi.getStdoutFd(), POLL_READ);
+	sendResponse(client_fd, client);
+}
+
+/**
+ * Moves the script's output from its pipe to the client socket with splice(), and
+ * waits on whichever side would block: the socket when it is full, the pipe when
+ * the script has not written more yet.
+ */
+void	Router::spliceCgiOutput(Client &client, CgiHandler &cgi)
+{
+	int		fd = client.getFd();
+	int		stdout_fd = cgi.getStdoutFd();
+	ssize_t	ret = cgi.spliceOutput(fd);
+
+	if (ret == CGI_SPLICE_ERROR)
+	{
+		WS_ERROR("webserv: splice error on socket %d: %s", fd, strerror(errno));
+		return (closeConnection(fd));
+	}
+	if (ret == 0)
+	{
+		closeCgi(fd, false);
+		return (sendResponse(fd, client));
+	}
+	if (ret > 0)
+	{
+		client.getOutput().addSentBytes(ret);
+		client.updateTime();
+	}
+	bool socket_full = (ret == CGI_SPLICE_SOCKET_FULL);
+	if (socket_full == (_poller.watching(stdout_fd, POLL_READ) != 0))
+	{
+		if (socket_full)
+			_poller.remove(stdout_fd, POLL_READ);
+		else
+			_poller.add(stdout_fd, POLL_READ);
+	}
+	if (socket_full != (_poller.watching(fd, POLL_WRITE) != 0))
+	{
+		if (socket_full)
+			_poller.add(fd, POLL_WRITE);
+		else
+			_poller.remove(fd, POLL_WRITE);
+	}
+}
+
+/* unregister a client's CGI pipes, optionally killing the script first */
+void	Router::closeCgi(int client_fd, bool kill_child)
+{
+	std::map<int, CgiHandler>::iterator it = _cgi_map.find(client_fd);
+
+	if (it == _cgi_map.end())
+		return ;
+	Client *client = _connections.client(client_fd);
+	if (client != NULL)
+		client->stopUpstreamTimer();
+	int fds[2] = {it->second.getStdinFd(), it->second.getStdoutFd()};
+	for (int i = 0; i < 2; ++i)
+	{
+		if (fds[i] < 0)
+			continue ;
+		if (_poller.watching(fds[i], POLL_READ))
+			_poller.remove(fds[i], POLL_READ);
+		if (_poller.watching(fds[i], POLL_WRITE))
+			_poller.remove(fds[i], POLL_WRITE);
+		_connections.clear(fds[i]);
+	}
+	if (kill_child)
+		it->second.kill();
+	else
+	{
+		it->second.closeStdin();
+		it->second.closeStdout();
+	}
+	CgiPool	*pool = it->second.getPool();
+	int		worker_fd = it->second.getWorkerFd();
+	bool	reusable = !kill_child && it->second.getWorkerDone();
+	bool	stored = !kill_child && client != NULL && it->second.getCapture() && storeCgiResponse(*client, it->second);
+	_cgi_map.erase(it);
+	if (pool != NULL)
+	{
+		pool->release(worker_fd, reusable);
+		dispatchPending(*pool);
+	}
+	releaseCgiSlot(client_fd);
+	//a killed script's fill ends with the 502/504 sent instead, or with the connection
+	if (!kill_child && _cache_fills.count(client_fd))
+		finishCacheFill(client_fd, stored);
+}
+
+//the client has a script running, or waits for a worker, a slot or another request's script
+bool	Router::cgiBusy(int client_fd) const
+{
+	return (_cgi_map.count(client_fd) || _cgi_waiting.count(client_fd) || _cgi_queued.count(client_fd)
+		|| _cache_waiting.count(client_fd));
+}
+
+/* put a completed script response in the microcache if its status and headers allow it */
+bool	Router::storeCgiResponse(Client &client, const CgiHandler &cgi)
+{
+	const std::vector<std::pair<string, string> >	&headers = cgi.getHeaders();
+	std::vector<string>								vary;
+	CgiCacheEntry									entry;
+	time_t											ttl;
+
+	ttl = CgiCache::lifetime(cgi.getStatus(), headers, client.getLocation()->getCacheValid(), vary);
+	if (ttl <= 0)
+		return (false);
+	entry.status = cgi.getStatus();
+	for (size_t i = 0; i < headers.size(); ++i)
+	{
+		string name = headers[i].first;
+		for (size_t j = 0; j < name.size(); ++j)
+			name[j] = std::tolower(name[j]);
+		//a script that died early must not leave a truncated body behind
+		if (name == "content-length" && std::strtoul(headers[i].second.c_str(), NULL, 10) != cgi.getCaptured().size())
+			return (false);
+		if (name == "content-length" || name == "transfer-encoding" || name == "connection" || name == "keep-alive")
+			continue ;
+		entry.headers += headers[i].first + ": " + headers[i].second + CRLF;
+	}
+	entry.body = cgi.getCaptured();
+	entry.stored = WebServer::Clock::now();
+	entry.expires = entry.stored + ttl;
+	return (_cgi_cache.store(cacheBase(client), client.getRequest(), entry, vary));
+}
+
+//microcache key of a request before Vary: server, location root, method and target
+string	Router::cacheBase(const Client &client) const
+{
+	return (client.getServer()->getServerName() + "|" + client.getLocation()->getRoot() + "|"
+		+ client.getRequest().getRequestMethod() + " " + client.getRequest().getRequestTarget());
+}
+
+/**
+ * The request filling a microcache key is done. The requests that waited for it
+ * look the cache up again if lookup_again is set (the response was stored, or the
+ * filler went away and the first waiter takes over its fill), and run their own
+ * script otherwise, when the response turned out not to be cacheable.
+ */
+void	Router::finishCacheFill(int client_fd, bool lookup_again)
+{
+	std::vector<int>	waiters;
+
+	_cgi_cache.endFill(_cache_fills[client_fd], waiters);
+	_cache_fills.erase(client_fd);
+	for (size_t i = 0; i < waiters.size(); ++i)
+	{
+		Client &client = *_connections.client(waiters[i]);
+		_cache_waiting.erase(waiters[i]);
+		if (lookup_again)
+			serveDynamic(client);
+		else
+			runCgi(client);
+		if (!cgiBusy(waiters[i]))
+			sendResponse(waiters[i], client);
+	}
+}
+
+/**
+ * Serves a file under the location (or server) root. The file is queued as a
+ * file region, so it is sent with sendfile() as the socket drains instead of
+ * being read into memory.
+ */
+void	Router::serveStatic(Client &client)
+{
+	const Server		&server = *client.getServer();
+	const Location		*location = client.getLocation();
+	string				target = client.getRequest().getRequestTarget();
+	string				root = location ? location->getRoot() : server.getRoot();
+	string				index = location ? location->getIndex() : server.getIndex();
+
+	target = target.substr(0, target.find('?'));
+	if (target.empty() || target[0] != '/' || target.find("/..") != string::npos)
+		return (queueErrorResponse(client, 400));
+	string path = root + target;
+	if (WebServer::Utils::getPathType(path) == IS_DIRECTORY)
+		path += "/" + index;
+	int file_fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (file_fd < 0)
+		return (queueErrorResponse(client, errno == EACCES ? 403 : 404));
+	struct stat file_stat;
+	if (fstat(file_fd, &file_stat) < 0 || !S_ISREG(file_stat.st_mode))
+	{
+		close(file_fd);
+		return (queueErrorResponse(client, 404));
+	}
+	std::map<string, string>	headers;
+	std::stringstream			ss;
+	ss << file_stat.st_size;
+	headers["Content-Type"] = WebServer::Utils::getMimeType(path);
+	headers["Content-Length"] = ss.str();
+	queueHeaders(client, 200, headers);
+	if (client.getRequest().getRequestMethod() == "HEAD")
+		close(file_fd);
+	else
+		client.getOutput().appendFile(file_fd, 0, file_stat.st_size, true);
+}
+
+/**
+ * Answers a request to a `metrics on` location with the server's counters: text
+ * by default, Prometheus exposition format for ?format=prometheus or a scraper's
+ * Accept header. Connection states are counted here, only when asked for.
+ */
+void	Router::serveMetrics(Client &client)
+{
+	const HTTPRequest				&request = client.getRequest();
+	const std::map<string, string>	&headers = request.getHeaders();
+	std::map<string, string>::const_iterator accept = headers.find("Accept");
+	ConnectionCounts				connections = {0, 0, 0};
+	std::map<string, string>		response_headers;
+	std::stringstream				ss;
+	string							body;
+
+	if (request.getRequestMethod() != "GET" && request.getRequestMethod() != "HEAD")
+		return (queueErrorResponse(client, 405));
+	for (size_t i = 0; i < _connections.activeCount(); ++i)
+	{
+		Client *other = _connections.active(i);
+		if (other->getState() == CLIENT_WRITING || other == &client)
+			++connections.writing;
+		else if (other->getState() == CLIENT_READING_BODY || !other->getInput().empty())
+			++connections.reading;
+		else
+			++connections.idle;
+	}
+	bool prometheus = request.getRequestTarget().find("format=prometheus") != string::npos
+		|| (accept != headers.end() && accept->second.find("version=0.0.4") != string::npos);
+	body = prometheus ? _metrics.renderPrometheus(connections) : _metrics.renderText(connections);
+	ss << body.size();
+	response_headers["Content-Type"] = prometheus ? "text/plain; version=0.0.4; charset=utf-8" : "text/plain";
+	response_headers["Content-Length"] = ss.str();
+	response_headers["Cache-Control"] = "no-store";
+	queueHeaders(client, 200, response_headers);
+	if (request.getRequestMethod() != "HEAD")
+		client.getOutput().appendMemory(body);
+}
+
+/**
+ * Flushes as much of the client's OutputChain as the socket takes. The client stays
+ * in the write set while the chain is not empty; once it is, the connection either
+ * closes or goes back to reading the next request.
+ */
+void	Router::sendResponse(const int &fd, Client &client)
+{
+	ALLOC_PHASE(ALLOC_PHASE_RESPOND);
+	_watchdog.stage("write");
+	FlushStatus status = client.getOutput().flush(fd);
+
+	if (status == FLUSH_ERROR)
+	{
+		WS_WARN("webserv: send error on socket %d: %s", fd, strerror(errno));
+		closeConnection(fd);
+		return ;
+	}
+	client.updateTime();
+	if (client.getOutput().getSentBytes() > 0)
+		client.markPhase(PHASE_RESPONSE_START);
+	std::map<int, CgiHandler>::iterator cgi = _cgi_map.find(fd);
+	//past the buffered head, the rest of the body is spliced once the chain is empty
+	if (cgi != _cgi_map.end() && cgi->second.canSplice())
+	{
+		if (status == FLUSH_DONE)
+			return (spliceCgiOutput(client, cgi->second));
+	}
+	//the chain drained enough: let a paused script write again
+	else if (cgi != _cgi_map.end() && cgi->second.getStdoutFd() >= 0 && client.getOutput().belowLowWater()
+		&& !_poller.watching(cgi->second.getStdoutFd(), POLL_READ))
+		_poller.add(cgi->second.getStdoutFd(), POLL_READ);
+	if (status == FLUSH_AGAIN)
+	{
+		client.setState(CLIENT_WRITING);
+		if (_poller.watching(fd, POLL_READ))
+			_poller.remove(fd, POLL_READ);
+		if (!_poller.watching(fd, POLL_WRITE))
+			_poller.add(fd, POLL_WRITE);
+		return ;
+	}
+	//everything queued is sent but the script is still running (or waiting for a worker, a slot or a cache fill)
+	if (cgiBusy(fd))
+	{
+		if (_poller.watching(fd, POLL_WRITE))
+			_poller.remove(fd, POLL_WRITE);
+		return (waitForCgi(client));
+	}
+	WS_DEBUG("------------------Response sent-------------------%lu\n", client.getOutput().getSentBytes());
+	client.markPhase(PHASE_RESPONSE_END);
+	logRequest(client);
+	releaseCgiSlot(fd);
+	//the request filling a cache entry got an answer without running its script
+	if (_cache_fills.count(fd))
+		finishCacheFill(fd, false);
+	if (!client.getKeepAlive())
+	{
+		closeConnection(fd);
+		return ;
+	}
+	if (_poller.watching(fd, POLL_WRITE))
+		_poller.remove(fd, POLL_WRITE);
+	if (!_poller.watching(fd, POLL_READ))
+		_poller.add(fd, POLL_READ);
+	client.resetRequest();
+	//a pipelined request may already be waiting in the buffer
+	if (!client.getInput().empty())
+		parseRequest(client);
+}
+
+/**
+ * close connections that stayed silent longer than CONNECTION_TIMEOUT, kill
+ * scripts running longer than CGI_TIMEOUT (504 if they did not answer yet), and
+ * turn away requests that waited too long for a CGI slot (503)
+ */
+void	Router::checkTimeout()
+{
+	std::vector<int>	expired;
+	time_t				now = WebServer::Clock::now();
+
+	for (std::map<int, CgiHandler>::const_iterator it = _cgi_map.begin(); it != _cgi_map.end(); ++it)
+	{
+		if (now - it->second.getStartTime() > CGI_TIMEOUT)
+			expired.push_back(it->first);
+	}
+	for (size_t i = 0; i < expired.size(); ++i)
+	{
+		Client &client = *_connections.client(expired[i]);
+		bool answered = _cgi_map[expired[i]].getHeadersDone();
+		WS_WARN("CGI for client %d timed out, killing it", expired[i]);
+		closeCgi(expired[i], true);
+		if (answered)
+			closeConnection(expired[i]);
+		else
+		{
+			client.setKeepAlive(false);
+			queueErrorResponse(client, 504);
+			sendResponse(expired[i], client);
+		}
+	}
+	expired.clear();
+	for (std::map<std::pair<string, string>, CgiPool>::iterator it = _cgi_pools.begin(); it != _cgi_pools.end(); ++it)
+		it->second.maintain(now);
+	expireCgiQueues(now);
+	_cgi_cache.expire(now);
+	bool reopen = AccessLog::reopenRequested();
+	for (std::map<string, AccessLog>::iterator it = _access_logs.begin(); it != _access_logs.end(); ++it)
+	{
+		if (reopen && !it->second.reopen())
+			WS_ERROR("webserv: cannot reopen access_log %s: %s", it->first.c_str(), strerror(errno));
+		it->second.tick(now);
+	}
+	_trace.tick(now);
+
+	for (size_t i = 0; i < _connections.activeCount(); ++i)
+	{
+		if (now - _connections.active(i)->getLastActivity() > CONNECTION_TIMEOUT)
+			expired.push_back(_connections.active(i)->getFd());
+	}
+	for (size_t i = 0; i < expired.size(); ++i)
+	{
+		WS_INFO("Client %d Timeout, Closing Connection..", expired[i]);
+		closeConnection(expired[i]);
+	}
+}
+
+/* close a client socket and forget the client, killing its script or dropping it from CGI queues */
+void	Router::closeConnection(const int fd)
+{
+	std::map<int, CgiPool *>::iterator waiting = _cgi_waiting.find(fd);
+	if (waiting != _cgi_waiting.end())
+	{
+		waiting->second->dropPending(fd);
+		_cgi_waiting.erase(waiting);
+	}
+	std::map<int, CgiAdmission *>::iterator queued = _cgi_queued.find(fd);
+	if (queued != _cgi_queued.end())
+	{
+		queued->second->drop(fd);
+		_cgi_queued.erase(queued);
+	}
+	std::map<int, string>::iterator cached = _cache_waiting.find(fd);
+	if (cached != _cache_waiting.end())
+	{
+		_cgi_cache.dropWaiter(cached->second, fd);
+		_cache_waiting.erase(cached);
+	}
+	closeCgi(fd, true);
+	releaseCgiSlot(fd);
+	if (_cache_fills.count(fd))
+		finishCacheFill(fd, true);
+	if (_poller.watching(fd, POLL_WRITE))
+		_poller.remove(fd, POLL_WRITE);
+	if (_poller.watching(fd, POLL_READ))
+		_poller.remove(fd, POLL_READ);
+	close(fd);
+	_trace.closed(fd);
+	Client *client = _connections.client(fd);
+	if (client != NULL)
+		WebServer::AllocStats::detach(&client->getAllocs());
+	_connections.close(fd);
+}
+
+/**
+ * Picks the virtual server for a request: the server on listen_fd whose server_name
+ * matches the Host header, or the first server bound to that socket.
+ */
+const Server	&Router::selectServer(int listen_fd, const HTTPRequest &request)
+{
+	return (matchServer(fds_to_servers[listen_fd], request));
+}
+
+//the server whose server_name matches the Host header, else the first: servers must not be empty
+const Server	&Router::matchServer(const std::vector<Server> &servers, const HTTPRequest &request)
+{
+	const std::map<string, string> &headers = request.getHeaders();
+	std::map<string, string>::const_iterator it = headers.find("Host");
+
+	if (it != headers.end())
+	{
+		string host = it->second.substr(0, it->second.find(':'));
+		for (size_t i = 0; i < servers.size(); ++i)
+		{
+			if (servers[i].getServerName() == host)
+				return (servers[i]);
+		}
+	}
+	return (servers[0]);
+}
+
+/* queue the error response pre-rendered at config load, or a generated one if the code has none */
+void	Router::queueErrorResponse(Client &client, short code)
+{
+	const Server	*server = client.getServer();
+	const string	*response = server ? server->getErrorResponse(code) : NULL;
+
+	client.getOutput().clear();
+	if (response != NULL)
+		return (queuePrebuilt(client, *response));
+	std::map<string, string>	headers;
+	string						body = HTTPResponse::defaultErrorBody(code);
+	std::stringstream			ss;
+
+	ss << body.size();
+	headers["Content-Type"] = "text/html";
+	headers["Content-Length"] = ss.str();
+	queueHeaders(client, code, headers);
+	if (client.getRequest().getRequestMethod() != "HEAD")
+		client.getOutput().appendMemory(body);
+}
+
+/**
+ * Queues a response rendered ahead of time without copying it: the cached Date
+ * header (and Connection: close when needed) is queued right after the status
+ * line, and the whole response still goes out in a single writev(). A HEAD
+ * request gets the header block only.
+ */
+void	Router::queuePrebuilt(Client &client, const string &response)
+{
+	size_t			status_end = response.find(CRLF) + 2;
+	size_t			end = response.size();
+	OutputChain		&output = client.getOutput();
+
+	if (client.getRequest().getRequestMethod() == "HEAD")
+		end = response.find(FIELD_LINE_SEPARATOR) + 4;
+
+	//"HTTP/1.1 503 ..."
+	client.setStatus(std::atoi(response.c_str() + 9));
+	output.appendSlice(response.data(), status_end);
+	output.appendMemory(WebServer::Clock::dateHeader());
+	if (!client.getKeepAlive())
+		output.appendMemory("Connection: close\r\n");
+	output.appendSlice(response.data() + status_end, end - status_end);
+}
+
+/* replay a microcache entry with a fresh Date and Age */
+void	Router::queueCached(Client &client, const CgiCacheEntry &entry, time_t now)
+{
+	OutputChain			&output = client.getOutput();
+	size_t				status_len;
+	const char			*status_line = WebServer::Utils::statusLine(entry.status, status_len);
+	std::stringstream	block;
+
+	client.setStatus(entry.status);
+	if (status_line != NULL)
+		output.appendSlice(status_line, status_len);
+	else
+		output.appendMemory(HTTPResponse(entry.status).getStarline() + CRLF);
+	block << WebServer::Clock::dateHeader() << "Server: webserv" << CRLF << entry.headers
+		<< "Age: " << (now - entry.stored) << CRLF;
+	if (entry.status != 204 && entry.status != 304)
+		block << "Content-Length: " << entry.body.size() << CRLF;
+	if (!client.getKeepAlive())
+		block << "Connection: close" << CRLF;
+	block << CRLF;
+	output.appendMemory(block.str());
+	//copied: the entry may expire while the response is still being sent
+	output.appendMemory(entry.body);
+}
+
+//copies len bytes to dst, returns the end of the copy
+static char	*putBytes(char *dst, const char *src, size_t len)
+{
+	memcpy(dst, src, len);
+	return (dst + len);
+}
+
+/* queue status line and header block of a response built at request time */
+void	Router::queueHeaders(Client &client, short code, const std::map<string, string> &headers)
+{
+	static const char	server[] = "Server: webserv\r\n";
+	static const char	close_header[] = "Connection: close\r\n";
+	OutputChain			&output = client.getOutput();
+	size_t				status_len;
+	const char			*status_line = WebServer::Utils::statusLine(code, status_len);
+	const string		&date = WebServer::Clock::dateHeader();
+	size_t				len = date.size() + sizeof(server) - 1 + 2;
+
+	client.setStatus(code);
+	if (status_line != NULL)
+		output.appendSlice(status_line, status_len);
+	else
+		output.appendMemory(HTTPResponse(code).getStarline() + CRLF);
+	if (!client.getKeepAlive())
+		len += sizeof(close_header) - 1;
+	for (std::map<string, string>::const_iterator it = headers.begin(); it != headers.end(); ++it)
+		len += it->first.size() + 2 + it->second.size() + 2;
+	//rendered in the request's arena, which outlives the response
+	char *block = static_cast<char *>(client.getArena().allocate(len));
+	char *end = putBytes(block, date.data(), date.size());
+	end = putBytes(end, server, sizeof(server) - 1);
+	if (!client.getKeepAlive())
+		end = putBytes(end, close_header, sizeof(close_header) - 1);
+	for (std::map<string, string>::const_iterator it = headers.begin(); it != headers.end(); ++it)
+	{
+		end = putBytes(end, it->first.data(), it->first.size());
+		end = putBytes(end, ": ", 2);
+		end = putBytes(end, it->second.data(), it->second.size());
+		end = putBytes(end, CRLF, 2);
+	}
+	putBytes(end, CRLF, 2);
+	output.appendSlice(block, len);
+}
+
+/* open the EventPoller, raise the open file limit and watch all server listening sockets. */
 void	Router::initialiseSets()
 {
-	//FD_ZERO must be called before using fd_set to avoid undefined behaviour
-	//ensure the set is empty and is ready to have fd added with FD_SET
-	//FD_SET add a fd to the set
-	//FD_ISSET check if a fd is in the set
-	//FD_CLR remove a fd from the set.
-	FD_ZERO(&_recv_fd_pool);
-	FD_ZERO(&_write_fd_pool);
-	WebServer::Logger *logManager = WebServer::Logger::getInstance();
+	struct rlimit	limit;
+
+	if (!_poller.open())
+	{
+		WS_ERROR("webserv: epoll_create error: %s   Closing....", strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+	//every connection is an fd: take all the descriptors the hard limit allows, up to
+	//CONNECTION_TABLE_MAX (a hard limit of "infinity" is about 2^30)
+	if (getrlimit(RLIMIT_NOFILE, &limit) == 0)
+	{
+		rlim_t wanted = std::min(limit.rlim_max, static_cast<rlim_t>(CONNECTION_TABLE_MAX));
+		if (limit.rlim_cur != wanted)
+		{
+			limit.rlim_cur = wanted;
+			setrlimit(RLIMIT_NOFILE, &limit);
+		}
+	}
+	if (getrlimit(RLIMIT_NOFILE, &limit) != 0)
+		limit.rlim_cur = FD_SETSIZE;
+	limit.rlim_cur = std::min(limit.rlim_cur, static_cast<rlim_t>(CONNECTION_TABLE_MAX));
+	WS_INFO("webserv: up to %lu open files", static_cast<unsigned long>(limit.rlim_cur));
+	//every fd the process can get has an entry: the pages of unused ones are never touched
+	if (!_connections.allocate(limit.rlim_cur))
+	{
+		WS_ERROR("webserv: cannot allocate the connection table for %lu fds   Closing....",
+			static_cast<unsigned long>(limit.rlim_cur));
+		exit(EXIT_FAILURE);
+	}
 
 	//listen() prepares a socket to accept incoming connections from clients
 	//int listen(int fd, int backlog)
@@ -201,40 +1328,161 @@ void	Router::initialiseSets()
 	//backlog is the maximum number of pending connections that can be in
 	//the socket's listen queue. If backlog is full, additional incoming connections
 	//are refused until space is available. Returns 0 on success, -1 if fail
-	for (std::map<int, std::vector<Server> >::const_iterator it = fds_to_servers_map.begin();
-	it != fds_to_servers_map.end(); ++it)
+	for (size_t i = 0; i < _listen_fds.size(); ++i)
 	{
-		if (listen(it->first, 512) == -1)
+		if (listen(_listen_fds[i], 512) == -1)
 		{
-			logManager->logMsg(RED, "webserv: listen error: %s   Closing....", strerror(errno));
+			WS_ERROR("webserv: listen error: %s   Closing....", strerror(errno));
 			exit(EXIT_FAILURE);
 		}
-		/*
-		if (fcntl(it->first, F_SETFL, O_NONBLOCK) < 0)
+		if (fcntl(_listen_fds[i], F_SETFL, O_NONBLOCK) < 0)
 		{
-			logManager->logMsg(RED, "webserv: fcntl error: %s   Closing....", strerror(errno));
+			WS_ERROR("webserv: fcntl error: %s   Closing....", strerror(errno));
 			exit(EXIT_FAILURE);
 		}
-		*/
-		addToFdSet(it->first, _recv_fd_pool);
-		_biggest_fd = it->first;
+		_connections.setListen(_listen_fds[i]);
+		_poller.add(_listen_fds[i], POLL_READ);
 	}
+	//exited CGI children are reported through a self-pipe watched like any other fd
+	CgiHandler::initSignalPipe();
+	_poller.add(CgiHandler::getSignalFd(), POLL_READ);
+	startCgiPools();
+	initCgiAdmissions();
+	openAccessLogs();
 }
 
-// add fd to set and update biggest fd if needed
-void	Router::addToFdSet(const int i, fd_set &set)
+void	Router::setSampling(const SampleConfig &config)
 {
-	FD_SET(i, &set);
-	if (i > _biggest_fd)
-		_biggest_fd = i;
+	_sampler = RequestSampler(config);
 }
 
-//remove fd from set and update biggest fd if needed
-void	Router::removeFromFdSet(const int i, fd_set &set)
+void	Router::setTracing(const TraceConfig &config)
 {
-	FD_CLR(i, &set);
-	if (i == _biggest_fd)
-		_biggest_fd--;
+	if (!config.path.empty() && !_trace.open(config))
+	{
+		WS_ERROR("webserv: cannot open request_trace %s: %s   Closing....", config.path.c_str(), strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+}
+
+void	Router::setStallThreshold(long threshold)
+{
+	if (!_watchdog.start(threshold))
+		WS_WARN("webserv: cannot start the stall watchdog: %s", strerror(errno));
+}
+
+/* one open file per access_log path, shared by the server blocks (and their copies) naming it */
+void	Router::openAccessLogs()
+{
+	for (size_t i = 0; i < _servers.size(); ++i)
+	{
+		const AccessLogConfig &config = _servers[i].getAccessLog();
+		if (config.path.empty() || _access_logs.count(config.path))
+			continue ;
+		AccessLog &log = _access_logs[config.path] = AccessLog(config);
+		if (!log.open())
+		{
+			WS_ERROR("webserv: cannot open access_log %s: %s   Closing....", config.path.c_str(), strerror(errno));
+			exit(EXIT_FAILURE);
+		}
+	}
+}
+
+/* close the watchdog's bracket around an event loop callback, reporting it if it stalled the loop */
+void	Router::endCallback()
+{
+	long elapsed = _watchdog.end();
+
+	WebServer::AllocStats::attach(NULL);
+	if (elapsed > 0)
+		reportStall(_watchdog.getCallback(), _watchdog.getStage(), _watchdog.getFd(), _watchdog.getLocation(),
+			elapsed, _watchdog.getBacktrace());
+}
+
+void	Router::reportStall(const char *callback, const char *stage, int fd, const char *location, long elapsed,
+	const string &trace)
+{
+	WS_WARN("webserv: event loop stalled %.1f ms in %s (%s) on fd %d, location %s%s", elapsed / 1000.0, callback,
+		stage, fd, location ? location : "-", trace.c_str());
+	_metrics.stalled(callback, elapsed);
+}
+
+/**
+ * Record the request client just completed: in the metrics, in its server's
+ * access log if it has one, and with the sampler.
+ */
+void	Router::logRequest(Client &client)
+{
+	const Server *server = client.getServer();
+
+	if (server == NULL)
+		server = &fds_to_servers[client.getListenFd()][0];
+	_metrics.completed(server->getServerName(), client.getLocation() ? client.getLocation()->getPath() : "",
+		client.getStatus(), client.getOutput().getSentBytes(),
+		client.getRequestStart() ? WebServer::Clock::monotonicUsec() - client.getRequestStart() : 0, client.getAllocs());
+	_sampler.sample(client, server->getServerName());
+	_trace.record(client, server->getServerName());
+	if (server->getAccessLog().path.empty())
+		return ;
+	std::map<string, AccessLog>::iterator log = _access_logs.find(server->getAccessLog().path);
+	if (log != _access_logs.end())
+		log->second.log(client, server->getServerName());
+}
+
+/* admission state for every location limiting its running scripts, shared by server copies */
+void	Router::initCgiAdmissions()
+{
+	for (size_t i = 0; i < _servers.size(); ++i)
+	{
+		const std::vector<Location> &locations = _servers[i].getLocations();
+		for (size_t j = 0; j < locations.size(); ++j)
+		{
+			string key = locations[j].getRoot() + locations[j].getPath();
+			if (locations[j].getCgiMaxConcurrent() > 0 && !_cgi_admissions.count(key))
+				_cgi_admissions[key] = CgiAdmission(locations[j].getCgiMaxConcurrent(),
+					locations[j].getCgiQueueSize(), locations[j].getCgiQueueTimeout());
+		}
+	}
+}
+
+/**
+ * One worker pool per cgi_pool location and interpreter that has a worker bootstrap,
+ * and one connection pool per fastcgi_pass address.
+ * Servers are copied per listening socket, so pools are keyed by what the location
+ * serves (root and path) rather than by its address; copies share their workers.
+ */
+void	Router::startCgiPools()
+{
+	for (size_t i = 0; i < _servers.size(); ++i)
+	{
+		const std::vector<Location> &locations = _servers[i].getLocations();
+		for (size_t j = 0; j < locations.size(); ++j)
+		{
+			if (!locations[j].getFastCgiPass().empty())
+			{
+				std::pair<string, string> key("fastcgi_pass", locations[j].getFastCgiPass());
+				if (_cgi_pools.count(key))
+					continue ;
+				CgiPoolConfig upstream;
+				upstream.workers = 0;
+				upstream.max_workers = locations[j].getFastCgiMaxConns();
+				upstream.max_requests = static_cast<size_t>(-1);
+				upstream.idle_timeout = CONNECTION_TIMEOUT;
+				_cgi_pools[key] = CgiPool(locations[j].getFastCgiPass(), upstream, CGI_POOL_FASTCGI);
+				_cgi_pools[key].start();
+			}
+			if (locations[j].getCgiPool().workers == 0)
+				continue ;
+			for (std::map<string, string>::const_iterator it = locations[j]._ext_path.begin(); it != locations[j]._ext_path.end(); ++it)
+			{
+				std::pair<string, string> key(locations[j].getRoot() + locations[j].getPath(), it->second);
+				if (!CgiPool::supports(it->second) || _cgi_pools.count(key))
+					continue ;
+				_cgi_pools[key] = CgiPool(it->second, locations[j].getCgiPool());
+				_cgi_pools[key].start();
+			}
+		}
+	}
 }
 
 // print Router details
@@ -243,10 +1491,11 @@ void	Router::printRouterDetails()
 	for(size_t i = 0; i < this->_servers.size(); ++i)
 		this->_servers[i].printServerDetails();
 
-	for (std::map<int, std::vector<Server> >::const_iterator it = fds_to_servers_map.begin(); it != fds_to_servers_map.end(); ++it)
+	for (size_t i = 0; i < _listen_fds.size(); ++i)
 	{
-    	std::cout << "Fd: " << it->first << std::endl;
-    	for (std::vector<Server>::const_iterator vec_it = it->second.begin(); vec_it != it->second.end(); ++vec_it)
+    	std::cout << "Fd: " << _listen_fds[i] << std::endl;
+		const std::vector<Server> &servers = fds_to_servers[_listen_fds[i]];
+    	for (std::vector<Server>::const_iterator vec_it = servers.begin(); vec_it != servers.end(); ++vec_it)
         	std::cout << vec_it->getServerName() << std::endl;
 	}
 }
\ No newline at end of file
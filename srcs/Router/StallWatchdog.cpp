@@ -0,0 +1,203 @@
+#include "../../includes/Router/StallWatchdog.hpp"
+#include "../../includes/Utils/Clock.hpp"
+#include "../../includes/Utils/AllocStats.hpp"
+#include <execinfo.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+
+void					*StallWatchdog::_stack[WATCHDOG_FRAMES];
+volatile int			StallWatchdog::_frames = 0;
+const char				*volatile StallWatchdog::_stack_stage = NULL;
+volatile unsigned long	StallWatchdog::_stack_generation = 0;
+StallWatchdog			*StallWatchdog::_instance = NULL;
+
+StallWatchdog::StallWatchdog(): _threshold(0), _running(0), _started(0), _generation(0), _signalled(0),
+	_callback(""), _stage(""), _location(NULL), _fd(-1), _iteration_start(0), _stalled(false) {}
+
+StallWatchdog::~StallWatchdog()
+{
+	stop();
+}
+
+/**
+ * Starts watching the calling thread, which must be the event loop's. Returns
+ * false (and leaves the watchdog off) if the watcher thread cannot be created.
+ */
+bool StallWatchdog::start(long threshold)
+{
+	struct sigaction	action;
+	sigset_t			all;
+	sigset_t			previous;
+
+	if (threshold <= 0)
+		return (true);
+	//backtrace() loads its unwinder on first use: do it now rather than in the handler
+	backtrace(_stack, WATCHDOG_FRAMES);
+	_instance = this;
+	this->_loop_thread = pthread_self();
+	sigemptyset(&action.sa_mask);
+	action.sa_flags = SA_RESTART;
+	action.sa_handler = &StallWatchdog::_capture;
+	sigaction(SIGUSR2, &action, NULL);
+	this->_threshold = threshold;
+	__atomic_store_n(&this->_running, 1, __ATOMIC_SEQ_CST);
+	//signals stay with the main thread: the watcher starts with all of them blocked
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &previous);
+	int err = pthread_create(&this->_thread, NULL, &StallWatchdog::_watch, this);
+	pthread_sigmask(SIG_SETMASK, &previous, NULL);
+	if (err != 0)
+	{
+		__atomic_store_n(&this->_running, 0, __ATOMIC_SEQ_CST);
+		this->_threshold = 0;
+		return (false);
+	}
+	return (true);
+}
+
+void StallWatchdog::stop()
+{
+	if (!__atomic_load_n(&this->_running, __ATOMIC_SEQ_CST))
+		return ;
+	__atomic_store_n(&this->_running, 0, __ATOMIC_SEQ_CST);
+	pthread_join(this->_thread, NULL);
+	this->_threshold = 0;
+}
+
+bool StallWatchdog::enabled() const
+{
+	return (this->_threshold > 0);
+}
+
+//watcher thread: signal the loop once per callback that runs past the threshold
+void *StallWatchdog::_watch(void *arg)
+{
+	StallWatchdog	*self = static_cast<StallWatchdog *>(arg);
+	struct timespec	pause;
+
+	WebServer::AllocStats::nameThread("watchdog");
+	pause.tv_sec = self->_threshold / 2 / 1000000;
+	pause.tv_nsec = (self->_threshold / 2 % 1000000) * 1000;
+	while (__atomic_load_n(&self->_running, __ATOMIC_ACQUIRE))
+	{
+		nanosleep(&pause, NULL);
+		long started = __atomic_load_n(&self->_started, __ATOMIC_ACQUIRE);
+		unsigned long generation = __atomic_load_n(&self->_generation, __ATOMIC_ACQUIRE);
+		if (started == 0 || generation == self->_signalled
+			|| WebServer::Clock::monotonicUsec() - started <= self->_threshold)
+			continue ;
+		self->_signalled = generation;
+		pthread_kill(self->_loop_thread, SIGUSR2);
+	}
+	return (NULL);
+}
+
+//runs on the loop thread while it is stuck: keep where it is
+void StallWatchdog::_capture(int sig)
+{
+	(void)sig;
+	if (_instance == NULL)
+		return ;
+	_frames = backtrace(_stack, WATCHDOG_FRAMES);
+	_stack_stage = _instance->_stage;
+	_stack_generation = __atomic_load_n(&_instance->_generation, __ATOMIC_RELAXED);
+}
+
+void StallWatchdog::beginIteration()
+{
+	if (this->_threshold == 0)
+		return ;
+	this->_iteration_start = WebServer::Clock::monotonicUsec();
+	this->_stalled = false;
+}
+
+//usec the iteration took if it went past the threshold without a stalled callback, else 0
+long StallWatchdog::endIteration()
+{
+	if (this->_threshold == 0)
+		return (0);
+	long elapsed = WebServer::Clock::monotonicUsec() - this->_iteration_start;
+	return ((elapsed > this->_threshold && !this->_stalled) ? elapsed : 0);
+}
+
+void StallWatchdog::begin(const char *callback, int fd)
+{
+	if (this->_threshold == 0)
+		return ;
+	this->_callback = callback;
+	this->_stage = callback;
+	this->_location = NULL;
+	this->_fd = fd;
+	__atomic_add_fetch(&this->_generation, 1, __ATOMIC_RELEASE);
+	__atomic_store_n(&this->_started, WebServer::Clock::monotonicUsec(), __ATOMIC_RELEASE);
+}
+
+//what the current callback is doing now (parse, handler, ...)
+void StallWatchdog::stage(const char *stage)
+{
+	this->_stage = stage;
+}
+
+//location must outlive the callback: the Router passes its config's path
+void StallWatchdog::locate(const char *location)
+{
+	this->_location = location;
+}
+
+//usec the callback took if it went past the threshold, else 0
+long StallWatchdog::end()
+{
+	if (this->_threshold == 0)
+		return (0);
+	long elapsed = WebServer::Clock::monotonicUsec() - this->_started;
+	__atomic_store_n(&this->_started, 0, __ATOMIC_RELEASE);
+	if (elapsed <= this->_threshold)
+		return (0);
+	this->_stalled = true;
+	return (elapsed);
+}
+
+const char *StallWatchdog::getCallback() const
+{
+	return (this->_callback);
+}
+
+//the stage the loop was stuck in when its stack was taken, or the last one reached
+const char *StallWatchdog::getStage() const
+{
+	if (_stack_generation == this->_generation && _stack_stage != NULL)
+		return (_stack_stage);
+	return (this->_stage);
+}
+
+int StallWatchdog::getFd() const
+{
+	return (this->_fd);
+}
+
+const char *StallWatchdog::getLocation() const
+{
+	return (this->_location);
+}
+
+//the stack taken during the last callback, one frame per line, empty if none was
+std::string StallWatchdog::getBacktrace() const
+{
+	std::string	trace;
+	char		line[32];
+
+	if (_stack_generation != this->_generation || _frames <= 0)
+		return (trace);
+	char **symbols = backtrace_symbols(_stack, _frames);
+	//the first frames are the signal handler and the signal trampoline
+	for (int i = 2; i < _frames; ++i)
+	{
+		snprintf(line, sizeof(line), "\n  #%-2d ", i - 2);
+		trace += line;
+		trace += symbols ? symbols[i] : "?";
+	}
+	free(symbols);
+	return (trace);
+}
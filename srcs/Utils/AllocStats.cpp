@@ -0,0 +1,180 @@
+#include "../../includes/Utils/AllocStats.hpp"
+#include <new>
+#include <stdlib.h>
+
+static ThreadAllocStats				*g_threads = NULL; //every thread's block, newest first
+static __thread ThreadAllocStats	*t_stats = NULL;
+static __thread int					t_phase = ALLOC_PHASE_OTHER;
+static __thread AllocCounts			*t_request = NULL;
+
+static const char	*g_phase_names[ALLOC_PHASE_COUNT] = {"other", "parse", "route", "handle", "respond"};
+
+WebServer::AllocStats::AllocStats() {}
+
+WebServer::AllocStats::~AllocStats() {}
+
+WebServer::AllocStats::AllocStats(const AllocStats &other) { *this = other; }
+
+WebServer::AllocStats &WebServer::AllocStats::operator=(const AllocStats &other)
+{
+	(void)other;
+	return *this;
+}
+
+//the calling thread's block, created (with malloc, not new) and published on first use
+static ThreadAllocStats	*threadStats()
+{
+	if (t_stats != NULL)
+		return (t_stats);
+	ThreadAllocStats *stats = static_cast<ThreadAllocStats *>(calloc(1, sizeof(ThreadAllocStats)));
+	if (stats == NULL)
+		return (NULL);
+	stats->next = __atomic_load_n(&g_threads, __ATOMIC_ACQUIRE);
+	while (!__atomic_compare_exchange_n(&g_threads, &stats->next, stats, true, __ATOMIC_RELEASE, __ATOMIC_ACQUIRE))
+		;
+	t_stats = stats;
+	return (stats);
+}
+
+bool WebServer::AllocStats::enabled()
+{
+#ifdef ALLOC_STATS
+	return (true);
+#else
+	return (false);
+#endif
+}
+
+//name shown for the calling thread: must be a string literal or otherwise outlive it
+void WebServer::AllocStats::nameThread(const char *name)
+{
+	ThreadAllocStats *stats = threadStats();
+
+	if (stats != NULL)
+		__atomic_store_n(&stats->name, name, __ATOMIC_RELEASE);
+}
+
+//returns the phase it replaces
+AllocPhase WebServer::AllocStats::setPhase(AllocPhase phase)
+{
+	AllocPhase previous = static_cast<AllocPhase>(t_phase);
+
+	t_phase = phase;
+	return (previous);
+}
+
+//charges the calling thread's allocations to request as well, until detached
+void WebServer::AllocStats::attach(AllocCounts *request)
+{
+	t_request = request;
+}
+
+//detaches request if it is the one attached: call it before request is destroyed
+void WebServer::AllocStats::detach(const AllocCounts *request)
+{
+	if (t_request == request)
+		t_request = NULL;
+}
+
+//the calling thread's counts over all phases
+AllocCounts WebServer::AllocStats::threadTotal()
+{
+	AllocCounts			total = {0, 0, 0};
+	ThreadAllocStats	*stats = threadStats();
+
+	for (int i = 0; stats != NULL && i < ALLOC_PHASE_COUNT; ++i)
+	{
+		total.allocs += __atomic_load_n(&stats->phases[i].allocs, __ATOMIC_RELAXED);
+		total.frees += __atomic_load_n(&stats->phases[i].frees, __ATOMIC_RELAXED);
+		total.bytes += __atomic_load_n(&stats->phases[i].bytes, __ATOMIC_RELAXED);
+	}
+	return (total);
+}
+
+//a copy of every thread's counts, oldest thread first
+std::vector<ThreadAllocStats> WebServer::AllocStats::snapshot()
+{
+	std::vector<ThreadAllocStats>	threads;
+
+	for (ThreadAllocStats *stats = __atomic_load_n(&g_threads, __ATOMIC_ACQUIRE); stats != NULL; stats = stats->next)
+	{
+		ThreadAllocStats copy;
+		copy.name = __atomic_load_n(&stats->name, __ATOMIC_ACQUIRE);
+		for (int i = 0; i < ALLOC_PHASE_COUNT; ++i)
+		{
+			copy.phases[i].allocs = __atomic_load_n(&stats->phases[i].allocs, __ATOMIC_RELAXED);
+			copy.phases[i].frees = __atomic_load_n(&stats->phases[i].frees, __ATOMIC_RELAXED);
+			copy.phases[i].bytes = __atomic_load_n(&stats->phases[i].bytes, __ATOMIC_RELAXED);
+		}
+		copy.next = NULL;
+		threads.insert(threads.begin(), copy);
+	}
+	return (threads);
+}
+
+const char *WebServer::AllocStats::phaseName(int phase)
+{
+	if (phase < 0 || phase >= ALLOC_PHASE_COUNT)
+		return ("?");
+	return (g_phase_names[phase]);
+}
+
+void WebServer::AllocStats::allocated(size_t bytes)
+{
+	ThreadAllocStats *stats = threadStats();
+
+	if (stats == NULL)
+		return ;
+	AllocCounts &counts = stats->phases[t_phase];
+	__atomic_store_n(&counts.allocs, counts.allocs + 1, __ATOMIC_RELAXED);
+	__atomic_store_n(&counts.bytes, counts.bytes + bytes, __ATOMIC_RELAXED);
+	if (t_request != NULL)
+	{
+		++t_request->allocs;
+		t_request->bytes += bytes;
+	}
+}
+
+void WebServer::AllocStats::freed()
+{
+	ThreadAllocStats *stats = threadStats();
+
+	if (stats == NULL)
+		return ;
+	AllocCounts &counts = stats->phases[t_phase];
+	__atomic_store_n(&counts.frees, counts.frees + 1, __ATOMIC_RELAXED);
+	if (t_request != NULL)
+		++t_request->frees;
+}
+
+#ifdef ALLOC_STATS
+
+void	*operator new(size_t size) throw(std::bad_alloc)
+{
+	void	*ptr = malloc(size ? size : 1);
+
+	if (ptr == NULL)
+		throw std::bad_alloc();
+	WebServer::AllocStats::allocated(size);
+	return (ptr);
+}
+
+void	*operator new[](size_t size) throw(std::bad_alloc)
+{
+	return (operator new(size));
+}
+
+void	operator delete(void *ptr) throw()
+{
+	if (ptr == NULL)
+		return ;
+	WebServer::AllocStats::freed();
+	free(ptr);
+}
+
+void	operator delete[](void *ptr) throw()
+{
+	operator delete(ptr);
+}
+
+#endif
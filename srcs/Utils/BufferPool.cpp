@@ -0,0 +1,82 @@
+#include "../../includes/Utils/BufferPool.hpp"
+#include <new>
+
+static const size_t	g_class_sizes[BUFFER_CLASSES] = {BUFFER_SMALL, BUFFER_MEDIUM, BUFFER_LARGE};
+
+WebServer::BufferPool::FreeBuffer	*WebServer::BufferPool::_free[BUFFER_CLASSES] = {NULL, NULL, NULL};
+size_t								WebServer::BufferPool::_pooled[BUFFER_CLASSES] = {0, 0, 0};
+size_t								WebServer::BufferPool::_borrowed[BUFFER_CLASSES] = {0, 0, 0};
+
+WebServer::BufferPool::BufferPool() {}
+
+WebServer::BufferPool::~BufferPool() {}
+
+WebServer::BufferPool::BufferPool(const BufferPool &other) { *this = other; }
+
+WebServer::BufferPool &WebServer::BufferPool::operator=(const BufferPool &other)
+{
+	(void)other;
+	return *this;
+}
+
+//index of the class of exactly size bytes, -1 if size is not a class size
+int WebServer::BufferPool::_classIndex(size_t size)
+{
+	for (int i = 0; i < BUFFER_CLASSES; ++i)
+		if (g_class_sizes[i] == size)
+			return (i);
+	return (-1);
+}
+
+//the smallest class holding wanted bytes, BUFFER_LARGE if none does
+size_t WebServer::BufferPool::classSize(size_t wanted)
+{
+	for (int i = 0; i < BUFFER_CLASSES; ++i)
+		if (wanted <= g_class_sizes[i])
+			return (g_class_sizes[i]);
+	return (BUFFER_LARGE);
+}
+
+//a buffer of size bytes, which must be a class size; throws std::bad_alloc
+char *WebServer::BufferPool::borrow(size_t size)
+{
+	int i = _classIndex(size);
+
+	if (i < 0)
+		throw std::bad_alloc();
+	++_borrowed[i];
+	if (_free[i] == NULL)
+		return (static_cast<char *>(::operator new(size)));
+	FreeBuffer *buffer = _free[i];
+	_free[i] = buffer->next;
+	--_pooled[i];
+	return (reinterpret_cast<char *>(buffer));
+}
+
+//returns a buffer from borrow(size)
+void WebServer::BufferPool::giveBack(char *buffer, size_t size)
+{
+	int i = _classIndex(size);
+
+	if (buffer == NULL || i < 0)
+		return ;
+	--_borrowed[i];
+	if ((_pooled[i] + 1) * size > BUFFER_POOL_KEEP)
+		return (::operator delete(buffer));
+	FreeBuffer *free_buffer = reinterpret_cast<FreeBuffer *>(buffer);
+	free_buffer->next = _free[i];
+	_free[i] = free_buffer;
+	++_pooled[i];
+}
+
+BufferClassStats WebServer::BufferPool::stats(int index)
+{
+	BufferClassStats stats = {0, 0, 0};
+
+	if (index < 0 || index >= BUFFER_CLASSES)
+		return (stats);
+	stats.size = g_class_sizes[index];
+	stats.borrowed = _borrowed[index];
+	stats.pooled = _pooled[index];
+	return (stats);
+}
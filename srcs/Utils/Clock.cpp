@@ -0,0 +1,158 @@
+# include "../includes/Utils/Clock.hpp"
+# include "../includes/Logger/Logger.hpp"
+
+time_t	WebServer::Clock::_now = 0;
+string	WebServer::Clock::_http_date;
+string	WebServer::Clock::_date_header;
+string	WebServer::Clock::_log_time;
+string	WebServer::Clock::_access_time;
+
+/**
+ * @brief Default constructor for Clock.
+ * Private to prevent instantiation.
+ */
+WebServer::Clock::Clock() {}
+
+/**
+ * @brief Destructor for Clock.
+ * Private to prevent deletion of instances.
+ */
+WebServer::Clock::~Clock() {}
+
+/**
+ * @brief Copy constructor for Clock.
+ * Private to prevent copying of the Clock class.
+ *
+ * @param other The Clock object to copy from.
+ */
+WebServer::Clock::Clock(const Clock &other) { *this = other; }
+
+/**
+ * @brief Assignment operator for Clock.
+ * Private to prevent assignment of the Clock class.
+ *
+ * @param other The Clock object to assign from.
+ * @return Clock& A reference to the updated Clock object.
+ */
+WebServer::Clock &WebServer::Clock::operator=(const Clock &other)
+{
+	(void)other;
+	return *this;
+}
+
+/**
+ * @brief Refreshes the cached strings if the wall clock moved to a new second.
+ *
+ * Called once per event loop tick; every other accessor only reads the cache.
+ */
+void	WebServer::Clock::update()
+{
+	time_t now = time(0);
+
+	if (now != _now)
+		_render(now);
+}
+
+/**
+ * @brief Renders all cached representations of now.
+ *
+ * @param now The second to render.
+ */
+void	WebServer::Clock::_render(time_t now)
+{
+	char		date[64];
+	struct tm	tm;
+
+	_now = now;
+	gmtime_r(&now, &tm);
+	// strftime's %a/%b follow the locale, the server never calls setlocale so they stay in English
+	strftime(date, sizeof(date), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+	_http_date = date;
+	_date_header = "Date: " + _http_date + "\r\n";
+	strftime(date, sizeof(date), "%d/%b/%Y:%H:%M:%S +0000", &tm);
+	_access_time = date;
+	// Add global time shift(GST) and adjust date
+	tm.tm_hour += GST;
+	if (tm.tm_hour >= 24)
+	{
+		tm.tm_hour -= 24;
+		tm.tm_mday += 1;
+	}
+	strftime(date, sizeof(date), "[%Y-%m-%d  %H:%M:%S]   ", &tm);
+	_log_time = date;
+}
+
+/**
+ * @brief The second the cache was last rendered for, rendering it first if needed.
+ *
+ * @return time_t Seconds since the epoch, at most one loop tick old.
+ */
+time_t	WebServer::Clock::now()
+{
+	if (_now == 0)
+		update();
+	return (_now);
+}
+
+/**
+ * @brief Cached IMF-fixdate, e.g. "Sun, 06 Nov 1994 08:49:37 GMT".
+ *
+ * @return const string& The cached date.
+ */
+const string	&WebServer::Clock::httpDate()
+{
+	if (_now == 0)
+		update();
+	return (_http_date);
+}
+
+/**
+ * @brief Cached complete Date header line, CRLF included.
+ *
+ * @return const string& The cached header line.
+ */
+const string	&WebServer::Clock::dateHeader()
+{
+	if (_now == 0)
+		update();
+	return (_date_header);
+}
+
+/**
+ * @brief Cached Logger timestamp prefix in GST (GMT+8).
+ *
+ * @return const string& The cached timestamp.
+ */
+const string	&WebServer::Clock::logTime()
+{
+	if (_now == 0)
+		update();
+	return (_log_time);
+}
+
+/**
+ * @brief Cached access log timestamp, Common Log Format in UTC.
+ *
+ * @return const string& The cached timestamp.
+ */
+const string	&WebServer::Clock::accessTime()
+{
+	if (_now == 0)
+		update();
+	return (_access_time);
+}
+
+/**
+ * @brief Microseconds on the monotonic clock, read on every call.
+ *
+ * Only differences are meaningful: used to time requests and CGI runs.
+ *
+ * @return long Microseconds since an arbitrary start.
+ */
+long	WebServer::Clock::monotonicUsec()
+{
+	struct timespec	ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (ts.tv_sec * 1000000L + ts.tv_nsec / 1000);
+}
@@ -1,6 +1,8 @@
 # include "../includes/Utils/Utils.hpp"
 # include <sys/stat.h>
 
+volatile sig_atomic_t WebServer::Utils::_stop_signal = 0;
+
 /**
  * @brief Default constructor for Utils.
  * Private to prevent instantiation.
@@ -38,16 +40,22 @@ WebServer::Utils& WebServer::Utils::operator=(const Utils& other)
 /**
  * @brief Handles signals received by the server.
  *
- * Logs the received signal and exits the application.
+ * Only records the signal: logging, flushing and exiting are not
+ * async-signal-safe, so the event loop shuts down once it sees stopSignal().
  *
  * @param signum The signal number to handle (e.g., SIGINT, SIGTERM).
  */
 void WebServer::Utils::signalHandler(int signum)
 {
-	WebServer::Logger *logManager = WebServer::Logger::getInstance();
+	_stop_signal = signum;
+}
 
-	logManager->logMsg(RED, "Interrup signal (%d) received.\n", signum);
-	exit(signum);
+/**
+ * @brief The signal that asked the server to stop, 0 while it runs.
+ */
+int WebServer::Utils::stopSignal()
+{
+	return (_stop_signal);
 }
 
 /**
@@ -161,46 +169,149 @@ std::string WebServer::Utils::getConfigFilePath(int argc, char** argv)
 {
 	if (argc > 2)
 	{
-		WebServer::Logger *logManager = WebServer::Logger::getInstance();
-		logManager->logMsg(RED, "Error: Wrong number of arguments.");
-		logManager->logMsg(RED, "Usage: ./webserv or ./webserv [config file path]");
+		WS_ERROR("Error: Wrong number of arguments.");
+		WS_ERROR("Usage: ./webserv or ./webserv [config file path]");
 		throw std::invalid_argument("Invalid arguments.");
 	}
 	return ((argc == 1)? "configs/default.conf" : argv[1]);
 }
 
-// Helper function to initialise the vector
-std::vector<std::pair<short, std::string> > WebServer::Utils::initialiseStatusCodes()
+/**
+ * Pre-rendered status lines, one table per status class, indexed by code % 100.
+ * Built by the compiler so a lookup is two array indexes and never allocates.
+ */
+#define STATUS_LINE(code, reason) { "HTTP/1.1 " #code " " reason "\r\n", sizeof("HTTP/1.1 " #code " " reason "\r\n") - 1 }
+#define NO_STATUS_LINE { NULL, 0 }
+
+struct StatusLine
+{
+	const char	*line;
+	size_t		len;
+};
+
+static const StatusLine g_status_1xx[] = {
+	STATUS_LINE(100, "Continue"),
+	STATUS_LINE(101, "Switching Protocols")
+};
+
+static const StatusLine g_status_2xx[] = {
+	STATUS_LINE(200, "OK"),
+	STATUS_LINE(201, "Created"),
+	STATUS_LINE(202, "Accepted"),
+	NO_STATUS_LINE,
+	STATUS_LINE(204, "No Content"),
+	NO_STATUS_LINE,
+	STATUS_LINE(206, "Partial Content")
+};
+
+static const StatusLine g_status_3xx[] = {
+	NO_STATUS_LINE,
+	STATUS_LINE(301, "Moved Permanently"),
+	STATUS_LINE(302, "Found"),
+	STATUS_LINE(303, "See Other"),
+	STATUS_LINE(304, "Not Modified"),
+	NO_STATUS_LINE,
+	NO_STATUS_LINE,
+	STATUS_LINE(307, "Temporary Redirect"),
+	STATUS_LINE(308, "Permanent Redirect")
+};
+
+static const StatusLine g_status_4xx[] = {
+	STATUS_LINE(400, "Bad Request"),
+	STATUS_LINE(401, "Unauthorized"),
+	NO_STATUS_LINE,
+	STATUS_LINE(403, "Forbidden"),
+	STATUS_LINE(404, "Not Found"),
+	STATUS_LINE(405, "Method Not Allowed"),
+	NO_STATUS_LINE,
+	NO_STATUS_LINE,
+	STATUS_LINE(408, "Request Timeout"),
+	NO_STATUS_LINE,
+	NO_STATUS_LINE,
+	STATUS_LINE(411, "Length Required"),
+	NO_STATUS_LINE,
+	STATUS_LINE(413, "Payload Too Large"),
+	STATUS_LINE(414, "URI Too Long"),
+	STATUS_LINE(415, "Unsupported Media Type")
+};
+
+static const StatusLine g_status_5xx[] = {
+	STATUS_LINE(500, "Internal Server Error"),
+	STATUS_LINE(501, "Not Implemented"),
+	STATUS_LINE(502, "Bad Gateway"),
+	STATUS_LINE(503, "Service Unavailable"),
+	STATUS_LINE(504, "Gateway Timeout"),
+	STATUS_LINE(505, "HTTP Version Not Supported")
+};
+
+static const struct
 {
-	std::vector<std::pair<short, std::string> > codes;
-	codes.push_back(std::make_pair(200, "OK"));
-	codes.push_back(std::make_pair(201, "Created"));
-	codes.push_back(std::make_pair(204, "No Content"));
-	codes.push_back(std::make_pair(301, "Moved Permanently"));
-	codes.push_back(std::make_pair(302, "Found"));
-	codes.push_back(std::make_pair(304, "Not Modified"));
-	codes.push_back(std::make_pair(400, "Bad Request"));
-	codes.push_back(std::make_pair(401, "Unauthorized"));
-	codes.push_back(std::make_pair(403, "Forbidden"));
-	codes.push_back(std::make_pair(404, "Not Found"));
-	codes.push_back(std::make_pair(500, "Internal Server Error"));
-	codes.push_back(std::make_pair(501, "Not Implemented"));
-	codes.push_back(std::make_pair(502, "Bad Gateway"));
-	codes.push_back(std::make_pair(503, "Service Unavailable"));
-	return (codes);
+	const StatusLine	*table;
+	size_t				size;
+} g_status_classes[] = {
+	{ g_status_1xx, sizeof(g_status_1xx) / sizeof(g_status_1xx[0]) },
+	{ g_status_2xx, sizeof(g_status_2xx) / sizeof(g_status_2xx[0]) },
+	{ g_status_3xx, sizeof(g_status_3xx) / sizeof(g_status_3xx[0]) },
+	{ g_status_4xx, sizeof(g_status_4xx) / sizeof(g_status_4xx[0]) },
+	{ g_status_5xx, sizeof(g_status_5xx) / sizeof(g_status_5xx[0]) }
+};
+
+/**
+ * @brief Looks up the pre-rendered status line for a status code.
+ *
+ * @param statusCode The HTTP status code.
+ * @param len Set to the length of the line, CRLF included.
+ * @return const char* "HTTP/1.1 NNN Reason\r\n", or NULL if the code is unknown.
+ */
+const char *WebServer::Utils::statusLine(short statusCode, size_t &len)
+{
+	len = 0;
+	if (statusCode < 100 || statusCode > 599)
+		return (NULL);
+	size_t cls = statusCode / 100 - 1;
+	size_t idx = statusCode % 100;
+	if (idx >= g_status_classes[cls].size || g_status_classes[cls].table[idx].line == NULL)
+		return (NULL);
+	len = g_status_classes[cls].table[idx].len;
+	return (g_status_classes[cls].table[idx].line);
 }
 
 std::string WebServer::Utils::statusCodeString(short statusCode)
 {
-	static const std::vector<std::pair<short, std::string> > codes = initialiseStatusCodes();
+	size_t		len;
+	const char	*line = statusLine(statusCode, len);
+
+	if (line == NULL)
+		return ("Undefined");
+	// skip "HTTP/1.1 NNN " and drop the trailing CRLF
+	return (std::string(line + 13, len - 15));
+}
+
+/**
+ * @brief Guesses the Content-Type of a file from its extension.
+ *
+ * @param path The path of the file.
+ * @return const char* The media type, "application/octet-stream" if unknown.
+ */
+const char *WebServer::Utils::getMimeType(const std::string &path)
+{
+	static const char *const types[][2] = {
+		{".html", "text/html"}, {".htm", "text/html"}, {".css", "text/css"},
+		{".js", "application/javascript"}, {".json", "application/json"},
+		{".txt", "text/plain"}, {".jpeg", "image/jpeg"}, {".jpg", "image/jpeg"},
+		{".png", "image/png"}, {".gif", "image/gif"}, {".ico", "image/x-icon"},
+		{".svg", "image/svg+xml"}, {".pdf", "application/pdf"}
+	};
+	size_t dot = path.rfind('.');
 
-	for (size_t i = 0; i < codes.size(); ++i)
+	if (dot == std::string::npos || path.find('/', dot) != std::string::npos)
+		return ("application/octet-stream");
+	for (size_t i = 0; i < sizeof(types) / sizeof(types[0]); ++i)
 	{
-		if (codes[i].first == statusCode) {
-			return (codes[i].second);
-		}
+		if (path.compare(dot, std::string::npos, types[i][0]) == 0)
+			return (types[i][1]);
 	}
-	return ("Undefined");
+	return ("application/octet-stream");
 }
 
 void WebServer::Utils::checkFinalToken(std::string &parameters)
@@ -14,18 +14,29 @@ int main(int argc, char **argv)
 	try 
 	{
         signal(SIGINT, WebServer::Utils::signalHandler);
+        signal(SIGTERM, WebServer::Utils::signalHandler);
 		signal(SIGPIPE, handleSigpipe);
+		signal(SIGUSR1, AccessLog::handleSignal);
 		std::string configFilePath = WebServer::Utils::getConfigFilePath(argc, argv);
 		ConfigParser	configParser;
 		configParser.extractServerBlocks(configFilePath);
+		WebServer::Logger::setLevel(configParser.getLogLevel());
+		if (!WebServer::Logger::getInstance()->start(configParser.getErrorLog(), configParser.getLogOverflow()))
+			std::cerr << "webserv: cannot open error_log " << configParser.getErrorLog() << ", logging synchronously" << std::endl;
 		Router 	Router;
+		Router.setSampling(configParser.getLogSample());
+		Router.setTracing(configParser.getRequestTrace());
+		Router.setStallThreshold(configParser.getStallThreshold());
 		Router.setupServers(configParser.getServers());
 		Router.runServers();
 	}
 	catch (std::exception &e)
 	{
+		WebServer::Logger::getInstance()->stop();
 		std::cerr << "Error: " << e.what() << std::endl;
 		return (1);
 	}
-	return (0);
+	//let the writer thread flush what is still in the ring
+	WebServer::Logger::getInstance()->stop();
+	return (WebServer::Utils::stopSignal());
 }